@@ -1,13 +1,24 @@
 #include "atlas/alloc.hpp"
+#include "atlas/btree_map.hpp"
 #include "atlas/hash.hpp"
 #include "atlas/hashmap.hpp"
+#include "atlas/hashset.hpp"
+#include "atlas/interval_tree.hpp"
 #include "atlas/map.hpp"
+#include "atlas/pairing_heap.hpp"
+#include "atlas/radix_tree.hpp"
 #include <absl/container/flat_hash_map.h>
+#include <atlas/ctrie.hpp>
 #include <atlas/hamt.hpp>
+#include <atlas/persistent_hamt.hpp>
+#include <atlas/siphash.hpp>
 #include <benchmark/benchmark.h>
 #include <frg/hash_map.hpp>
+#include <algorithm>
 #include <fstream>
 #include <parallel_hashmap/phmap.h>
+#include <queue>
+#include <random>
 #include <unordered_map>
 
 namespace atlas::impl {
@@ -282,8 +293,782 @@ void phashmap_benchmark(benchmark::State &state) {
     }
   }
 }
+// Tables used by the lookup benchmarks are much bigger than the LLC, so that
+// every lookup misses the cache
+constexpr size_t BIG_TABLE_SIZE = 1 << 22;
+
+static std::vector<uint64_t> shuffled_keys(size_t count) {
+  std::vector<uint64_t> keys(count);
+  for (size_t i = 0; i < count; i++) {
+    keys[i] = i * 0x9e3779b97f4a7c15LLU;
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+  return keys;
+}
+
+void hash_map_get_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(BIG_TABLE_SIZE);
+  atlas::HashMap<uint64_t, uint64_t> map(BIG_TABLE_SIZE);
+
+  for (auto key : keys) {
+    (void)map.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+
+  for (auto _ : state) {
+    for (auto key : keys) {
+      benchmark::DoNotOptimize(map.get(key));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+void hash_map_get_many_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(BIG_TABLE_SIZE);
+  atlas::HashMap<uint64_t, uint64_t> map(BIG_TABLE_SIZE);
+
+  for (auto key : keys) {
+    (void)map.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+  std::vector<atlas::Option<uint64_t>> out(keys.size());
+
+  for (auto _ : state) {
+    map.get_many({keys.data(), keys.size()}, {out.data(), out.size()});
+    benchmark::DoNotOptimize(out.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+// Ordered lookups of 1M keys in random order
+template <typename M> void ordered_map_get_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(1 << 20);
+  M map;
+
+  for (auto key : keys) {
+    (void)map.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+
+  for (auto _ : state) {
+    for (auto key : keys) {
+      benchmark::DoNotOptimize(map.get(key));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(ordered_map_get_benchmark<atlas::Map<uint64_t, uint64_t>>);
+BENCHMARK(ordered_map_get_benchmark<atlas::BTreeMap<uint64_t, uint64_t>>);
+
+// Lookups of 1M page-index like keys, three quarters of a dense range
+template <typename M> void dense_keys_get_benchmark(benchmark::State &state) {
+  std::vector<uint64_t> keys;
+  M map;
+
+  for (uint64_t i = 0; i < (1 << 20) * 4 / 3; i++) {
+    if (i % 4 != 3) {
+      keys.push_back(i);
+    }
+  }
+
+  for (auto key : keys) {
+    (void)map.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+
+  for (auto _ : state) {
+    for (auto key : keys) {
+      benchmark::DoNotOptimize(map.get(key));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(dense_keys_get_benchmark<atlas::Map<uint64_t, uint64_t>>);
+BENCHMARK(dense_keys_get_benchmark<atlas::HashMap<uint64_t, uint64_t>>);
+BENCHMARK(dense_keys_get_benchmark<atlas::RadixTree<uint64_t>>);
+
+// Build a Map of 1M sorted entries and tear it down
+template <bool Sorted> void map_build_benchmark(benchmark::State &state) {
+  atlas::Vec<atlas::Cons<uint64_t, uint64_t>> entries;
+
+  for (uint64_t i = 0; i < (1 << 20); i++) {
+    entries.push(atlas::cons(i, i));
+  }
+
+  for (auto _ : state) {
+    if constexpr (Sorted) {
+      auto map =
+          atlas::Map<uint64_t, uint64_t>::from_sorted(entries.iter()).take();
+      benchmark::DoNotOptimize(map.size());
+    } else {
+      atlas::Map<uint64_t, uint64_t> map;
+      for (auto &entry : entries) {
+        (void)map.insert(entry.car, entry.cdr);
+      }
+      benchmark::DoNotOptimize(map.size());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+BENCHMARK(map_build_benchmark<false>);
+BENCHMARK(map_build_benchmark<true>);
+
+// Find the entries of a 1M snapshot that are gone from the next one, either
+// by looking each of them up or with a merge
+template <bool Merge> void map_difference_benchmark(benchmark::State &state) {
+  atlas::Map<uint64_t, uint64_t> old_map, new_map;
+
+  for (uint64_t i = 0; i < (1 << 20); i++) {
+    (void)old_map.insert(i * 2, i);
+
+    if (i % 16 != 0) {
+      (void)new_map.insert(i * 2, i);
+    }
+  }
+
+  for (auto _ : state) {
+    if constexpr (Merge) {
+      auto gone = old_map.difference(new_map);
+      benchmark::DoNotOptimize(gone.size());
+    } else {
+      atlas::Map<uint64_t, uint64_t> gone;
+      old_map.iter().for_each([&](auto &e) {
+        if (new_map.get(e.car).is_none()) {
+          (void)gone.insert(e.car, e.cdr);
+        }
+      });
+      benchmark::DoNotOptimize(gone.size());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * old_map.size());
+}
+
+BENCHMARK(map_difference_benchmark<false>);
+BENCHMARK(map_difference_benchmark<true>);
+
+struct Blob {
+  uint64_t words[8];
+};
+
+// Sum one word of every value of a 1M entries map, either through copies of
+// the entries or through the references yielded by iter()
+template <bool Copy> void map_scan_benchmark(benchmark::State &state) {
+  atlas::Map<uint64_t, Blob> map;
+
+  for (uint64_t i = 0; i < (1 << 20); i++) {
+    (void)map.insert(i, Blob{{i}});
+  }
+
+  for (auto _ : state) {
+    uint64_t sum = 0;
+
+    if constexpr (Copy) {
+      map.iter().for_each([&](atlas::Cons<uint64_t, Blob> entry) {
+        sum += entry.cdr.words[0];
+      });
+    } else {
+      map.iter().for_each([&](auto &entry) { sum += entry.cdr.words[0]; });
+    }
+
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(state.iterations() * map.size());
+}
+
+BENCHMARK(map_scan_benchmark<true>);
+BENCHMARK(map_scan_benchmark<false>);
+
+struct Region {
+  uint64_t start;
+  uint64_t end;
+
+  atlas::RBTreeNode<Region> hook;
+  uint64_t max_end;
+};
+
+// Find the regions overlapping a small window among 64K short regions, either
+// with the subtree max-end or by walking the regions in order
+template <bool Augmented>
+void interval_overlap_benchmark(benchmark::State &state) {
+  atlas::IntervalTree<Region, &Region::hook, uint64_t, &Region::start,
+                      &Region::end, &Region::max_end>
+      tree;
+  std::vector<Region> regions(1 << 16);
+  std::mt19937_64 rng(1);
+
+  for (auto &region : regions) {
+    region.start = rng() % (1 << 30);
+    region.end = region.start + 1 + rng() % 4096;
+    tree.insert(&region);
+  }
+
+  std::vector<uint64_t> queries(1024);
+  for (auto &query : queries) {
+    query = rng() % (1 << 30);
+  }
+
+  for (auto _ : state) {
+    for (auto start : queries) {
+      auto end = start + 4096;
+      size_t found = 0;
+
+      if constexpr (Augmented) {
+        for (auto region : tree.overlapping(start, end)) {
+          found += region->end - region->start;
+        }
+      } else {
+        for (auto region : tree.iter()) {
+          if (region->start >= end) {
+            break;
+          }
+
+          if (start < region->end) {
+            found += region->end - region->start;
+          }
+        }
+      }
+
+      benchmark::DoNotOptimize(found);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * queries.size());
+}
+
+BENCHMARK(interval_overlap_benchmark<false>);
+BENCHMARK(interval_overlap_benchmark<true>);
+
+struct Timer {
+  uint64_t deadline;
+
+  atlas::RBTreeNode<Timer> hook;
+};
+
+// Every tick fires the earliest of 64K timers and rearms it
+template <bool Cached> void timer_tick_benchmark(benchmark::State &state) {
+  atlas::RBTree<Timer, &Timer::hook, uint64_t, &Timer::deadline,
+                atlas::RBNoAugment, Cached>
+      tree;
+  std::vector<Timer> timers(1 << 16);
+  std::mt19937_64 rng(1);
+
+  for (auto &timer : timers) {
+    timer.deadline = rng() % (1 << 20);
+    tree.insert(&timer);
+  }
+
+  for (auto _ : state) {
+    auto timer = tree.pop_first().unwrap();
+    timer->deadline += 1 << 20;
+    tree.insert(timer);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(timer_tick_benchmark<false>);
+BENCHMARK(timer_tick_benchmark<true>);
+
+struct HeapEntry {
+  uint64_t key;
+
+  atlas::PairingHeapNode<HeapEntry> hook;
+};
+
+using EntryHeap = atlas::PairingHeap<
+    HeapEntry, &HeapEntry::hook,
+    [](HeapEntry *a, HeapEntry *b) { return a->key < b->key; }>;
+
+using BinaryHeap =
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>>;
+
+// Insert BIG_TABLE_SIZE random keys, then pop them all
+template <bool Pairing> void heap_drain_benchmark(benchmark::State &state) {
+  std::vector<HeapEntry> entries(BIG_TABLE_SIZE);
+  std::mt19937_64 rng(1);
+
+  for (auto &entry : entries) {
+    entry.key = rng();
+  }
+
+  for (auto _ : state) {
+    if constexpr (Pairing) {
+      EntryHeap heap;
+
+      for (auto &entry : entries) {
+        heap.insert(&entry);
+      }
+
+      while (auto entry = heap.pop()) {
+        benchmark::DoNotOptimize(entry.unwrap());
+      }
+    } else {
+      BinaryHeap heap;
+
+      for (auto &entry : entries) {
+        heap.push(entry.key);
+      }
+
+      while (!heap.empty()) {
+        benchmark::DoNotOptimize(heap.top());
+        heap.pop();
+      }
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+BENCHMARK(heap_drain_benchmark<false>);
+BENCHMARK(heap_drain_benchmark<true>);
+
+// Keep 64K keys in the heap, every step pops the minimum and pushes it back
+// with a later key
+template <bool Pairing> void heap_mixed_benchmark(benchmark::State &state) {
+  std::vector<HeapEntry> entries(1 << 16);
+  std::mt19937_64 rng(1);
+  EntryHeap pairing;
+  BinaryHeap binary;
+
+  for (auto &entry : entries) {
+    entry.key = rng() % (1 << 20);
+
+    if constexpr (Pairing) {
+      pairing.insert(&entry);
+    } else {
+      binary.push(entry.key);
+    }
+  }
+
+  for (auto _ : state) {
+    auto delay = rng() % (1 << 20);
+
+    if constexpr (Pairing) {
+      auto entry = pairing.pop().unwrap();
+      entry->key += delay;
+      pairing.insert(entry);
+    } else {
+      auto key = binary.top();
+      binary.pop();
+      binary.push(key + delay);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(heap_mixed_benchmark<false>);
+BENCHMARK(heap_mixed_benchmark<true>);
+
+void hamt_get_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(BIG_TABLE_SIZE);
+  atlas::Hamt<uint64_t, uint64_t> hamt;
+
+  for (auto key : keys) {
+    hamt.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+
+  for (auto _ : state) {
+    for (auto key : keys) {
+      benchmark::DoNotOptimize(hamt.get(key));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+void hamt_get_many_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(BIG_TABLE_SIZE);
+  atlas::Hamt<uint64_t, uint64_t> hamt;
+
+  for (auto key : keys) {
+    hamt.insert(key, key);
+  }
+
+  std::shuffle(keys.begin(), keys.end(), std::mt19937_64(1));
+  std::vector<atlas::Option<uint64_t>> out(keys.size());
+
+  for (auto _ : state) {
+    hamt.get_many({keys.data(), keys.size()}, {out.data(), out.size()});
+    benchmark::DoNotOptimize(out.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+static uint64_t sip_hash13_fixed_key(const void *key, size_t len,
+                                    uint64_t seed) {
+  return atlas::sip_hash13(seed, ~seed, key, len);
+}
+
+// Hash throughput across key lengths, for the default hash and murmur
+template <uint64_t (*F)(const void *, size_t, uint64_t)>
+void hash_throughput_benchmark(benchmark::State &state) {
+  std::vector<uint8_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i * 31;
+  }
+
+  uint64_t seed = 0;
+  for (auto _ : state) {
+    seed = F(data.data(), data.size(), seed);
+    benchmark::DoNotOptimize(seed);
+  }
+
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+void integer_hash_benchmark(benchmark::State &state) {
+  uint64_t key = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(atlas::Hash<uint64_t>()(key++));
+  }
+}
+
+void murmur_integer_hash_benchmark(benchmark::State &state) {
+  uint64_t key = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(atlas::MurmurHash<uint64_t>()(key++));
+  }
+}
+
+// Hash quality: flip every input bit of many keys and report the worst
+// deviation from a 50% chance of flipping each output bit (avalanche bias),
+// plus the fullest bucket when hashing sequential keys into 2^16 buckets
+template <typename H, size_t L>
+void hash_quality_benchmark(benchmark::State &state) {
+  constexpr size_t KEYS = 1 << 12;
+  double worst_bias = 0;
+  size_t max_load = 0;
+
+  auto hash = [](const uint8_t *key) {
+    if constexpr (L == 8) {
+      uint64_t v;
+      memcpy(&v, key, 8);
+      return H()(v);
+    } else {
+      return H()(atlas::StringView((const char *)key, L));
+    }
+  };
+
+  for (auto _ : state) {
+    std::vector<size_t> flips(L * 8 * 64);
+    std::mt19937_64 rng(7);
+    uint8_t key[L];
+
+    for (size_t k = 0; k < KEYS; k++) {
+      for (auto &byte : key) {
+        byte = rng();
+      }
+
+      auto reference = hash(key);
+
+      for (size_t bit = 0; bit < L * 8; bit++) {
+        key[bit / 8] ^= 1 << (bit % 8);
+        auto diff = reference ^ hash(key);
+        key[bit / 8] ^= 1 << (bit % 8);
+
+        for (size_t out = 0; out < 64; out++) {
+          flips[bit * 64 + out] += (diff >> out) & 1;
+        }
+      }
+    }
+
+    worst_bias = 0;
+    for (auto count : flips) {
+      worst_bias = std::max(worst_bias, std::abs(double(count) / KEYS - 0.5));
+    }
+
+    std::vector<size_t> buckets(1 << 16);
+    for (uint64_t i = 0; i < (1 << 20); i++) {
+      memset(key, 0, L);
+      memcpy(key, &i, std::min(L, sizeof(i)));
+      max_load = std::max(max_load, ++buckets[hash(key) & 0xffff]);
+    }
+  }
+
+  state.counters["worst_bias"] = worst_bias;
+  state.counters["max_bucket_load"] = max_load;
+}
+
+BENCHMARK(hash_throughput_benchmark<atlas::wy_hash>)
+    ->RangeMultiplier(4)
+    ->Range(4, 16384);
+BENCHMARK(hash_throughput_benchmark<atlas::murmur_hash>)
+    ->RangeMultiplier(4)
+    ->Range(4, 16384);
+BENCHMARK(hash_throughput_benchmark<sip_hash13_fixed_key>)
+    ->RangeMultiplier(4)
+    ->Range(4, 16384);
+BENCHMARK(integer_hash_benchmark);
+BENCHMARK(murmur_integer_hash_benchmark);
+BENCHMARK(hash_quality_benchmark<atlas::Hash<uint64_t>, 8>)->Iterations(1);
+BENCHMARK(hash_quality_benchmark<atlas::MurmurHash<uint64_t>, 8>)
+    ->Iterations(1);
+BENCHMARK(hash_quality_benchmark<atlas::Hash<atlas::StringView>, 24>)
+    ->Iterations(1);
+BENCHMARK(hash_quality_benchmark<atlas::MurmurHash<atlas::StringView>, 24>)
+    ->Iterations(1);
+
+// Overhead of keyed hashing on a string table
+template <typename H> void string_map_benchmark(benchmark::State &state) {
+  std::vector<std::string> words;
+  std::mt19937_64 rng(3);
+
+  for (size_t i = 0; i < (1 << 16); i++) {
+    words.push_back(std::to_string(rng()) + "_key");
+  }
+
+  for (auto _ : state) {
+    atlas::HashMap<atlas::StringView, size_t, atlas::DefaultAllocator, H> map;
+
+    for (auto &word : words) {
+      (void)map.insert({word.data(), word.size()}, word.size());
+    }
+
+    for (auto &word : words) {
+      benchmark::DoNotOptimize(map.get({word.data(), word.size()}));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * words.size());
+}
+
+BENCHMARK(string_map_benchmark<atlas::Hash<atlas::StringView>>);
+BENCHMARK(string_map_benchmark<atlas::SipHash<atlas::StringView>>);
+
+// Batch hashing against hashing one key at a time
+template <bool Batch> void hash_integers_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(4096);
+  std::vector<uint64_t> out(keys.size());
+
+  for (auto _ : state) {
+    if constexpr (Batch) {
+      atlas::hash_batch(atlas::Slice<const uint64_t>(keys.data(), keys.size()),
+                        atlas::Slice<uint64_t>(out.data(), out.size()));
+    } else {
+      for (size_t i = 0; i < keys.size(); i++) {
+        out[i] = atlas::Hash<uint64_t>()(keys[i]);
+      }
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+template <bool Batch> void hash_map_build_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(1 << 20);
+
+  for (auto _ : state) {
+    atlas::HashSet<uint64_t> set;
+
+    if constexpr (Batch) {
+      (void)set.insert_many(
+          atlas::Slice<const uint64_t>(keys.data(), keys.size()));
+    } else {
+      set.reserve(keys.size());
+      for (auto key : keys) {
+        (void)set.insert(key);
+      }
+    }
+    benchmark::DoNotOptimize(set.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(hash_integers_benchmark<false>);
+BENCHMARK(hash_integers_benchmark<true>);
+BENCHMARK(hash_map_build_benchmark<false>);
+BENCHMARK(hash_map_build_benchmark<true>);
+
+// Build a Hamt from scratch and tear it down, this is dominated by resizing
+// branch tables
+void hamt_insert_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(1 << 20);
+
+  for (auto _ : state) {
+    atlas::Hamt<uint64_t, uint64_t> hamt;
+
+    for (auto key : keys) {
+      hamt.insert(key, key);
+    }
+
+    benchmark::DoNotOptimize(hamt.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(hamt_insert_benchmark);
+
+// Building the same trie from entries that are already sorted by hash
+void hamt_bulk_build_benchmark(benchmark::State &state) {
+  using Hamt = atlas::Hamt<uint64_t, uint64_t>;
+  auto keys = shuffled_keys(1 << 20);
+
+  std::vector<atlas::Cons<uint64_t, uint64_t>> entries;
+  entries.reserve(keys.size());
+
+  for (auto key : keys) {
+    entries.push_back(atlas::cons(key, key));
+  }
+
+  std::sort(entries.begin(), entries.end(), [](auto &a, auto &b) {
+    return Hamt::trie_order(atlas::Hash<uint64_t>()(a.car)) <
+           Hamt::trie_order(atlas::Hash<uint64_t>()(b.car));
+  });
+
+  for (auto _ : state) {
+    auto hamt = Hamt::from_sorted_by_hash(
+        atlas::Slice<const atlas::Cons<uint64_t, uint64_t>>(entries.data(),
+                                                            entries.size()));
+
+    benchmark::DoNotOptimize(hamt.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+BENCHMARK(hamt_bulk_build_benchmark);
+
+// Concurrent lookups on a shared Ctrie, run with 1 to 8 threads
+void ctrie_get_benchmark(benchmark::State &state) {
+  static atlas::Ctrie<uint64_t, uint64_t> *ctrie;
+  static std::vector<uint64_t> keys;
+
+  if (state.thread_index() == 0) {
+    keys = shuffled_keys(1 << 20);
+    ctrie = new atlas::Ctrie<uint64_t, uint64_t>();
+
+    for (auto key : keys) {
+      ctrie->insert(key, key);
+    }
+  }
+
+  size_t i = state.thread_index() * 7919;
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ctrie->get(keys[i++ & (keys.size() - 1)]));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    delete ctrie;
+  }
+}
+
+// Concurrent inserts of disjoint keys into a shared Ctrie
+void ctrie_insert_benchmark(benchmark::State &state) {
+  static atlas::Ctrie<uint64_t, uint64_t> *ctrie;
+
+  if (state.thread_index() == 0) {
+    ctrie = new atlas::Ctrie<uint64_t, uint64_t>();
+  }
+
+  uint64_t key = uint64_t(state.thread_index()) << 40;
+
+  for (auto _ : state) {
+    ctrie->insert(key, key);
+    key++;
+  }
+
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    delete ctrie;
+  }
+}
+
+// Take a snapshot of a persistent map and update it
+void persistent_hamt_update_benchmark(benchmark::State &state) {
+  auto keys = shuffled_keys(1 << 16);
+  atlas::PersistentHamt<uint64_t, uint64_t> map;
+
+  for (auto key : keys) {
+    map = map.insert(key, key);
+  }
+
+  size_t i = 0;
+
+  for (auto _ : state) {
+    auto snapshot = map;
+    map = snapshot.insert(keys[i & (keys.size() - 1)], i);
+    i++;
+    benchmark::DoNotOptimize(snapshot.size());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(persistent_hamt_update_benchmark);
+
+// Apply a batch of updates to a persistent map, one version per update or
+// through a transient
+template <bool Transient>
+void persistent_hamt_batch_benchmark(benchmark::State &state) {
+  constexpr size_t BATCH = 4096;
+
+  auto keys = shuffled_keys(1 << 16);
+  atlas::PersistentHamt<uint64_t, uint64_t> map;
+
+  for (auto key : keys) {
+    map = map.insert(key, key);
+  }
+
+  size_t i = 0;
+
+  for (auto _ : state) {
+    if constexpr (Transient) {
+      auto batch = map.transient();
+
+      for (size_t j = 0; j < BATCH; j++, i++) {
+        batch.insert(keys[i & (keys.size() - 1)], i);
+      }
+
+      map = batch.commit();
+    } else {
+      for (size_t j = 0; j < BATCH; j++, i++) {
+        map = map.insert(keys[i & (keys.size() - 1)], i);
+      }
+    }
+
+    benchmark::DoNotOptimize(map.size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * BATCH);
+}
+
+BENCHMARK(persistent_hamt_batch_benchmark<false>);
+BENCHMARK(persistent_hamt_batch_benchmark<true>);
+
 #if 1
+BENCHMARK(hash_map_get_benchmark);
+BENCHMARK(hash_map_get_many_benchmark);
+BENCHMARK(hamt_get_benchmark);
+BENCHMARK(hamt_get_many_benchmark);
 BENCHMARK(hamt_benchmark);
+BENCHMARK(ctrie_get_benchmark)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(ctrie_insert_benchmark)->ThreadRange(1, 8)->UseRealTime();
 BENCHMARK(frg_map_benchmark);
 BENCHMARK(absl_map_benchmark);
 BENCHMARK(phashmap_benchmark);
@@ -17,6 +17,16 @@ template <std::integral T> constexpr T align_down(T value, T alignment) {
 static_assert(align_up(4092, 4096) == 4096);
 static_assert(align_down(4092, 4096) == 0);
 
+/// Hint the CPU to pull the cache line containing `addr`, used to overlap
+/// memory latency in batched lookups
+inline void prefetch(const void *addr) {
+#if defined(__clang__) || defined(__GNUC__)
+  __builtin_prefetch(addr);
+#else
+  (void)addr;
+#endif
+}
+
 struct None {};
 
 constexpr inline auto NONE = None{};
@@ -0,0 +1,704 @@
+#pragma once
+#include "alloc.hpp"
+#include "assert.hpp"
+#include "cons.hpp"
+#include "iter.hpp"
+#include "map.hpp"
+#include "option.hpp"
+#include "result.hpp"
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__) && __has_include(<immintrin.h>)
+#include <immintrin.h>
+#endif
+
+namespace atlas {
+
+namespace detail {
+
+// How many of the sorted `keys` are smaller than `key`. Every key is
+// compared, without branches, so that the loop is vectorized
+template <std::integral K>
+inline size_t count_less(const K *keys, size_t count, K key) {
+  size_t ret = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    ret += keys[i] < key;
+  }
+
+  return ret;
+}
+
+#if defined(__AVX2__) && __has_include(<immintrin.h>)
+
+// 64-bit keys, four at a time. AVX2 only compares signed integers, so
+// unsigned ones are flipped into the signed range first.
+template <std::integral K>
+  requires(sizeof(K) == 8)
+inline size_t count_less(const K *keys, size_t count, K key) {
+  constexpr uint64_t BIAS = std::is_signed_v<K> ? 0 : 1ULL << 63;
+
+  auto bias = _mm256_set1_epi64x(BIAS);
+  auto needle = _mm256_set1_epi64x(static_cast<uint64_t>(key) ^ BIAS);
+  size_t ret = 0;
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    auto group =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+    auto less = _mm256_cmpgt_epi64(needle, _mm256_xor_si256(group, bias));
+    auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(less));
+
+    ret += __builtin_popcount(mask);
+
+    // Keys are sorted, nothing past a group that isn't all smaller is
+    if (mask != 0xf) {
+      return ret;
+    }
+  }
+
+  for (; i < count; i++) {
+    ret += keys[i] < key;
+  }
+
+  return ret;
+}
+
+#endif
+
+} // namespace detail
+
+/// An ordered map backed by a B-tree
+/// Every node holds up to CAPACITY keys next to each other, sized to span a
+/// few cache lines, so a lookup touches one node per level and searches it
+/// linearly (with SIMD for integer keys) instead of chasing a pointer per
+/// key like Map does.
+template <typename K, typename V, Allocator A = DefaultAllocator>
+class BTreeMap {
+
+public:
+  BTreeMap(A alloc = A()) : alloc_(alloc) {}
+
+  BTreeMap(BTreeMap &&other)
+      : root_(other.root_), alloc_(std::move(other.alloc_)),
+        size_(other.size_) {
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+
+  BTreeMap(const BTreeMap &other) = delete;
+  BTreeMap &operator=(const BTreeMap &other) = delete;
+
+  ~BTreeMap() { clear(); }
+
+  [[nodiscard]] size_t size() const { return size_; }
+
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  Result<> insert(K key, V value) {
+    if (root_ == nullptr) {
+      root_ = allocate_node(true);
+    }
+
+    MapKey<K> needle{std::move(key)};
+    Split split;
+
+    if (!insert_into(root_, needle, value, split)) {
+      return Err(Error::Duplicate);
+    }
+
+    // The root was split, the tree grows by one level
+    if (split.right != nullptr) {
+      auto root = internal(allocate_node(false));
+      root->count = 1;
+      construct(root, 0, std::move(split.key), std::move(split.value));
+      destroy(split);
+      root->children[0] = root_;
+      root->children[1] = split.right;
+      root_ = root;
+    }
+
+    size_++;
+
+    return Ok(NONE);
+  }
+
+  [[nodiscard]] Option<V> get(K key) const {
+    MapKey<K> needle{std::move(key)};
+    auto node = root_;
+
+    while (node != nullptr) {
+      auto pos = lower_bound(node, needle);
+
+      if (pos < node->count && node->keys[pos] == needle) {
+        return node->values[pos];
+      }
+
+      if (node->leaf) {
+        break;
+      }
+
+      node = internal(node)->children[pos];
+    }
+
+    return NONE;
+  }
+
+  [[nodiscard]] bool contains(K key) const {
+    return get(std::move(key)).is_some();
+  }
+
+  Result<> remove(K key) {
+    MapKey<K> needle{std::move(key)};
+
+    if (root_ == nullptr || !remove_from(root_, needle)) {
+      return Err(Error::NotFound);
+    }
+
+    // The root lost its last key, the tree shrinks by one level
+    if (root_->count == 0) {
+      auto old = root_;
+      root_ = old->leaf ? nullptr : internal(old)->children[0];
+      free_node(old);
+    }
+
+    size_--;
+
+    return Ok(NONE);
+  }
+
+  void clear() {
+    if (root_ != nullptr) {
+      free_tree(root_);
+      root_ = nullptr;
+    }
+
+    size_ = 0;
+  }
+
+  [[nodiscard]] V operator[](K key) const { return get(key).unwrap(); }
+
+  /// Returns an iterator over the entries, in key order. Like with Map,
+  /// entries are `Cons<const K &, const V &>` referring to the map, nothing
+  /// is copied unless the caller converts them to a `Cons<K, V>`.
+  [[nodiscard]] auto iter() const { return entries<const V>(); }
+
+  /// Same as iter(), but values can be modified through the entries
+  [[nodiscard]] auto iter_mut() { return entries<V>(); }
+
+  /// Returns an iterator over the entries with keys in [`start`, `end`), in
+  /// key order. Entries are references into the map, like with iter().
+  [[nodiscard]] auto range(K start, K end) const {
+    Cursor cursor;
+    cursor.seek(root_, MapKey<K>{std::move(start)});
+
+    MapKey<K> limit{std::move(end)};
+
+    auto next_func = [cursor, limit]() mutable
+        -> Option<Cons<const K &, const V &>> {
+      auto [node, pos] = cursor.next();
+
+      if (node == nullptr) {
+        return NONE;
+      }
+
+      if ((node->keys[pos] <=> limit) >= 0) {
+        cursor.depth = 0;
+        return NONE;
+      }
+
+      return ref<const V>(node, pos);
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+private:
+  // Keys of a node span 4 cache lines, with at least 7 per node
+  static constexpr size_t NODE_KEY_BYTES = 256;
+  static constexpr size_t CAPACITY =
+      NODE_KEY_BYTES / sizeof(MapKey<K>) > 7
+          ? NODE_KEY_BYTES / sizeof(MapKey<K>)
+          : 7;
+
+  // Every node but the root holds at least MIN_KEYS keys
+  static constexpr size_t MIN_KEYS = (CAPACITY - 1) / 2;
+
+  // Internal nodes have at least MIN_KEYS + 1 >= 4 children, 32 levels are
+  // more than enough to address memory
+  static constexpr size_t MAX_DEPTH = 32;
+
+  // Keys and values are constructed and destroyed by hand
+  struct Node {
+    uint16_t count;
+    bool leaf;
+
+    union {
+      MapKey<K> keys[CAPACITY];
+    };
+
+    union {
+      V values[CAPACITY];
+    };
+
+    Node() {}
+    ~Node() {}
+  };
+
+  struct Internal : Node {
+    Node *children[CAPACITY + 1];
+  };
+
+  // The upper half of a node that was split, and the entry between halves
+  struct Split {
+    Node *right = nullptr;
+
+    union {
+      MapKey<K> key;
+    };
+
+    union {
+      V value;
+    };
+
+    Split() {}
+    ~Split() {}
+  };
+
+  // In order walk over the tree. The frame of every node on the path says
+  // which of its entries comes next, the entries of leaves before it were
+  // visited, and so were the subtrees of internal nodes up to `pos`.
+  struct Cursor {
+    struct Frame {
+      Node *node;
+      size_t pos;
+    };
+
+    Frame frames[MAX_DEPTH];
+    size_t depth = 0;
+
+    void push(Node *node, size_t pos) {
+      ENSURE(depth < MAX_DEPTH, "BTreeMap is too deep");
+      frames[depth++] = {node, pos};
+    }
+
+    // Go down the leftmost path of `node`
+    void descend(Node *node) {
+      while (node != nullptr) {
+        push(node, 0);
+        node = node->leaf ? nullptr : internal(node)->children[0];
+      }
+    }
+
+    void seek_first(Node *root) { descend(root); }
+
+    // Stop before the first key that isn't smaller than `key`
+    void seek(Node *node, const MapKey<K> &key) {
+      while (node != nullptr) {
+        auto pos = lower_bound(node, key);
+        push(node, pos);
+
+        if (node->leaf || (pos < node->count && node->keys[pos] == key)) {
+          return;
+        }
+
+        node = internal(node)->children[pos];
+      }
+    }
+
+    // The next entry, with a null node at the end
+    Frame next() {
+      while (depth > 0) {
+        auto &frame = frames[depth - 1];
+        auto node = frame.node;
+        auto pos = frame.pos;
+
+        if (pos >= node->count) {
+          depth--;
+          continue;
+        }
+
+        frame.pos++;
+
+        // The subtree after the entry comes next
+        if (!node->leaf) {
+          descend(internal(node)->children[pos + 1]);
+        }
+
+        return {node, pos};
+      }
+
+      return {nullptr, 0};
+    }
+  };
+
+  Node *root_ = nullptr;
+  A alloc_;
+  size_t size_ = 0;
+
+  [[nodiscard]] static Internal *internal(Node *node) {
+    return static_cast<Internal *>(node);
+  }
+
+  template <typename W>
+  [[nodiscard]] static Cons<const K &, W &> ref(Node *node, size_t pos) {
+    return Cons<const K &, W &>(node->keys[pos].val, node->values[pos]);
+  }
+
+  template <typename W> [[nodiscard]] auto entries() const {
+    Cursor cursor;
+    cursor.seek_first(root_);
+
+    auto next_func = [cursor]() mutable -> Option<Cons<const K &, W &>> {
+      auto [node, pos] = cursor.next();
+
+      if (node == nullptr) {
+        return NONE;
+      }
+
+      return ref<W>(node, pos);
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+  [[nodiscard]] static size_t lower_bound(const Node *node,
+                                          const MapKey<K> &key) {
+    if constexpr (std::is_integral_v<K>) {
+      static_assert(sizeof(MapKey<K>) == sizeof(K));
+      return detail::count_less(&node->keys[0].val, node->count, key.val);
+    } else {
+      size_t pos = 0;
+
+      while (pos < node->count && (node->keys[pos] <=> key) < 0) {
+        pos++;
+      }
+
+      return pos;
+    }
+  }
+
+  Node *allocate_node(bool leaf) {
+    Node *node;
+
+    if (leaf) {
+      node = new (alloc_.allocate(sizeof(Node))) Node;
+    } else {
+      node = new (alloc_.allocate(sizeof(Internal))) Internal;
+    }
+
+    node->count = 0;
+    node->leaf = leaf;
+    return node;
+  }
+
+  void free_node(Node *node) {
+    if (node->leaf) {
+      node->~Node();
+      alloc_.deallocate(node, sizeof(Node));
+    } else {
+      internal(node)->~Internal();
+      alloc_.deallocate(node, sizeof(Internal));
+    }
+  }
+
+  void free_tree(Node *node) {
+    for (size_t i = 0; i < node->count; i++) {
+      destroy(node, i);
+    }
+
+    if (!node->leaf) {
+      for (size_t i = 0; i <= node->count; i++) {
+        free_tree(internal(node)->children[i]);
+      }
+    }
+
+    free_node(node);
+  }
+
+  static void construct(Node *node, size_t pos, MapKey<K> &&key, V &&value) {
+    new (&node->keys[pos]) MapKey<K>(std::move(key));
+    new (&node->values[pos]) V(std::move(value));
+  }
+
+  static void destroy(Node *node, size_t pos) {
+    node->keys[pos].~MapKey<K>();
+    node->values[pos].~V();
+  }
+
+  static void destroy(Split &split) {
+    split.key.~MapKey<K>();
+    split.value.~V();
+  }
+
+  // Move the entry at `from` of `src` to `to` of `dst`
+  static void move(Node *dst, size_t to, Node *src, size_t from) {
+    construct(dst, to, std::move(src->keys[from]),
+              std::move(src->values[from]));
+    destroy(src, from);
+  }
+
+  // Make room for an entry at `pos`, and for a child after it
+  static void open(Node *node, size_t pos) {
+    for (size_t i = node->count; i > pos; i--) {
+      move(node, i, node, i - 1);
+    }
+
+    if (!node->leaf) {
+      auto children = internal(node)->children;
+
+      for (size_t i = node->count + 1; i > pos + 1; i--) {
+        children[i] = children[i - 1];
+      }
+    }
+
+    node->count++;
+  }
+
+  // Close the gap left by the entry at `pos`, which was moved out or
+  // destroyed, and by the child after it
+  static void close(Node *node, size_t pos) {
+    for (size_t i = pos; i + 1 < node->count; i++) {
+      move(node, i, node, i + 1);
+    }
+
+    if (!node->leaf) {
+      auto children = internal(node)->children;
+
+      for (size_t i = pos + 1; i < node->count; i++) {
+        children[i] = children[i + 1];
+      }
+    }
+
+    node->count--;
+  }
+
+  // Put `key`, `value` and the child to its right at `pos` of a node that
+  // has room
+  static void put(Node *node, size_t pos, MapKey<K> &&key, V &&value,
+                  Node *right) {
+    open(node, pos);
+    construct(node, pos, std::move(key), std::move(value));
+
+    if (right != nullptr) {
+      internal(node)->children[pos + 1] = right;
+    }
+  }
+
+  // Insert into the subtree of `node`, a full node is split in two halves,
+  // which are handed back through `split`. Returns false if the key was
+  // already present.
+  bool insert_into(Node *node, MapKey<K> &key, V &value, Split &split) {
+    auto pos = lower_bound(node, key);
+
+    if (pos < node->count && node->keys[pos] == key) {
+      return false;
+    }
+
+    Node *right = nullptr;
+
+    if (!node->leaf) {
+      Split child;
+
+      if (!insert_into(internal(node)->children[pos], key, value, child)) {
+        return false;
+      }
+
+      if (child.right == nullptr) {
+        return true;
+      }
+
+      // The child was split, its middle entry comes up into this node
+      put_or_split(node, pos, std::move(child.key), std::move(child.value),
+                   child.right, split);
+      destroy(child);
+      return true;
+    }
+
+    put_or_split(node, pos, std::move(key), std::move(value), right, split);
+    return true;
+  }
+
+  void put_or_split(Node *node, size_t pos, MapKey<K> &&key, V &&value,
+                    Node *right, Split &split) {
+    if (node->count < CAPACITY) {
+      put(node, pos, std::move(key), std::move(value), right);
+      return;
+    }
+
+    // Keep the lower half here, move the upper half to a new node and hand
+    // the middle entry to the parent
+    constexpr size_t MID = CAPACITY / 2;
+
+    auto upper = allocate_node(node->leaf);
+
+    for (size_t i = MID + 1; i < CAPACITY; i++) {
+      move(upper, i - MID - 1, node, i);
+    }
+
+    if (!node->leaf) {
+      for (size_t i = MID + 1; i <= CAPACITY; i++) {
+        internal(upper)->children[i - MID - 1] = internal(node)->children[i];
+      }
+    }
+
+    upper->count = CAPACITY - MID - 1;
+
+    new (&split.key) MapKey<K>(std::move(node->keys[MID]));
+    new (&split.value) V(std::move(node->values[MID]));
+    destroy(node, MID);
+    node->count = MID;
+    split.right = upper;
+
+    if (pos <= MID) {
+      put(node, pos, std::move(key), std::move(value), right);
+    } else {
+      put(upper, pos - MID - 1, std::move(key), std::move(value), right);
+    }
+  }
+
+  // Remove `key` from the subtree of `node`, which may be left with too few
+  // keys for its parent to fix. Returns false if the key wasn't found.
+  bool remove_from(Node *node, const MapKey<K> &key) {
+    auto pos = lower_bound(node, key);
+    bool found = pos < node->count && node->keys[pos] == key;
+
+    if (node->leaf) {
+      if (!found) {
+        return false;
+      }
+
+      destroy(node, pos);
+      close(node, pos);
+      return true;
+    }
+
+    if (found) {
+      // Replace the entry with its predecessor, the largest one of the left
+      // subtree
+      destroy(node, pos);
+      take_last(internal(node)->children[pos], node, pos);
+    } else if (!remove_from(internal(node)->children[pos], key)) {
+      return false;
+    }
+
+    rebalance(node, pos);
+    return true;
+  }
+
+  // Move the last entry of the subtree of `node` to `to` of `dst`
+  void take_last(Node *node, Node *dst, size_t to) {
+    if (node->leaf) {
+      move(dst, to, node, node->count - 1);
+      node->count--;
+      return;
+    }
+
+    auto last = node->count;
+    take_last(internal(node)->children[last], dst, to);
+    rebalance(node, last);
+  }
+
+  // Give child `pos` of `node` at least MIN_KEYS keys, by borrowing one from
+  // a sibling or merging with it
+  void rebalance(Node *node, size_t pos) {
+    auto children = internal(node)->children;
+    auto child = children[pos];
+
+    if (child->count >= MIN_KEYS) {
+      return;
+    }
+
+    if (pos > 0 && children[pos - 1]->count > MIN_KEYS) {
+      rotate_right(node, pos - 1);
+    } else if (pos < node->count && children[pos + 1]->count > MIN_KEYS) {
+      rotate_left(node, pos);
+    } else if (pos > 0) {
+      merge(node, pos - 1);
+    } else {
+      merge(node, pos);
+    }
+  }
+
+  // Move the last entry of child `pos` up into `node`, and the separator
+  // down into child `pos + 1`
+  void rotate_right(Node *node, size_t pos) {
+    auto left = internal(node)->children[pos];
+    auto right = internal(node)->children[pos + 1];
+
+    open(right, 0);
+    move(right, 0, node, pos);
+    move(node, pos, left, left->count - 1);
+
+    // open() made room for a child after the first entry, the borrowed one
+    // goes before it
+    if (!right->leaf) {
+      auto children = internal(right)->children;
+      children[1] = children[0];
+      children[0] = internal(left)->children[left->count];
+    }
+
+    left->count--;
+  }
+
+  // Move the first entry of child `pos + 1` up into `node`, and the
+  // separator down into child `pos`
+  void rotate_left(Node *node, size_t pos) {
+    auto left = internal(node)->children[pos];
+    auto right = internal(node)->children[pos + 1];
+
+    move(left, left->count, node, pos);
+    left->count++;
+    move(node, pos, right, 0);
+
+    if (!left->leaf) {
+      internal(left)->children[left->count] = internal(right)->children[0];
+    }
+
+    // Shift everything, including the first child, one place down
+    for (size_t i = 0; i + 1 < right->count; i++) {
+      move(right, i, right, i + 1);
+    }
+
+    if (!right->leaf) {
+      auto children = internal(right)->children;
+
+      for (size_t i = 0; i < right->count; i++) {
+        children[i] = children[i + 1];
+      }
+    }
+
+    right->count--;
+  }
+
+  // Merge child `pos + 1` and the separator between them into child `pos`
+  void merge(Node *node, size_t pos) {
+    auto left = internal(node)->children[pos];
+    auto right = internal(node)->children[pos + 1];
+    auto count = left->count;
+
+    move(left, count, node, pos);
+
+    for (size_t i = 0; i < right->count; i++) {
+      move(left, count + 1 + i, right, i);
+    }
+
+    if (!left->leaf) {
+      for (size_t i = 0; i <= right->count; i++) {
+        internal(left)->children[count + 1 + i] = internal(right)->children[i];
+      }
+    }
+
+    left->count = count + 1 + right->count;
+    right->count = 0;
+    free_node(right);
+
+    // The separator was moved out already, drop its slot and the child
+    // after it
+    close(node, pos);
+  }
+};
+
+} // namespace atlas
@@ -1,5 +1,7 @@
 #pragma once
+#include <concepts>
 #include <cstddef>
+#include <type_traits>
 
 namespace atlas {
 
@@ -9,6 +11,12 @@ template <typename A, typename B> struct Cons {
 
   constexpr Cons(A car, B cdr) : car(car), cdr(cdr) {}
 
+  /// Convert from a cons of compatible types, such as a cons of references
+  template <typename C, typename D>
+    requires(std::is_constructible_v<A, const C &> &&
+             std::is_constructible_v<B, const D &>)
+  constexpr Cons(const Cons<C, D> &other) : car(other.car), cdr(other.cdr) {}
+
   constexpr A first() const { return car; }
   constexpr B second() const { return cdr; }
 
@@ -22,7 +30,12 @@ template <typename A, typename B> struct Cons {
     }
   }
 
-  bool operator==(const Cons<A, B> &other) const = default;
+  // Not defaulted, so that conses of references compare what they refer to
+  constexpr bool operator==(const Cons<A, B> &other) const
+    requires(std::equality_comparable<A> && std::equality_comparable<B>)
+  {
+    return car == other.car && cdr == other.cdr;
+  }
 };
 
 template <typename A, typename B> constexpr Cons<A, B> cons(A a, B b) {
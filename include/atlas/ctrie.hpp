@@ -0,0 +1,1051 @@
+#pragma once
+#include "alloc.hpp"
+#include "hamt.hpp"
+#include "hash.hpp"
+#include "option.hpp"
+#include "result.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace atlas {
+
+/// A concurrent hash trie (Ctrie)
+/// get(), insert() and remove() are lock-free and can be called from any
+/// number of threads. The trie has the same shape as Hamt: every table is
+/// indexed by a 32-bit bitmap, and keys are walked with HamtHashState. Tables
+/// are never modified in place: an update copies the table it changes, and
+/// swaps the copy in with a compare-and-swap on the indirection node above
+/// it.
+/// snapshot() returns a consistent copy of the trie in O(1). Both tries share
+/// every node, and each copies the nodes it updates on the way, which is
+/// tracked with generations (GCAS), while the root is replaced with a double
+/// compare single swap (RDCSS).
+/// See "Concurrent Tries with Efficient Non-Blocking Snapshots" (Prokopec,
+/// Bronson, Bagwell and Odersky).
+/// Nodes replaced by an update may still be read by other threads, so they
+/// are reclaimed with epochs: a node is reused once every operation that
+/// started before it was replaced is over. A thread that stalls in the middle
+/// of an operation holds back reuse until it's done. Memory goes back to the
+/// allocator when the trie and all of its snapshots are destroyed, until then
+/// the trie keeps as much as it held at its largest.
+/// NOTE: Nodes that a snapshot may share (keys, and nodes older than the last
+/// snapshot) are only reclaimed while no snapshot of the trie is alive, the
+/// ones replaced in the meantime are kept until the trie is destroyed. So are
+/// the two generations made by each snapshot, nodes refer to them by address.
+/// The allocator must be thread-safe.
+template <typename K, typename V, Allocator A = DefaultAllocator,
+          typename H = Hash<K>>
+class Ctrie {
+
+public:
+  Ctrie(A alloc = A(), H hash = H()) : hash_(hash) {
+    arena_ = new (alloc.allocate(sizeof(Arena))) Arena(alloc);
+
+    auto gen = make<Gen>();
+    root_.store(reinterpret_cast<uintptr_t>(
+        make<INode>(make_cnode(0, gen), gen)));
+  }
+
+  Ctrie(Ctrie &&other) : arena_(other.arena_), hash_(std::move(other.hash_)) {
+    root_.store(other.root_.load());
+    other.arena_ = nullptr;
+  }
+
+  Ctrie(const Ctrie &other) = delete;
+  Ctrie &operator=(const Ctrie &other) = delete;
+
+  ~Ctrie() {
+    if (arena_ == nullptr ||
+        arena_->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+
+    auto block = arena_->blocks.load();
+
+    while (block != nullptr) {
+      auto next = block->next;
+
+      if (block->destroy != nullptr) {
+        block->destroy(block->data());
+      }
+
+      arena_->alloc.deallocate(block, BLOCK_HEADER + block->size);
+      block = next;
+    }
+
+    A alloc = arena_->alloc;
+    arena_->~Arena();
+    alloc.deallocate(arena_, sizeof(Arena));
+  }
+
+  [[nodiscard]] Option<V> get(const K &key) const {
+    Guard guard(this);
+    uint64_t hash = hash_(key);
+
+    while (true) {
+      auto root = read_root();
+      HashState state(hash, &key, hash_);
+      Option<V> ret = NONE;
+
+      if (lookup(root, key, state, nullptr, state, root->gen, ret) !=
+          RESTART) {
+        return ret;
+      }
+    }
+  }
+
+  void insert(K key, V value) {
+    Guard guard(this);
+
+    // Nodes are immutable, so the same leaf can be offered again on retries
+    auto leaf = make<SNode>(std::move(key), std::move(value));
+
+    while (true) {
+      auto root = read_root();
+      HashState state(hash_(leaf->key), &leaf->key, hash_);
+
+      if (insert_into(root, leaf, state, nullptr, state, root->gen) !=
+          RESTART) {
+        return;
+      }
+    }
+  }
+
+  Result<> remove(const K &key) {
+    Guard guard(this);
+    uint64_t hash = hash_(key);
+
+    while (true) {
+      auto root = read_root();
+      HashState state(hash, &key, hash_);
+
+      auto status = remove_from(root, key, state, nullptr, state, root->gen);
+
+      if (status == DONE) {
+        return Ok(NONE);
+      }
+
+      if (status == NOT_FOUND) {
+        return Err(Error::NotFound);
+      }
+    }
+  }
+
+  /// Returns a copy of the trie as it is at this instant, later updates of
+  /// either trie aren't visible in the other
+  [[nodiscard]] Ctrie snapshot() {
+    Guard guard(this);
+
+    // Updates stop reclaiming shared nodes before the snapshot can see them
+    arena_->refs.fetch_add(1);
+
+    while (true) {
+      auto root = read_root();
+      auto main = gcas_read(root);
+      auto gen = make<Gen>();
+      auto copy = make<INode>(main, gen);
+
+      if (rdcss_root(root, main, copy)) {
+        retire(root);
+        return Ctrie(arena_, make<INode>(main, make<Gen>()), hash_);
+      }
+
+      // The copy was never linked, nodes can't have been made in its gen
+      retire(copy);
+      retire(gen);
+    }
+  }
+
+private:
+  using HashState = HamtHashState<K, H>;
+
+  // Only the identity of a generation matters
+  struct Gen {
+    uint8_t unused = 0;
+  };
+
+  struct MainNode {
+    enum Kind : uint8_t { CNODE, TNODE, FAILED };
+
+    Kind kind;
+
+    // The main node this one replaced, until the replacement is committed
+    std::atomic<MainNode *> prev;
+
+    MainNode(Kind kind) : kind(kind), prev(nullptr) {}
+  };
+
+  // An entry of a CNode, either an INode or an SNode
+  struct Branch {
+    bool is_inode;
+  };
+
+  // Indirection node, the only mutable node of the trie
+  struct INode : Branch {
+    std::atomic<MainNode *> main;
+    Gen *gen;
+
+    INode(MainNode *main, Gen *gen) : Branch{true}, main(main), gen(gen) {}
+  };
+
+  // A key and its value
+  struct SNode : Branch {
+    K key;
+    V value;
+
+    SNode(K key, V value)
+        : Branch{false}, key(std::move(key)), value(std::move(value)) {}
+  };
+
+  // A table, its entries follow it in the same allocation
+  struct CNode : MainNode {
+    uint32_t bitmap;
+    Gen *gen;
+
+    CNode(uint32_t bitmap, Gen *gen)
+        : MainNode(MainNode::CNODE), bitmap(bitmap), gen(gen) {}
+
+    Branch **array() { return reinterpret_cast<Branch **>(this + 1); }
+  };
+
+  // A tomb, left behind by a removal that leaves a single key in a table. It
+  // is pulled up into the parent table by the next operation that sees it.
+  struct TNode : MainNode {
+    SNode *leaf;
+
+    TNode(SNode *leaf) : MainNode(MainNode::TNODE), leaf(leaf) {}
+  };
+
+  // Marks a main node whose GCAS failed, so that it gets rolled back
+  struct FailedNode : MainNode {
+    MainNode *rollback;
+
+    FailedNode(MainNode *rollback)
+        : MainNode(MainNode::FAILED), rollback(rollback) {}
+  };
+
+  // RDCSS descriptor, the root points to it while a snapshot is being taken
+  struct Descriptor {
+    enum State : uint8_t { PENDING, COMMITTED, ABORTED };
+
+    INode *old_root;
+    MainNode *expected_main;
+    INode *new_root;
+
+    // Decided once, before the root stops pointing to the descriptor
+    std::atomic<State> state;
+
+    Descriptor(INode *old_root, MainNode *expected_main, INode *new_root)
+        : old_root(old_root), expected_main(expected_main),
+          new_root(new_root), state(PENDING) {}
+  };
+
+  // Every node is allocated from an arena shared by a trie and its
+  // snapshots, and freed along with it
+  struct Block {
+    Block *next;
+    size_t size;
+    void (*destroy)(void *);
+
+    // The next block of a retired list or a free list
+    std::atomic<Block *> link;
+
+    void *data() { return reinterpret_cast<uint8_t *>(this) + BLOCK_HEADER; }
+  };
+
+  static constexpr size_t BLOCK_HEADER =
+      (sizeof(Block) + alignof(std::max_align_t) - 1) &
+      ~(alignof(std::max_align_t) - 1);
+
+  // Blocks are reused for nodes of the same size class
+  static constexpr size_t SIZE_CLASS = alignof(std::max_align_t);
+
+  static constexpr size_t MAX_NODE_SIZE =
+      std::max({sizeof(CNode) + sizeof(Branch *) * 32, sizeof(SNode),
+                sizeof(INode), sizeof(TNode), sizeof(FailedNode),
+                sizeof(Descriptor), sizeof(Gen)});
+
+  static constexpr size_t SIZE_CLASSES =
+      (MAX_NODE_SIZE + SIZE_CLASS - 1) / SIZE_CLASS + 1;
+
+  struct Arena {
+    std::atomic<Block *> blocks;
+    std::atomic<size_t> refs;
+    A alloc;
+
+    // Every operation counts itself in the epoch it started in. The epoch
+    // moves on once the operations of the previous one are over, and the
+    // nodes retired two epochs ago can't be reached by anyone anymore.
+    std::atomic<uint64_t> epoch;
+    std::atomic<size_t> active[2];
+    std::atomic<Block *> retired[3];
+    std::atomic<Block *> free[SIZE_CLASSES];
+    std::atomic_flag reclaiming;
+
+    Arena(A alloc)
+        : blocks(nullptr), refs(1), alloc(alloc), epoch(1), active{0, 0},
+          retired{nullptr, nullptr, nullptr} {
+      for (auto &list : free) {
+        list.store(nullptr, std::memory_order_relaxed);
+      }
+
+      reclaiming.clear();
+    }
+  };
+
+  // Held by every public operation, nodes aren't reused while a thread that
+  // could have read them holds one
+  struct Guard {
+    const Ctrie *trie;
+    uint64_t epoch;
+
+    Guard(const Ctrie *trie) : trie(trie), epoch(trie->enter()) {}
+    ~Guard() { trie->leave(epoch); }
+  };
+
+  enum Status { DONE, NOT_FOUND, RESTART };
+
+  Arena *arena_;
+
+  // Either an INode, or a Descriptor with the low bit set
+  mutable std::atomic<uintptr_t> root_;
+  H hash_;
+
+  Ctrie(Arena *arena, INode *root, H hash) : arena_(arena), hash_(hash) {
+    root_.store(reinterpret_cast<uintptr_t>(root));
+  }
+
+  [[nodiscard]] static size_t popcount(uint32_t x) {
+    return __builtin_popcount(x);
+  }
+
+  // The position of the entry for `bit` in a table
+  [[nodiscard]] static size_t get_index(uint32_t bitmap, uint32_t bit) {
+    return popcount(bitmap & (bit - 1));
+  }
+
+  [[nodiscard]] static HashState next_level(HashState state) {
+    state.next();
+    return state;
+  }
+
+  // Tables below the root are contracted into tombs when they hold one key
+  [[nodiscard]] static bool is_root_level(const HashState &state) {
+    return state.shift == 0 && state.gen == 0;
+  }
+
+  template <typename T> static void destroy_node(void *node) {
+    static_cast<T *>(node)->~T();
+  }
+
+  // Only called with a Guard held (or by the constructor of a new arena):
+  // a block popped from a free list can't come back to it before the
+  // operation that popped it is over, so the pop is safe from ABA
+  void *allocate(size_t size, void (*destroy)(void *)) const {
+    auto size_class = (size + SIZE_CLASS - 1) / SIZE_CLASS;
+    auto &free = arena_->free[size_class];
+    auto block = free.load(std::memory_order_acquire);
+
+    while (block != nullptr &&
+           !free.compare_exchange_weak(
+               block, block->link.load(std::memory_order_relaxed),
+               std::memory_order_acquire, std::memory_order_acquire)) {
+    }
+
+    if (block != nullptr) {
+      block->destroy = destroy;
+      return block->data();
+    }
+
+    size = size_class * SIZE_CLASS;
+    block = new (arena_->alloc.allocate(BLOCK_HEADER + size))
+        Block{nullptr, size, destroy, nullptr};
+
+    auto head = arena_->blocks.load(std::memory_order_relaxed);
+
+    do {
+      block->next = head;
+    } while (!arena_->blocks.compare_exchange_weak(head, block,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+
+    return block->data();
+  }
+
+  uint64_t enter() const {
+    while (true) {
+      auto epoch = arena_->epoch.load();
+      arena_->active[epoch & 1].fetch_add(1);
+
+      // The epoch may have moved on before we were counted in it
+      if (arena_->epoch.load() == epoch) {
+        return epoch;
+      }
+
+      arena_->active[epoch & 1].fetch_sub(1);
+    }
+  }
+
+  void leave(uint64_t epoch) const {
+    arena_->active[epoch & 1].fetch_sub(1);
+
+    for (auto &list : arena_->retired) {
+      if (list.load(std::memory_order_relaxed) != nullptr) {
+        reclaim();
+        return;
+      }
+    }
+  }
+
+  // Move to the next epoch if the operations of the previous one are over,
+  // and reuse the nodes retired in it
+  void reclaim() const {
+    if (arena_->reclaiming.test_and_set(std::memory_order_acquire)) {
+      return;
+    }
+
+    auto epoch = arena_->epoch.load();
+
+    if (arena_->active[(epoch - 1) & 1].load() == 0) {
+      arena_->epoch.store(epoch + 1);
+      auto block = arena_->retired[(epoch - 1) % 3].exchange(nullptr);
+
+      while (block != nullptr) {
+        auto next = block->link.load(std::memory_order_relaxed);
+
+        if (block->destroy != nullptr) {
+          block->destroy(block->data());
+          block->destroy = nullptr;
+        }
+
+        push(arena_->free[block->size / SIZE_CLASS], block);
+        block = next;
+      }
+    }
+
+    arena_->reclaiming.clear(std::memory_order_release);
+  }
+
+  static void push(std::atomic<Block *> &list, Block *block) {
+    auto head = list.load(std::memory_order_relaxed);
+
+    do {
+      block->link.store(head, std::memory_order_relaxed);
+    } while (!list.compare_exchange_weak(head, block,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+  // Hand over a node that can't be reached from the trie anymore (or never
+  // could), it's reused once the operations that may have seen it are over
+  void retire(void *node) const {
+    auto block = reinterpret_cast<Block *>(reinterpret_cast<uint8_t *>(node) -
+                                           BLOCK_HEADER);
+    push(arena_->retired[arena_->epoch.load() % 3], block);
+  }
+
+  // Whether a snapshot may share the nodes that are older than our generation
+  [[nodiscard]] bool shared() const { return arena_->refs.load() != 1; }
+
+  // A table that was replaced in `in`
+  void retire_table(CNode *cn, INode *in) const {
+    if (cn->gen == in->gen || !shared()) {
+      retire(cn);
+    }
+  }
+
+  // An INode that was removed from the table of `in`
+  void retire_inode(INode *child, INode *in) const {
+    if (child->gen == in->gen || !shared()) {
+      retire(child);
+    }
+  }
+
+  // A key or a tomb that was removed from the trie, these have no generation
+  void retire_leaf(void *node) const {
+    if (!shared()) {
+      retire(node);
+    }
+  }
+
+  // The INodes of a table that renewed() replaced by copies
+  void retire_inodes(CNode *cn, INode *in) const {
+    for (size_t i = 0; i < popcount(cn->bitmap); i++) {
+      if (cn->array()[i]->is_inode) {
+        retire_inode(static_cast<INode *>(cn->array()[i]), in);
+      }
+    }
+  }
+
+  // The INodes copied by renewed() for an update that failed
+  void discard_inodes(CNode *copy) const {
+    for (size_t i = 0; i < popcount(copy->bitmap); i++) {
+      if (copy->array()[i]->is_inode) {
+        retire(copy->array()[i]);
+      }
+    }
+  }
+
+  // The nodes made by dual() for an update that failed
+  void discard_dual(INode *child) const {
+    auto cn = static_cast<CNode *>(child->main.load());
+
+    for (size_t i = 0; i < popcount(cn->bitmap); i++) {
+      if (cn->array()[i]->is_inode) {
+        discard_dual(static_cast<INode *>(cn->array()[i]));
+      }
+    }
+
+    retire(cn);
+    retire(child);
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) const {
+    void (*destroy)(void *) = nullptr;
+
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destroy = &destroy_node<T>;
+    }
+
+    return new (allocate(sizeof(T), destroy)) T(std::forward<Args>(args)...);
+  }
+
+  CNode *make_cnode(uint32_t bitmap, Gen *gen) const {
+    auto size = sizeof(CNode) + sizeof(Branch *) * popcount(bitmap);
+    return new (allocate(size, nullptr)) CNode(bitmap, gen);
+  }
+
+  // A copy of `cn` with `branch` at `bit`, added or replacing the entry
+  CNode *with_branch(CNode *cn, uint32_t bit, Branch *branch, Gen *gen) const {
+    auto ret = make_cnode(cn->bitmap | bit, gen);
+
+    for (uint32_t bits = ret->bitmap; bits != 0; bits &= bits - 1) {
+      uint32_t b = bits & -bits;
+      ret->array()[get_index(ret->bitmap, b)] =
+          b == bit ? branch : cn->array()[get_index(cn->bitmap, b)];
+    }
+
+    return ret;
+  }
+
+  // A copy of `cn` without the entry of `bit`
+  CNode *without_branch(CNode *cn, uint32_t bit, Gen *gen) const {
+    auto ret = make_cnode(cn->bitmap & ~bit, gen);
+
+    for (uint32_t bits = ret->bitmap; bits != 0; bits &= bits - 1) {
+      uint32_t b = bits & -bits;
+      ret->array()[get_index(ret->bitmap, b)] =
+          cn->array()[get_index(cn->bitmap, b)];
+    }
+
+    return ret;
+  }
+
+  INode *copy_to_gen(INode *in, Gen *gen) const {
+    return make<INode>(gcas_read(in), gen);
+  }
+
+  // A copy of `cn` whose INodes belong to `gen`
+  CNode *renewed(CNode *cn, Gen *gen) const {
+    auto ret = make_cnode(cn->bitmap, gen);
+
+    for (size_t i = 0; i < popcount(cn->bitmap); i++) {
+      auto branch = cn->array()[i];
+
+      if (branch->is_inode) {
+        branch = copy_to_gen(static_cast<INode *>(branch), gen);
+      }
+
+      ret->array()[i] = branch;
+    }
+
+    return ret;
+  }
+
+  // Tables shared with a snapshot are copied into our generation before
+  // keys are added to them
+  CNode *own(CNode *cn, INode *in) const {
+    return cn->gen == in->gen ? cn : renewed(cn, in->gen);
+  }
+
+  // Entomb a table below the root that only holds one key
+  MainNode *contracted(CNode *cn, const HashState &state) const {
+    if (!is_root_level(state) && popcount(cn->bitmap) == 1 &&
+        !cn->array()[0]->is_inode) {
+      return make<TNode>(static_cast<SNode *>(cn->array()[0]));
+    }
+
+    return cn;
+  }
+
+  // A copy of `cn` where the tombs of its children are replaced by their keys
+  CNode *compressed(CNode *cn, Gen *gen) const {
+    auto ret = make_cnode(cn->bitmap, gen);
+
+    for (size_t i = 0; i < popcount(cn->bitmap); i++) {
+      auto branch = cn->array()[i];
+
+      if (branch->is_inode) {
+        auto main = gcas_read(static_cast<INode *>(branch));
+
+        if (main->kind == MainNode::TNODE) {
+          branch = static_cast<TNode *>(main)->leaf;
+        }
+      }
+
+      ret->array()[i] = branch;
+    }
+
+    return ret;
+  }
+
+  // The hash state of a key that is already in the trie, at the same level as
+  // `state`
+  HashState state_of(SNode *leaf, const HashState &state) const {
+    HashState ret(hash_(leaf->key), &leaf->key, hash_);
+    ret.shift = state.shift;
+
+    if (state.gen != 0) {
+      ret.gen = state.gen;
+      ret.hash = hash_(leaf->key, state.gen);
+    }
+
+    return ret;
+  }
+
+  // A table holding two keys whose hashes match up to the current level
+  CNode *dual(SNode *x, HashState x_state, SNode *y, HashState y_state,
+              Gen *gen) const {
+    uint32_t x_bit = 1 << x_state.get_index();
+    uint32_t y_bit = 1 << y_state.get_index();
+
+    if (x_bit == y_bit) {
+      auto ret = make_cnode(x_bit, gen);
+      ret->array()[0] = make<INode>(
+          dual(x, next_level(x_state), y, next_level(y_state), gen), gen);
+      return ret;
+    }
+
+    auto ret = make_cnode(x_bit | y_bit, gen);
+    ret->array()[get_index(ret->bitmap, x_bit)] = x;
+    ret->array()[get_index(ret->bitmap, y_bit)] = y;
+    return ret;
+  }
+
+  INode *read_root(bool abort = false) const {
+    while (true) {
+      auto root = root_.load();
+
+      if (!(root & 1)) {
+        return reinterpret_cast<INode *>(root);
+      }
+
+      rdcss_complete(abort);
+    }
+  }
+
+  bool rdcss_root(INode *old_root, MainNode *expected_main,
+                  INode *new_root) {
+    auto desc = make<Descriptor>(old_root, expected_main, new_root);
+    auto expected = reinterpret_cast<uintptr_t>(old_root);
+    bool committed = false;
+
+    if (root_.compare_exchange_strong(
+            expected, reinterpret_cast<uintptr_t>(desc) | 1)) {
+      rdcss_complete(false);
+      committed = desc->state.load() == Descriptor::COMMITTED;
+    }
+
+    // The root doesn't point to it anymore
+    retire(desc);
+    return committed;
+  }
+
+  void rdcss_complete(bool abort) const {
+    while (true) {
+      auto root = root_.load();
+
+      if (!(root & 1)) {
+        return;
+      }
+
+      auto desc = reinterpret_cast<Descriptor *>(root & ~uintptr_t(1));
+      auto state = desc->state.load();
+
+      // Whoever decides first wins, the others only move the root to match
+      if (state == Descriptor::PENDING) {
+        auto decided =
+            !abort && gcas_read(desc->old_root) == desc->expected_main
+                ? Descriptor::COMMITTED
+                : Descriptor::ABORTED;
+
+        if (desc->state.compare_exchange_strong(state, decided)) {
+          state = decided;
+        }
+      }
+
+      auto next = state == Descriptor::COMMITTED ? desc->new_root
+                                                 : desc->old_root;
+
+      if (root_.compare_exchange_strong(root,
+                                        reinterpret_cast<uintptr_t>(next))) {
+        return;
+      }
+    }
+  }
+
+  // Replace the main node of `in`, this only succeeds if the generation of
+  // `in` is still the one of the root once the swap is committed
+  bool gcas(INode *in, MainNode *old_main, MainNode *new_main) const {
+    new_main->prev.store(old_main);
+
+    if (in->main.compare_exchange_strong(old_main, new_main)) {
+      gcas_commit(in, new_main);
+
+      if (new_main->prev.load() == nullptr) {
+        return true;
+      }
+    }
+
+    // Never committed, `in` doesn't point to it anymore. Neither does
+    // anything point to the mark left by its rollback.
+    auto prev = new_main->prev.load();
+
+    if (prev != nullptr && prev->kind == MainNode::FAILED) {
+      retire(prev);
+    }
+
+    retire(new_main);
+    return false;
+  }
+
+  MainNode *gcas_commit(INode *in, MainNode *main) const {
+    while (true) {
+      auto root = read_root(true);
+      auto prev = main->prev.load();
+
+      if (prev == nullptr) {
+        return main;
+      }
+
+      if (prev->kind == MainNode::FAILED) {
+        auto rollback = static_cast<FailedNode *>(prev)->rollback;
+
+        if (in->main.compare_exchange_strong(main, rollback)) {
+          return rollback;
+        }
+
+        main = in->main.load();
+        continue;
+      }
+
+      if (root->gen == in->gen) {
+        if (main->prev.compare_exchange_strong(prev, nullptr)) {
+          return main;
+        }
+        continue;
+      }
+
+      // A snapshot was taken in the meantime, roll back
+      auto failed = make<FailedNode>(prev);
+
+      if (!main->prev.compare_exchange_strong(prev, failed)) {
+        retire(failed);
+      }
+
+      main = in->main.load();
+    }
+  }
+
+  MainNode *gcas_read(INode *in) const {
+    auto main = in->main.load();
+
+    if (main->prev.load() == nullptr) {
+      return main;
+    }
+
+    return gcas_commit(in, main);
+  }
+
+  // Replace the table of `in` by a copy whose INodes belong to `gen`
+  bool renew(INode *in, CNode *cn, Gen *gen) const {
+    auto copy = renewed(cn, gen);
+
+    if (!gcas(in, cn, copy)) {
+      discard_inodes(copy);
+      return false;
+    }
+
+    retire_table(cn, in);
+    retire_inodes(cn, in);
+    return true;
+  }
+
+  // Replace the table of `in` by `owned`, which is own(cn, in), with
+  // `branch` at `bit`
+  bool gcas_branch(INode *in, CNode *cn, CNode *owned, uint32_t bit,
+                   Branch *branch) const {
+    bool done = gcas(in, cn, with_branch(owned, bit, branch, in->gen));
+
+    if (done) {
+      retire_table(cn, in);
+    }
+
+    // The copy made by own() is never linked, its INodes are if we're done
+    if (owned != cn) {
+      if (done) {
+        retire_inodes(cn, in);
+      } else {
+        discard_inodes(owned);
+      }
+
+      retire(owned);
+    }
+
+    return done;
+  }
+
+  // Pull the tombs below `in` into its table
+  void clean(INode *in, const HashState &state, Gen *start_gen) const {
+    if (in == nullptr) {
+      return;
+    }
+
+    auto main = gcas_read(in);
+
+    if (main->kind != MainNode::CNODE) {
+      return;
+    }
+
+    auto cn = static_cast<CNode *>(main);
+    auto packed = compressed(cn, start_gen);
+    auto updated = contracted(packed, state);
+
+    if (gcas(in, cn, updated)) {
+      retire_table(cn, in);
+
+      // The INodes whose tombs were pulled up
+      for (size_t i = 0; i < popcount(cn->bitmap); i++) {
+        if (cn->array()[i] != packed->array()[i]) {
+          auto child = static_cast<INode *>(cn->array()[i]);
+          retire_leaf(child->main.load());
+          retire_inode(child, in);
+        }
+      }
+    }
+
+    if (updated != packed) {
+      retire(packed);
+    }
+  }
+
+  // Replace `in` in the table of `parent` by the key of its tomb
+  void clean_parent(INode *parent, INode *in, const HashState &parent_state,
+                    Gen *start_gen) const {
+    while (true) {
+      auto main = gcas_read(in);
+      auto parent_main = gcas_read(parent);
+
+      if (main->kind != MainNode::TNODE ||
+          parent_main->kind != MainNode::CNODE) {
+        return;
+      }
+
+      auto cn = static_cast<CNode *>(parent_main);
+      uint32_t bit = 1 << parent_state.get_index();
+
+      if (!(cn->bitmap & bit) ||
+          cn->array()[get_index(cn->bitmap, bit)] != in) {
+        return;
+      }
+
+      auto updated =
+          with_branch(cn, bit, static_cast<TNode *>(main)->leaf, in->gen);
+      auto contracted_main = contracted(updated, parent_state);
+      bool done = gcas(parent, cn, contracted_main);
+
+      if (contracted_main != updated) {
+        retire(updated);
+      }
+
+      if (done) {
+        retire_table(cn, parent);
+        retire_inode(in, parent);
+        retire_leaf(main);
+        return;
+      }
+
+      if (read_root()->gen != start_gen) {
+        return;
+      }
+    }
+  }
+
+  Status lookup(INode *in, const K &key, const HashState &state,
+                INode *parent, const HashState &parent_state, Gen *start_gen,
+                Option<V> &out) const {
+    auto main = gcas_read(in);
+
+    if (main->kind == MainNode::TNODE) {
+      clean(parent, parent_state, start_gen);
+      return RESTART;
+    }
+
+    auto cn = static_cast<CNode *>(main);
+    uint32_t bit = 1 << state.get_index();
+
+    if (!(cn->bitmap & bit)) {
+      return NOT_FOUND;
+    }
+
+    auto branch = cn->array()[get_index(cn->bitmap, bit)];
+
+    if (branch->is_inode) {
+      auto child = static_cast<INode *>(branch);
+
+      if (child->gen == start_gen) {
+        return lookup(child, key, next_level(state), in, state, start_gen,
+                      out);
+      }
+
+      if (renew(in, cn, start_gen)) {
+        return lookup(in, key, state, parent, parent_state, start_gen, out);
+      }
+
+      return RESTART;
+    }
+
+    auto leaf = static_cast<SNode *>(branch);
+
+    if (!key_equal(leaf->key, key)) {
+      return NOT_FOUND;
+    }
+
+    out = Option<V>(V(leaf->value));
+    return DONE;
+  }
+
+  Status insert_into(INode *in, SNode *leaf, const HashState &state,
+                     INode *parent, const HashState &parent_state,
+                     Gen *start_gen) {
+    auto main = gcas_read(in);
+
+    if (main->kind == MainNode::TNODE) {
+      clean(parent, parent_state, start_gen);
+      return RESTART;
+    }
+
+    auto cn = static_cast<CNode *>(main);
+    uint32_t bit = 1 << state.get_index();
+
+    if (!(cn->bitmap & bit)) {
+      return gcas_branch(in, cn, own(cn, in), bit, leaf) ? DONE : RESTART;
+    }
+
+    auto branch = cn->array()[get_index(cn->bitmap, bit)];
+
+    if (branch->is_inode) {
+      auto child = static_cast<INode *>(branch);
+
+      if (child->gen == start_gen) {
+        return insert_into(child, leaf, next_level(state), in, state,
+                           start_gen);
+      }
+
+      if (renew(in, cn, start_gen)) {
+        return insert_into(in, leaf, state, parent, parent_state, start_gen);
+      }
+
+      return RESTART;
+    }
+
+    auto prev = static_cast<SNode *>(branch);
+
+    if (key_equal(prev->key, leaf->key)) {
+      if (!gcas_branch(in, cn, cn, bit, leaf)) {
+        return RESTART;
+      }
+
+      retire_leaf(prev);
+      return DONE;
+    }
+
+    // Another key lives here, push both of them one level down
+    auto child = make<INode>(dual(prev, next_level(state_of(prev, state)),
+                                  leaf, next_level(state), in->gen),
+                             in->gen);
+
+    if (!gcas_branch(in, cn, own(cn, in), bit, child)) {
+      discard_dual(child);
+      return RESTART;
+    }
+
+    return DONE;
+  }
+
+  Status remove_from(INode *in, const K &key, const HashState &state,
+                     INode *parent, const HashState &parent_state,
+                     Gen *start_gen) {
+    auto main = gcas_read(in);
+
+    if (main->kind == MainNode::TNODE) {
+      clean(parent, parent_state, start_gen);
+      return RESTART;
+    }
+
+    auto cn = static_cast<CNode *>(main);
+    uint32_t bit = 1 << state.get_index();
+
+    if (!(cn->bitmap & bit)) {
+      return NOT_FOUND;
+    }
+
+    auto branch = cn->array()[get_index(cn->bitmap, bit)];
+    Status status;
+
+    if (branch->is_inode) {
+      auto child = static_cast<INode *>(branch);
+
+      if (child->gen == start_gen) {
+        status = remove_from(child, key, next_level(state), in, state,
+                             start_gen);
+      } else if (renew(in, cn, start_gen)) {
+        status = remove_from(in, key, state, parent, parent_state, start_gen);
+      } else {
+        status = RESTART;
+      }
+    } else {
+      if (!key_equal(static_cast<SNode *>(branch)->key, key)) {
+        return NOT_FOUND;
+      }
+
+      auto removed = without_branch(cn, bit, in->gen);
+      auto updated = contracted(removed, state);
+      status = RESTART;
+
+      if (gcas(in, cn, updated)) {
+        retire_table(cn, in);
+        retire_leaf(branch);
+        status = DONE;
+      }
+
+      if (updated != removed) {
+        retire(removed);
+      }
+    }
+
+    // We may have left a tomb behind, pull it up into the parent
+    if (status == DONE && parent != nullptr &&
+        gcas_read(in)->kind == MainNode::TNODE) {
+      clean_parent(parent, in, parent_state, start_gen);
+    }
+
+    return status;
+  }
+};
+
+} // namespace atlas
@@ -3,6 +3,9 @@
 #include "base.hpp"
 #include "hash.hpp"
 #include "map.hpp"
+#include "slice.hpp"
+#include "table_pool.hpp"
+#include "vec.hpp"
 #if 0
 #include <bitset>
 #include <iostream>
@@ -12,18 +15,162 @@ namespace atlas {
 
 constexpr size_t BRANCHING_FACTOR = 32;
 
+/// The position of a key while descending a hash trie: every level consumes
+/// 5 bits of its hash, and once they run out the key is hashed again with the
+/// next generation
+template <typename K, typename H> struct HamtHashState {
+  // A 64-bit hash covers 12 levels
+  static constexpr size_t MAX_SHIFT = 55;
+
+  size_t hash;
+  size_t shift;
+  size_t gen;
+  const K *key;
+  H hasher_fn;
+
+  // The generation 0 hash of the key, which is what leaves store
+  uint64_t key_hash;
+
+  HamtHashState() = default;
+
+  HamtHashState(uint64_t hash, const K *key, H hasher_fn)
+      : hash(hash), shift(0), gen(0), key(key), hasher_fn(hasher_fn),
+        key_hash(hash) {}
+
+  inline HamtHashState &next() {
+    shift += 5;
+
+    // Hash was exhausted, regenerate
+    if (shift > MAX_SHIFT) {
+      hash = hasher_fn(*key, ++gen);
+
+      shift = 0;
+    }
+    return *this;
+  }
+
+  inline size_t get_index() const { return (hash >> shift) & 0x1f; }
+};
+
+/// Where a Hamt keeps the entries of its leaves
+enum class HamtLeaves {
+  // Inline if the entry can be copied bytewise and is at most as big as two
+  // branches, out of line otherwise
+  Auto,
+
+  // In the branch tables, every slot of a table is as big as an entry
+  Inline,
+
+  // Behind a pointer, so that the slots of a table stay as small as a branch
+  OutOfLine,
+};
+
+/// Leaf layout of a Hamt
+/// With `StoreHash`, every leaf keeps the full hash of its key next to the
+/// entry (or its pointer), so lookups reject mismatching leaves with an
+/// integer comparison, and splitting a leaf on insertion never has to hash
+/// its key again.
+template <HamtLeaves Leaves = HamtLeaves::Auto, bool StoreHash = false>
+struct HamtLayout {
+  static constexpr HamtLeaves LEAVES = Leaves;
+  static constexpr bool STORE_HASH = StoreHash;
+};
+
 /// Hash Array Mapped Trie
 /// This is used when a good balance between a hashtable and a tree is needed,
 /// e.g. when you need good resizing (on deletion) and fast lookups.
+/// See HamtLayout for how leaves are stored.
 template <typename K, typename V, Allocator A = DefaultAllocator,
-          typename H = Hash<K>>
+          typename H = Hash<K>, typename Layout = HamtLayout<>>
 class Hamt {
 
 public:
+  /// The deepest a trie can get, this is only reached if keys share their
+  /// whole hash
+  static constexpr size_t MAX_DEPTH = 32;
+
   Hamt(A alloc = A(), H hash = H())
-      : root_(nullptr), alloc_(alloc), hash_(hash) {}
+      : root_(nullptr), alloc_(alloc), hash_(hash), pool_(alloc),
+        entries_(make_entry_pool(alloc)) {}
+
+  Hamt(Hamt &&other)
+      : root_(other.root_), alloc_(std::move(other.alloc_)),
+        hash_(std::move(other.hash_)), size_(other.size_),
+        pool_(std::move(other.pool_)), entries_(std::move(other.entries_)) {
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+
+  /// Build a trie from `entries`, which must be sorted by
+  /// `trie_order(hash(key))`. Each table is allocated once, at its final
+  /// size, instead of growing one entry at a time. If a key appears more
+  /// than once, the last value wins. Entries that turn out not to be sorted
+  /// are inserted one at a time instead.
+  [[nodiscard]] static Hamt from_sorted_by_hash(Slice<const Cons<K, V>> entries,
+                                                A alloc = A(),
+                                                H hash = H()) {
+    Hamt ret(alloc, hash);
+
+    if (entries.size() == 0) {
+      return ret;
+    }
+
+    // The entries to build from and their hashes, a run of the same key only
+    // keeps its last entry. Left in, the run would look like keys sharing
+    // their whole hash and get a chain of single-child branches.
+    Vec<size_t, A> indices(alloc);
+    Vec<uint64_t, A> hashes(alloc);
+    Vec<size_t, A> deferred(alloc);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      auto hash = ret.hash_(entries[i].car);
+      auto last = hashes.size() - 1;
+
+      if (i > 0 && trie_order(hashes[last]) > trie_order(hash)) [[unlikely]] {
+        for (size_t j = 0; j < entries.size(); j++) {
+          ret.insert(entries[j].car, entries[j].cdr);
+        }
 
-  Option<V> get(K key) const {
+        return ret;
+      }
+
+      if (i > 0 && hashes[last] == hash &&
+          key_equal(entries[indices[last]].car, entries[i].car)) {
+        indices[last] = i;
+        continue;
+      }
+
+      indices.push(i);
+      hashes.push(hash);
+    }
+
+    ret.root_ = reinterpret_cast<Node *>(ret.alloc_.allocate(sizeof(Node)));
+    ret.build_branch(ret.root_, entries, indices, hashes, 0, hashes.size(), 0,
+                     deferred);
+
+    // Keys whose whole hash collides with another key's go through the
+    // regular insertion, which rehashes them
+    for (size_t i = 0; i < deferred.size(); i++) {
+      auto &entry = entries[deferred[i]];
+      ret.insert(entry.car, entry.cdr);
+    }
+
+    return ret;
+  }
+
+  /// The order in which keys are laid out in the trie, the hash bits of the
+  /// first level are the most significant
+  [[nodiscard]] static constexpr uint64_t trie_order(uint64_t hash) {
+    uint64_t ret = 0;
+
+    for (size_t shift = 0; shift <= HashState::MAX_SHIFT; shift += 5) {
+      ret = (ret << 5) | ((hash >> shift) & 0x1f);
+    }
+
+    return ret;
+  }
+
+  Option<V> get(const K &key) const {
     auto node = root_;
 
     if (node == nullptr) {
@@ -32,17 +179,98 @@ public:
 
     auto hash = hash_(key);
 
-    HashState hash_state{hash, 0, 0, &key, hash_};
+    HashState hash_state(hash, &key, hash_);
 
-    auto result = find_node_rehash(root_, key, hash_state);
+    auto result = search(root_, key, hash_state, nullptr);
 
     if (result.status == FOUND) {
-      return result.value->leaf.value;
+      return entry(result.value->leaf).value;
     }
 
     return NONE;
   }
 
+  /// Look up every key of `keys`, storing the value of `keys[i]` in `out[i]`
+  /// A group of keys descends the trie together one level at a time, and the
+  /// next table of every key is prefetched before any of them is read, so the
+  /// cache misses of the group overlap instead of stalling one after the
+  /// other.
+  void get_many(Slice<const K> keys, Slice<Option<V>> out) const {
+    ENSURE(out.size() >= keys.size(), "output slice is too small");
+
+    struct Cursor {
+      Node *node;
+      HashState state;
+    };
+
+    Cursor cursors[BATCH_SIZE];
+    bool pending[BATCH_SIZE];
+    uint64_t hashes[BATCH_SIZE];
+
+    for (size_t start = 0; start < keys.size(); start += BATCH_SIZE) {
+      size_t count = keys.size() - start;
+      count = count < BATCH_SIZE ? count : BATCH_SIZE;
+
+      size_t remaining = 0;
+
+      hash_batch(keys.sub_slice(start, start + count).unwrap(),
+                 Slice<uint64_t>(hashes, count), hash_);
+
+      for (size_t i = 0; i < count; i++) {
+        auto &key = keys[start + i];
+
+        pending[i] = root_ != nullptr;
+        out[start + i] = NONE;
+
+        if (!pending[i]) {
+          continue;
+        }
+
+        cursors[i] = {root_, HashState(hashes[i], &key, hash_)};
+        prefetch_next(cursors[i]);
+        remaining++;
+      }
+
+      while (remaining > 0) {
+        for (size_t i = 0; i < count; i++) {
+          if (!pending[i]) {
+            continue;
+          }
+
+          auto &cursor = cursors[i];
+          auto node = cursor.node;
+          uint32_t index = cursor.state.get_index();
+
+          if (!(node->branch.bitmap & (1 << index))) {
+            pending[i] = false;
+            remaining--;
+            continue;
+          }
+
+          auto child = &node->branch.ptr[get_index(node->branch.bitmap, index)];
+
+          if (node->branch.leafmap & (1 << index)) {
+            if (leaf_matches(child->leaf, keys[start + i],
+                             cursor.state.key_hash)) {
+              out[start + i] = Option<V>(V(entry(child->leaf).value));
+            }
+
+            pending[i] = false;
+            remaining--;
+            continue;
+          }
+
+          cursor.node = child;
+          cursor.state.next();
+          prefetch_next(cursor);
+        }
+      }
+    }
+  }
+
+  /// Insert `key`, or replace its value
+  /// A new key's table is copied to a table one entry bigger, taken from the
+  /// table pool: an insertion copies at most one table, never its path.
   void insert(K key, V value) {
     auto hash = hash_(key);
     auto node = root_;
@@ -56,13 +284,13 @@ public:
       node = root_;
     }
 
-    HashState hash_state{hash, 0, 0, &key, hash_};
+    HashState hash_state(hash, &key, hash_);
 
     insert_from_hash(key, value, hash_state);
     return;
   }
 
-  Result<> remove(K key) {
+  Result<> remove(const K &key) {
     auto node = root_;
 
     if (node == nullptr) {
@@ -70,13 +298,15 @@ public:
     }
 
     auto hash = hash_(key);
-    HashState hash_state{hash, 0, 0, &key, hash_};
-    auto result = find_node_rehash(root_, key, hash_state);
+    HashState hash_state(hash, &key, hash_);
+    auto result = search(root_, key, hash_state, nullptr);
 
-    if (result.status == NOT_FOUND) {
+    if (result.status != FOUND) {
       return Err(Error::NotFound);
     }
 
+    destroy_leaf(result.value->leaf);
+
     // Clear bit in parent bitmap
     // Also clear bit in leafmap, just to be sure
     auto hash_index = hash_state.get_index();
@@ -89,13 +319,14 @@ public:
 
     // Fold the branch if it only has one other leaf
     if (new_size == 1 && popcount(result.parent->branch.leafmap) == 1) {
-      HashState new_state = {hash_state.hash, 0, hash_state.gen, &key, hash_};
+      HashState new_state(hash, &key, hash_);
 
       shrink_table_nofree(result.parent, 1, get_index(prev_bitmap, hash_index));
 
-      // The tree depth shouldn't EVER exceed 7, so this is safe
-      Node *ancestors[7];
-      size_t indices[7];
+      // The depth can only exceed the number of levels covered by one hash
+      // if two keys share all 60 bits of it
+      Node *ancestors[MAX_DEPTH];
+      size_t indices[MAX_DEPTH];
 
       size_t n_ancestors = 0;
 
@@ -107,6 +338,7 @@ public:
       while (true) {
         auto index = new_state.get_index();
 
+        ENSURE(n_ancestors < MAX_DEPTH, "Hamt is too deep");
         ancestors[n_ancestors++] = node;
         indices[n_ancestors - 1] = index;
 
@@ -177,33 +409,177 @@ public:
 
   [[nodiscard]] size_t size() const { return size_; }
 
+  /// Returns an iterator over the entries of the trie
+  /// NOTE: The order is unspecified
+  [[nodiscard]] auto iter() const {
+    Walk walk;
+    start_walk(walk);
+
+    auto next_func = [this, walk]() mutable -> Option<Cons<K, V>> {
+      auto leaf = next_leaf(walk);
+
+      if (leaf == nullptr) {
+        return NONE;
+      }
+
+      auto &e = entry(leaf->leaf);
+      return cons(e.key.val, e.value);
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+  /// Shape and memory use of a trie
+  struct Stats {
+    // Branches, including the root
+    size_t branches;
+    size_t leaves;
+
+    // How many leaves are at each depth, the children of the root are at
+    // depth 1
+    size_t depth_histogram[MAX_DEPTH + 1];
+
+    // Bytes of the root, of the tables and of the out of line entries in use
+    size_t used_bytes;
+
+    // Bytes reserved from the allocator, including free tables and entries
+    // of the pools
+    size_t reserved_bytes;
+  };
+
+  [[nodiscard]] Stats stats() const {
+    Stats ret = {};
+    auto pool = pool_.stats();
+
+    ret.used_bytes = pool.used_bytes();
+    ret.reserved_bytes = pool.slab_bytes;
+
+    if constexpr (!INLINE_LEAVES) {
+      auto entries = entries_.stats();
+      ret.used_bytes += entries.used_bytes();
+      ret.reserved_bytes += entries.slab_bytes;
+    }
+
+    if (root_ != nullptr) {
+      ret.used_bytes += sizeof(Node);
+      ret.reserved_bytes += sizeof(Node);
+    }
+
+    Walk walk;
+    start_walk(walk);
+
+    while (next_leaf(walk) != nullptr) {
+      ret.leaves++;
+      ret.depth_histogram[walk.depth]++;
+    }
+
+    ret.branches = walk.branches;
+    return ret;
+  }
+
+  /// Memory used by the branch tables, per table size
+  [[nodiscard]] TablePoolStats<BRANCHING_FACTOR> pool_stats() const {
+    return pool_.stats();
+  }
+
+  /// Hand the memory of the tables and entries freed by removals back to
+  /// the allocator, as far as whole slabs of the pools are free
+  void trim() {
+    pool_.trim();
+
+    if constexpr (!INLINE_LEAVES) {
+      entries_.trim();
+    }
+  }
+
+  /// Remove every entry, the memory of the pools goes back to the allocator
+  void clear() {
+    if (root_ == nullptr) {
+      return;
+    }
+
+    if constexpr (!INLINE_LEAVES) {
+      Walk walk;
+      start_walk(walk);
+
+      while (auto leaf = next_leaf(walk)) {
+        destroy_leaf(leaf->leaf);
+      }
+    }
+
+    dealloc(root_, false);
+    alloc_.deallocate(root_, sizeof(Node));
+    root_ = nullptr;
+    size_ = 0;
+
+    trim();
+  }
+
   ~Hamt() {
+    if constexpr (!INLINE_LEAVES) {
+      Walk walk;
+      start_walk(walk);
+
+      while (auto leaf = next_leaf(walk)) {
+        leaf->leaf.entry->~Entry();
+      }
+    }
+
+    // Every table and entry lives in a pool, which frees them all at once
     if (root_ != nullptr) {
-      dealloc(root_, false);
       alloc_.deallocate(root_, sizeof(Node));
     }
   }
 
 private:
-  struct Node {
-    struct Leaf {
-      MapKey<K> key;
-      V value;
-    };
+  static constexpr bool STORE_HASH = Layout::STORE_HASH;
 
-    struct Branch {
-      Node *ptr;
+  struct Node;
 
-      // 32-bit bitmap where each one bit represents the presence of a
-      // child node
-      uint32_t bitmap;
+  struct Branch {
+    Node *ptr;
 
-      // The leafmap is a design decision I've made inspired by clojure's CHAMP
-      // optimization, as to avoid the use of tagged pointers and to minimize
-      // memory use, now a branch fits neatly into 16 bytes.
-      uint32_t leafmap;
-    };
+    // 32-bit bitmap where each one bit represents the presence of a
+    // child node
+    uint32_t bitmap;
+
+    // The leafmap is a design decision I've made inspired by clojure's CHAMP
+    // optimization, as to avoid the use of tagged pointers and to minimize
+    // memory use, now a branch fits neatly into 16 bytes.
+    uint32_t leafmap;
+  };
+
+  struct Entry {
+    MapKey<K> key;
+    V value;
+  };
+
+  using CachedHash = std::conditional_t<STORE_HASH, uint64_t, None>;
+
+  struct InlineLeaf {
+    Entry entry;
+    [[no_unique_address]] CachedHash hash;
+  };
+
+  struct OutOfLineLeaf {
+    Entry *entry;
+    [[no_unique_address]] CachedHash hash;
+  };
+
+  // Tables are resized with memcpy, so only entries that can be copied
+  // bytewise can live in them
+  static constexpr bool INLINE_LEAVES =
+      Layout::LEAVES == HamtLeaves::Inline ||
+      (Layout::LEAVES == HamtLeaves::Auto &&
+       std::is_trivially_copyable_v<Entry> &&
+       sizeof(InlineLeaf) <= 2 * sizeof(Branch));
+
+  static_assert(!INLINE_LEAVES || std::is_trivially_copyable_v<Entry>,
+                "inline leaves must be trivially copyable");
+
+  using Leaf = std::conditional_t<INLINE_LEAVES, InlineLeaf, OutOfLineLeaf>;
 
+  struct Node {
     union {
       Leaf leaf;
       Branch branch;
@@ -215,6 +591,26 @@ private:
   H hash_;
   size_t size_ = 0;
 
+  // Branch tables are resized by one entry on every insertion and removal,
+  // so they come from per size freelists instead of the allocator
+  TablePool<Node, BRANCHING_FACTOR, A> pool_;
+
+  // Out of line entries, there's no pool with inline leaves (their entries
+  // may be too small to pool)
+  using EntryPool =
+      std::conditional_t<INLINE_LEAVES, None, TablePool<Entry, 1, A>>;
+
+  [[no_unique_address]] EntryPool entries_;
+
+  static EntryPool make_entry_pool(A alloc) {
+    if constexpr (INLINE_LEAVES) {
+      (void)alloc;
+      return NONE;
+    } else {
+      return EntryPool(alloc);
+    }
+  }
+
   [[nodiscard]] inline size_t popcount(uint32_t x) const {
     return __builtin_popcount(x);
   }
@@ -234,34 +630,145 @@ private:
       }
 
       if (node->branch.ptr) {
-        alloc_.deallocate(node->branch.ptr,
-                          sizeof(Node) * popcount(node->branch.bitmap));
+        pool_.deallocate(node->branch.ptr, popcount(node->branch.bitmap));
       }
     }
   }
 
-  struct HashState {
-    size_t hash;
-    size_t shift;
-    size_t gen = 0;
-    K *key;
-    H hasher_fn;
+  using HashState = HamtHashState<K, H>;
 
-    inline HashState &next() {
-      shift += 5;
+  // The state of a depth first walk over the trie, with one frame per level
+  // instead of recursion
+  struct Walk {
+    struct Frame {
+      Node *branch;
 
-      // Hash was exhausted, regenerate
-      if (shift > 30) {
-        hash = hasher_fn(*key, ++gen);
+      // Children that haven't been visited yet
+      uint32_t remaining;
+    };
+
+    Frame frames[MAX_DEPTH];
+    size_t depth = 0;
+    size_t branches = 0;
+  };
+
+  void start_walk(Walk &walk) const {
+    if (root_ != nullptr) {
+      walk.frames[walk.depth++] = {root_, root_->branch.bitmap};
+      walk.branches++;
+    }
+  }
 
-        shift = 0;
+  // Returns the next leaf, `walk.depth` is then its depth
+  Node *next_leaf(Walk &walk) const {
+    while (walk.depth > 0) {
+      auto &frame = walk.frames[walk.depth - 1];
+
+      if (frame.remaining == 0) {
+        walk.depth--;
+        continue;
+      }
+
+      uint32_t index = __builtin_ctz(frame.remaining);
+      frame.remaining &= frame.remaining - 1;
+
+      auto branch = frame.branch;
+      auto child = &branch->branch.ptr[get_index(branch->branch.bitmap, index)];
+
+      if (branch->branch.leafmap & (1 << index)) {
+        return child;
       }
-      return *this;
+
+      ENSURE(walk.depth < MAX_DEPTH, "Hamt is too deep");
+      walk.frames[walk.depth++] = {child, child->branch.bitmap};
+      walk.branches++;
     }
 
-    inline size_t get_index() { return (hash >> shift) & 0x1f; }
-  };
+    return nullptr;
+  }
+
+  // How many lookups get_many keeps in flight
+  static constexpr size_t BATCH_SIZE = 16;
+
+  template <typename C> void prefetch_next(C &cursor) const {
+    auto node = cursor.node;
+    uint32_t index = cursor.state.get_index();
+
+    if (node->branch.ptr != nullptr) {
+      prefetch(&node->branch.ptr[get_index(node->branch.bitmap, index)]);
+    }
+  }
+
+  [[nodiscard]] static Entry &entry(Leaf &leaf) {
+    if constexpr (INLINE_LEAVES) {
+      return leaf.entry;
+    } else {
+      return *leaf.entry;
+    }
+  }
+
+  [[nodiscard]] static const Entry &entry(const Leaf &leaf) {
+    return entry(const_cast<Leaf &>(leaf));
+  }
 
+  [[nodiscard]] bool leaf_matches(const Leaf &leaf, const K &key,
+                                  uint64_t key_hash) const {
+    if constexpr (STORE_HASH) {
+      if (leaf.hash != key_hash) {
+        return false;
+      }
+    } else {
+      (void)key_hash;
+    }
+
+    return key_equal(entry(leaf).key.val, key);
+  }
+
+  [[nodiscard]] uint64_t leaf_hash(const Leaf &leaf) const {
+    if constexpr (STORE_HASH) {
+      return leaf.hash;
+    } else {
+      return hash_(entry(leaf).key.val);
+    }
+  }
+
+  void set_leaf_hash(Leaf &leaf, uint64_t hash) {
+    if constexpr (STORE_HASH) {
+      leaf.hash = hash;
+    } else {
+      (void)leaf;
+      (void)hash;
+    }
+  }
+
+  void make_leaf(Leaf &leaf, K key, V value, uint64_t hash) {
+    if constexpr (INLINE_LEAVES) {
+      new (&leaf.entry) Entry{MapKey<K>{std::move(key)}, std::move(value)};
+    } else {
+      leaf.entry = new (entries_.allocate(1))
+          Entry{MapKey<K>{std::move(key)}, std::move(value)};
+    }
+
+    set_leaf_hash(leaf, hash);
+  }
+
+  void set_value(Leaf &leaf, V value) {
+    auto &e = entry(leaf);
+    e.value.~V();
+    new (&e.value) V(std::move(value));
+  }
+
+  void destroy_leaf(Leaf &leaf) {
+    if constexpr (!INLINE_LEAVES) {
+      leaf.entry->~Entry();
+      entries_.deallocate(leaf.entry, 1);
+    } else {
+      (void)leaf;
+    }
+  }
+
+  // A collision means that another key occupies the slot, so the key isn't
+  // in the trie
   enum SearchStatus { NOT_FOUND, FOUND, COLLISION };
 
   struct SearchResult {
@@ -271,7 +778,7 @@ private:
     SearchStatus status;
   };
 
-  SearchResult search(Node *node, K key, HashState &state,
+  SearchResult search(Node *node, const K &key, HashState &state,
                       Node *grandparent) const {
     uint32_t index = state.get_index();
 
@@ -281,7 +788,7 @@ private:
       if (node->branch.leafmap & (1 << index)) {
         auto leaf = &node->branch.ptr[pos];
 
-        if (leaf->leaf.key == key) {
+        if (leaf_matches(leaf->leaf, key, state.key_hash)) {
           return {node, grandparent, leaf, FOUND};
         }
 
@@ -297,9 +804,53 @@ private:
     return {nullptr, nullptr, node, NOT_FOUND};
   }
 
+  // Turn `node` into a branch holding the entries at `indices` [begin, end),
+  // which share the hash bits below `shift`
+  void build_branch(Node *node, Slice<const Cons<K, V>> entries,
+                    const Vec<size_t, A> &indices,
+                    const Vec<uint64_t, A> &hashes, size_t begin, size_t end,
+                    size_t shift, Vec<size_t, A> &deferred) {
+    uint32_t bitmap = 0;
+
+    for (size_t i = begin; i < end; i++) {
+      bitmap |= 1 << ((hashes[i] >> shift) & 0x1f);
+    }
+
+    node->branch.bitmap = bitmap;
+    node->branch.leafmap = 0;
+    node->branch.ptr = pool_.allocate(popcount(bitmap));
+
+    for (size_t i = begin; i < end;) {
+      uint32_t index = (hashes[i] >> shift) & 0x1f;
+      size_t group_end = i + 1;
+
+      while (group_end < end &&
+             ((hashes[group_end] >> shift) & 0x1f) == index) {
+        group_end++;
+      }
+
+      auto child = &node->branch.ptr[get_index(bitmap, index)];
+
+      if (group_end - i == 1 || shift + 5 > HashState::MAX_SHIFT) {
+        node->branch.leafmap |= 1 << index;
+        auto &entry = entries[indices[i]];
+        make_leaf(child->leaf, entry.car, entry.cdr, hashes[i]);
+        size_++;
+
+        for (size_t j = i + 1; j < group_end; j++) {
+          deferred.push(indices[j]);
+        }
+      } else {
+        build_branch(child, entries, indices, hashes, i, group_end, shift + 5,
+                     deferred);
+      }
+
+      i = group_end;
+    }
+  }
+
   void extend_table(Node *branch, size_t prev_size, size_t pos) {
-    auto new_table = reinterpret_cast<Node *>(
-        alloc_.allocate(sizeof(Node) * (prev_size + 1)));
+    auto new_table = pool_.allocate(prev_size + 1);
 
     if (prev_size > 0) {
       memcpy(new_table, branch->branch.ptr, sizeof(Node) * pos);
@@ -307,7 +858,7 @@ private:
       memcpy(&new_table[pos + 1], &branch->branch.ptr[pos],
              sizeof(Node) * (prev_size - pos));
 
-      alloc_.deallocate(branch->branch.ptr, sizeof(Node) * prev_size);
+      pool_.deallocate(branch->branch.ptr, prev_size);
     }
 
     branch->branch.ptr = new_table;
@@ -321,13 +872,12 @@ private:
   void shrink_table_to_fit(Node *branch, size_t new_size, size_t prev_size,
                            size_t pos) {
     if (new_size == 0) {
-      alloc_.deallocate(branch->branch.ptr, sizeof(Node));
+      pool_.deallocate(branch->branch.ptr, prev_size);
       branch->branch.ptr = nullptr;
     }
 
     else {
-      auto new_table =
-          reinterpret_cast<Node *>(alloc_.allocate(sizeof(Node) * new_size));
+      auto new_table = pool_.allocate(new_size);
 
       if (pos > 0) {
         memcpy(new_table, branch->branch.ptr, sizeof(Node) * pos);
@@ -338,7 +888,7 @@ private:
                sizeof(Node) * (new_size - pos));
       }
 
-      alloc_.deallocate(branch->branch.ptr, sizeof(Node) * prev_size);
+      pool_.deallocate(branch->branch.ptr, prev_size);
       branch->branch.ptr = new_table;
     }
   }
@@ -356,17 +906,17 @@ private:
     branch->branch.bitmap = new_bitmap;
     branch->branch.leafmap |= (1 << index);
 
-    branch->branch.ptr[pos].leaf.key = MapKey<K>{key};
-    branch->branch.ptr[pos].leaf.value = value;
+    make_leaf(branch->branch.ptr[pos].leaf, std::move(key), std::move(value),
+              hash.key_hash);
   }
 
-  void insert_from_hash(K key, V value, HashState hash) {
+  void insert_from_hash(K &key, V &value, HashState hash) {
     auto node = root_;
 
     auto result = search(node, key, hash, nullptr);
 
     if (result.status == FOUND) {
-      result.value->leaf.value = value;
+      set_value(result.value->leaf, std::move(value));
     }
 
     else if (result.status == NOT_FOUND) {
@@ -380,28 +930,20 @@ private:
     }
   }
 
-  SearchResult find_node_rehash(Node *start, K key, HashState &state) const {
-    auto res = search(start, key, state, nullptr);
-
-    while (res.status == COLLISION) {
-      state.hash = hash_(key, ++state.gen);
-      state.shift = 0;
-      state.gen = 0;
-      state.hasher_fn = hash_;
-
-      res = search(root_, key, state, nullptr);
-    }
-
-    return res;
-  }
-
   void convert_to_branch(Node *node, Node *parent, HashState hash, K &key,
                          V &value) {
 
     auto prev_node = *node;
 
-    HashState state = {hash_(prev_node.leaf.key.val), hash.shift, hash.gen,
-                       &prev_node.leaf.key.val, hash_};
+    // Bring the state of the existing leaf to the same level as ours
+    auto prev_key = &entry(prev_node.leaf).key.val;
+    HashState state(leaf_hash(prev_node.leaf), prev_key, hash_);
+    state.shift = hash.shift;
+
+    if (hash.gen != 0) {
+      state.gen = hash.gen;
+      state.hash = hash_(*prev_key, hash.gen);
+    }
 
     parent->branch.leafmap &= ~(1 << hash.get_index());
 
@@ -413,8 +955,7 @@ private:
     while (curr_index == prev_index) {
       root->branch.leafmap = 0;
       root->branch.bitmap = 1 << curr_index;
-      root->branch.ptr =
-          reinterpret_cast<Node *>(alloc_.allocate(sizeof(Node)));
+      root->branch.ptr = pool_.allocate(1);
 
       curr_index = hash.next().get_index();
       prev_index = state.next().get_index();
@@ -422,8 +963,7 @@ private:
       root = root->branch.ptr;
     }
 
-    root->branch.ptr =
-        reinterpret_cast<Node *>(alloc_.allocate(sizeof(Node) * 2));
+    root->branch.ptr = pool_.allocate(2);
 
     root->branch.bitmap = root->branch.leafmap =
         (1 << curr_index) | (1 << prev_index);
@@ -432,12 +972,12 @@ private:
     auto real_curr_index = get_index(root->branch.bitmap, curr_index);
 
     root->branch.ptr[real_prev_index] = prev_node;
-    root->branch.ptr[real_curr_index].leaf.key = MapKey<K>{key};
-    root->branch.ptr[real_curr_index].leaf.value = value;
+    make_leaf(root->branch.ptr[real_curr_index].leaf, std::move(key),
+              std::move(value), hash.key_hash);
   }
 
   // 'Fold' a branch, convert it to a leaf node
-  void fold_branch(Node *branch, Node *parent, size_t index, Node::Leaf &leaf) {
+  void fold_branch(Node *branch, Node *parent, size_t index, Leaf &leaf) {
     // Ensure parent knows we're a leaf node
     parent->branch.leafmap |= (1 << index);
 
@@ -477,8 +1017,10 @@ private:
     else {
       std::cout << indentation << "?---"
                 << " Leaf Node @ " << (void *)n << ":" << std::endl;
-      std::cout << indentation << "  +- Key: " << n->leaf.key.val << std::endl;
-      std::cout << indentation << "  +- Value: " << n->leaf.value << std::endl;
+      std::cout << indentation << "  +- Key: " << entry(n->leaf).key.val
+                << std::endl;
+      std::cout << indentation << "  +- Value: " << entry(n->leaf).value
+                << std::endl;
     }
   }
 #endif
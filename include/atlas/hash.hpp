@@ -1,13 +1,25 @@
 #pragma once
+#include "array.hpp"
+#include "cons.hpp"
+#include "enum.hpp"
+#include "slice.hpp"
 #include "string.hpp"
 #include "string_view.hpp"
+#include "tuple.hpp"
+#include <bit>
+#include <type_traits>
+#include <utility>
+
+#if (defined(__AVX2__) || defined(__SSE2__)) && __has_include(<immintrin.h>)
+#include <immintrin.h>
+#endif
 
 namespace atlas {
 
 /*
     MurmurHash2a, by Austin Appleby
 */
-static uint64_t murmur_hash(const void *key, size_t len, uint64_t seed) {
+inline uint64_t murmur_hash(const void *key, size_t len, uint64_t seed) {
   const uint64_t m = 0xc6a4a7935bd1e995LLU;
   const int r = 47;
   uint64_t h = seed ^ (len * m);
@@ -47,11 +59,240 @@ static uint64_t murmur_hash(const void *key, size_t len, uint64_t seed) {
   return h;
 }
 
+namespace detail {
+
+constexpr uint64_t HASH_SECRET[8] = {
+    0xa0761d6478bd642fLLU, 0xe7037ed1a0b428dbLLU, 0x8ebc6af09c88c6e3LLU,
+    0x589965cc75374cc3LLU, 0x1d8e4e27c47d124fLLU, 0xbe4ba423396cfeb8LLU,
+    0xdb979083e96dd4deLLU, 0x1f67b3b7a4a44072LLU,
+};
+
+// Multiply two 64-bit values and fold the 128-bit product
+inline uint64_t fold_mul(uint64_t a, uint64_t b) {
+  auto r = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+constexpr size_t STRIPE_SIZE = 64;
+constexpr size_t STRIPES_PER_BLOCK = 16;
+constexpr uint64_t SCRAMBLE_PRIME = 0x9e3779b1;
+
+// Accumulate 64-byte stripes into 8 lanes, XXH3 style: each lane adds the
+// product of the two halves of its keyed input, plus the raw input of its
+// neighbour lane. Lanes are scrambled after each block of 16 stripes.
+inline void accumulate_stripes_scalar(uint64_t (&acc)[8], const uint8_t *p,
+                                      size_t stripes) {
+  for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+    for (size_t i = 0; i < 8; i++) {
+      auto data = read64(p + i * 8);
+      auto key = data ^ HASH_SECRET[i];
+      acc[i ^ 1] += data;
+      acc[i] += (key & 0xffffffff) * (key >> 32);
+    }
+
+    if ((s + 1) % STRIPES_PER_BLOCK == 0) {
+      for (size_t i = 0; i < 8; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= HASH_SECRET[7 - i];
+        acc[i] *= SCRAMBLE_PRIME;
+      }
+    }
+  }
+}
+
+#if defined(__AVX2__) && __has_include(<immintrin.h>)
+
+inline void accumulate_stripes(uint64_t (&acc)[8], const uint8_t *p,
+                               size_t stripes) {
+  auto secret = reinterpret_cast<const __m256i *>(HASH_SECRET);
+  auto acc_ptr = reinterpret_cast<__m256i *>(acc);
+  __m256i lanes[2] = {_mm256_loadu_si256(acc_ptr),
+                      _mm256_loadu_si256(acc_ptr + 1)};
+
+  for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+    for (size_t i = 0; i < 2; i++) {
+      auto data = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(p + i * 32));
+      auto key = _mm256_xor_si256(data, _mm256_loadu_si256(secret + i));
+      auto product = _mm256_mul_epu32(key, _mm256_srli_epi64(key, 32));
+      auto swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      lanes[i] = _mm256_add_epi64(lanes[i], _mm256_add_epi64(product, swapped));
+    }
+
+    if ((s + 1) % STRIPES_PER_BLOCK == 0) {
+      auto prime = _mm256_set1_epi64x(SCRAMBLE_PRIME);
+      for (size_t i = 0; i < 2; i++) {
+        auto x = _mm256_xor_si256(lanes[i], _mm256_srli_epi64(lanes[i], 47));
+        x = _mm256_xor_si256(
+            x, _mm256_setr_epi64x(HASH_SECRET[7 - i * 4], HASH_SECRET[6 - i * 4],
+                                  HASH_SECRET[5 - i * 4],
+                                  HASH_SECRET[4 - i * 4]));
+        auto lo = _mm256_mul_epu32(x, prime);
+        auto hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), prime);
+        lanes[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+      }
+    }
+  }
+
+  _mm256_storeu_si256(acc_ptr, lanes[0]);
+  _mm256_storeu_si256(acc_ptr + 1, lanes[1]);
+}
+
+#elif defined(__SSE2__) && __has_include(<immintrin.h>)
+
+inline void accumulate_stripes(uint64_t (&acc)[8], const uint8_t *p,
+                               size_t stripes) {
+  auto secret = reinterpret_cast<const __m128i *>(HASH_SECRET);
+  auto acc_ptr = reinterpret_cast<__m128i *>(acc);
+  __m128i lanes[4];
+
+  for (size_t i = 0; i < 4; i++) {
+    lanes[i] = _mm_loadu_si128(acc_ptr + i);
+  }
+
+  for (size_t s = 0; s < stripes; s++, p += STRIPE_SIZE) {
+    for (size_t i = 0; i < 4; i++) {
+      auto data =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 16));
+      auto key = _mm_xor_si128(data, _mm_loadu_si128(secret + i));
+      auto product = _mm_mul_epu32(key, _mm_srli_epi64(key, 32));
+      auto swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+      lanes[i] = _mm_add_epi64(lanes[i], _mm_add_epi64(product, swapped));
+    }
+
+    if ((s + 1) % STRIPES_PER_BLOCK == 0) {
+      auto prime = _mm_set1_epi64x(SCRAMBLE_PRIME);
+      for (size_t i = 0; i < 4; i++) {
+        auto x = _mm_xor_si128(lanes[i], _mm_srli_epi64(lanes[i], 47));
+        x = _mm_xor_si128(x, _mm_set_epi64x(HASH_SECRET[6 - i * 2],
+                                            HASH_SECRET[7 - i * 2]));
+        auto lo = _mm_mul_epu32(x, prime);
+        auto hi = _mm_mul_epu32(_mm_srli_epi64(x, 32), prime);
+        lanes[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+      }
+    }
+  }
+
+  for (size_t i = 0; i < 4; i++) {
+    _mm_storeu_si128(acc_ptr + i, lanes[i]);
+  }
+}
+
+#else
+
+inline void accumulate_stripes(uint64_t (&acc)[8], const uint8_t *p,
+                               size_t stripes) {
+  accumulate_stripes_scalar(acc, p, stripes);
+}
+
+#endif
+
+} // namespace detail
+
+/*
+    A wyhash style hash function (after wyhash by Wang Yi), inputs longer than
+    64 bytes go through an XXH3 style stripe accumulator, which is vectorized
+    when SSE2 or AVX2 are available.
+*/
+inline uint64_t wy_hash(const void *key, size_t len, uint64_t seed) {
+  using namespace detail;
+
+  auto p = static_cast<const uint8_t *>(key);
+  uint64_t a;
+  uint64_t b;
+
+  seed ^= fold_mul(seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (read32(p) << 32) | read32(p + ((len >> 3) << 2));
+      b = (read32(p + len - 4) << 32) |
+          read32(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = (static_cast<uint64_t>(p[0]) << 16) |
+          (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+
+    if (i > STRIPE_SIZE) {
+      uint64_t acc[8] = {seed, HASH_SECRET[2], HASH_SECRET[3], seed,
+                         HASH_SECRET[4], HASH_SECRET[5], seed, HASH_SECRET[6]};
+
+      // Always leave at least one byte for the tail
+      size_t stripes = (i - 1) / STRIPE_SIZE;
+      accumulate_stripes(acc, p, stripes);
+      p += stripes * STRIPE_SIZE;
+      i -= stripes * STRIPE_SIZE;
+
+      for (size_t j = 0; j < 8; j += 2) {
+        seed = fold_mul(acc[j] ^ HASH_SECRET[j], acc[j + 1] ^ seed);
+      }
+    }
+
+    while (i > 16) {
+      seed = fold_mul(read64(p) ^ HASH_SECRET[1], read64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+
+    a = read64(p + i - 16);
+    b = read64(p + i - 8);
+  }
+
+  return fold_mul(fold_mul(a ^ HASH_SECRET[1], b ^ seed) ^ HASH_SECRET[0] ^
+                      len,
+                  HASH_SECRET[1]);
+}
+
+/// Hash a single integer with one multiplication: the key is keyed with the
+/// seed, multiplied by a constant into a 128-bit product, and both halves of
+/// the product are folded together, so every output bit depends on every
+/// input bit.
+constexpr uint64_t mix_integer(uint64_t x, uint64_t seed = 0) {
+  auto r = static_cast<unsigned __int128>(
+               x ^ (seed * detail::HASH_SECRET[2] + detail::HASH_SECRET[3])) *
+           detail::HASH_SECRET[4];
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
 template <typename T> struct Hash;
 
 template <std::integral T> struct Hash<T> {
-  uint64_t operator()(T a, size_t gen = 0) const {
-    return murmur_hash(&a, sizeof(a), gen);
+  constexpr uint64_t operator()(T a, size_t gen = 0) const {
+    return mix_integer(static_cast<uint64_t>(a), gen);
+  }
+};
+
+template <std::floating_point T>
+  requires(sizeof(T) == 4 || sizeof(T) == 8)
+struct Hash<T> {
+  constexpr uint64_t operator()(T a, size_t gen = 0) const {
+    // -0.0 and 0.0 compare equal, so they must hash the same
+    if (a == 0) {
+      a = 0;
+    }
+
+    if constexpr (sizeof(T) == 4) {
+      return mix_integer(std::bit_cast<uint32_t>(a), gen);
+    } else {
+      return mix_integer(std::bit_cast<uint64_t>(a), gen);
+    }
   }
 };
 
@@ -63,20 +304,239 @@ template <> struct Hash<void *> {
 
 template <> struct Hash<String> {
   uint64_t operator()(const String &s, size_t gen = 0) const {
-    return murmur_hash(s.data(), s.length(), gen);
+    return wy_hash(s.data(), s.length(), gen);
   }
 };
 
 template <> struct Hash<StringView> {
   uint64_t operator()(const StringView &s, size_t gen = 0) const {
-    return murmur_hash(s.data(), s.length(), gen);
+    return wy_hash(s.data(), s.length(), gen);
   }
 };
 
 template <> struct Hash<const char *> {
+  uint64_t operator()(const char *s, size_t gen = 0) const {
+    return wy_hash(s, strlen(s), gen);
+  }
+};
+
+/// Mix the hash of one more field into `seed`, the result depends on the
+/// order in which fields are combined
+constexpr uint64_t hash_combine(uint64_t seed, uint64_t hash) {
+  return mix_integer(hash, seed);
+}
+
+/// Types whose value is entirely defined by their bytes (no padding, no
+/// floating point), contiguous sequences of them are hashed as one buffer
+template <typename T>
+concept TriviallyHashable = std::has_unique_object_representations_v<T>;
+
+template <Enum T> struct Hash<T> {
+  constexpr uint64_t operator()(T a, size_t gen = 0) const {
+    return Hash<std::underlying_type_t<T>>()(
+        static_cast<std::underlying_type_t<T>>(a), gen);
+  }
+};
+
+template <typename A, typename B> struct Hash<Cons<A, B>> {
+  constexpr uint64_t operator()(const Cons<A, B> &c, size_t gen = 0) const {
+    return hash_combine(Hash<A>()(c.car, gen), Hash<B>()(c.cdr, gen));
+  }
+};
+
+template <typename... Ts> struct Hash<Tuple<Ts...>> {
+  constexpr uint64_t operator()(const Tuple<Ts...> &t, size_t gen = 0) const {
+    return hash_fields(t, gen, std::make_integer_sequence<int, sizeof...(Ts)>());
+  }
+
+private:
+  template <int... I>
+  constexpr uint64_t hash_fields(const Tuple<Ts...> &t, size_t gen,
+                                 std::integer_sequence<int, I...>) const {
+    uint64_t seed = gen;
+    ((seed = hash_combine(seed, Hash<Ts>()(t.template get<I>(), gen))), ...);
+    (void)t;
+    return seed;
+  }
+};
+
+/// Hash `count` contiguous values, in one pass over their bytes when they're
+/// trivially hashable. The byte path can't run in constant expressions, so
+/// it's only constexpr for other types.
+template <typename T>
+constexpr uint64_t hash_range(const T *data, size_t count, size_t gen = 0) {
+  using U = std::remove_cv_t<T>;
+
+  if constexpr (TriviallyHashable<U>) {
+    return wy_hash(data, count * sizeof(U), gen);
+  } else {
+    uint64_t seed = hash_combine(gen, count);
+    for (size_t i = 0; i < count; i++) {
+      seed = hash_combine(seed, Hash<U>()(data[i], gen));
+    }
+    return seed;
+  }
+}
+
+template <typename T> struct Hash<Slice<T>> {
+  constexpr uint64_t operator()(const Slice<T> &s, size_t gen = 0) const {
+    return hash_range(s.data(), s.size(), gen);
+  }
+};
+
+template <typename T, size_t N> struct Hash<Array<T, N>> {
+  constexpr uint64_t operator()(const Array<T, N> &a, size_t gen = 0) const {
+    return hash_range(a.data(), N, gen);
+  }
+};
+
+/// The previous default, MurmurHash2a for every key type
+template <typename T> struct MurmurHash;
+
+template <std::integral T> struct MurmurHash<T> {
+  uint64_t operator()(T a, size_t gen = 0) const {
+    return murmur_hash(&a, sizeof(a), gen);
+  }
+};
+
+template <> struct MurmurHash<void *> {
+  uint64_t operator()(void *a, size_t gen = 0) const {
+    return MurmurHash<uintptr_t>()((uintptr_t)a, gen);
+  }
+};
+
+template <> struct MurmurHash<String> {
+  uint64_t operator()(const String &s, size_t gen = 0) const {
+    return murmur_hash(s.data(), s.length(), gen);
+  }
+};
+
+template <> struct MurmurHash<StringView> {
+  uint64_t operator()(const StringView &s, size_t gen = 0) const {
+    return murmur_hash(s.data(), s.length(), gen);
+  }
+};
+
+template <> struct MurmurHash<const char *> {
   uint64_t operator()(const char *s, size_t gen = 0) const {
     return murmur_hash(s, strlen(s), gen);
   }
 };
 
+/// Key equality used by the hash containers, C strings are compared by
+/// content to stay consistent with how they're hashed
+template <typename T> constexpr bool key_equal(const T &a, const T &b) {
+  return a == b;
+}
+
+inline bool key_equal(const char *a, const char *b) {
+  return strcmp(a, b) == 0;
+}
+
+namespace detail {
+
+template <std::integral T>
+inline void mix_integers_scalar(const T *keys, size_t count, uint64_t *out,
+                                uint64_t seed) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = mix_integer(static_cast<uint64_t>(keys[i]), seed);
+  }
+}
+
+#if defined(__AVX2__) && __has_include(<immintrin.h>)
+
+// mix_integer on four lanes. AVX2 has no 64x64->128 multiply, so the product
+// is put together from four 32x32->64 ones.
+inline __m256i mix_integer_x4(__m256i x, __m256i key, __m256i m) {
+  const __m256i low_mask = _mm256_set1_epi64x(0xffffffff);
+
+  auto a = _mm256_xor_si256(x, key);
+  auto a_hi = _mm256_srli_epi64(a, 32);
+  auto m_hi = _mm256_srli_epi64(m, 32);
+
+  auto ll = _mm256_mul_epu32(a, m);
+  auto lh = _mm256_mul_epu32(a, m_hi);
+  auto hl = _mm256_mul_epu32(a_hi, m);
+  auto hh = _mm256_mul_epu32(a_hi, m_hi);
+
+  auto mid = _mm256_add_epi64(
+      _mm256_srli_epi64(ll, 32),
+      _mm256_add_epi64(_mm256_and_si256(lh, low_mask),
+                       _mm256_and_si256(hl, low_mask)));
+
+  auto lo = _mm256_or_si256(_mm256_slli_epi64(mid, 32),
+                            _mm256_and_si256(ll, low_mask));
+  auto hi = _mm256_add_epi64(
+      _mm256_add_epi64(hh, _mm256_srli_epi64(mid, 32)),
+      _mm256_add_epi64(_mm256_srli_epi64(lh, 32), _mm256_srli_epi64(hl, 32)));
+
+  return _mm256_xor_si256(lo, hi);
+}
+
+// Load four keys, widened to 64 bits the same way static_cast<uint64_t> does
+template <std::integral T> inline __m256i load_integers_x4(const T *keys) {
+  if constexpr (sizeof(T) == 8) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys));
+  } else if constexpr (sizeof(T) == 4) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys));
+    return std::is_signed_v<T> ? _mm256_cvtepi32_epi64(v)
+                               : _mm256_cvtepu32_epi64(v);
+  } else if constexpr (sizeof(T) == 2) {
+    auto v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(keys));
+    return std::is_signed_v<T> ? _mm256_cvtepi16_epi64(v)
+                               : _mm256_cvtepu16_epi64(v);
+  } else {
+    int32_t bytes;
+    memcpy(&bytes, keys, sizeof(bytes));
+    auto v = _mm_cvtsi32_si128(bytes);
+    return std::is_signed_v<T> ? _mm256_cvtepi8_epi64(v)
+                               : _mm256_cvtepu8_epi64(v);
+  }
+}
+
+template <std::integral T>
+inline void mix_integers(const T *keys, size_t count, uint64_t *out,
+                         uint64_t seed) {
+  auto key = _mm256_set1_epi64x(seed * HASH_SECRET[2] + HASH_SECRET[3]);
+  auto m = _mm256_set1_epi64x(HASH_SECRET[4]);
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    auto h = mix_integer_x4(load_integers_x4(keys + i), key, m);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), h);
+  }
+
+  mix_integers_scalar(keys + i, count - i, out + i, seed);
+}
+
+#else
+
+template <std::integral T>
+inline void mix_integers(const T *keys, size_t count, uint64_t *out,
+                         uint64_t seed) {
+  mix_integers_scalar(keys, count, out, seed);
+}
+
+#endif
+
+} // namespace detail
+
+/// Hash every key of `keys` into `out`, giving the same result as calling
+/// `hasher(key, gen)` on each of them.
+/// With the default hasher, integer keys are mixed four at a time when AVX2
+/// is available. Other keys are hashed one by one.
+template <typename K, typename H = Hash<K>>
+void hash_batch(Slice<const K> keys, Slice<uint64_t> out,
+                const H &hasher = H(), size_t gen = 0) {
+  ENSURE(out.size() >= keys.size(), "output slice is too small");
+
+  if constexpr (std::is_same_v<H, Hash<K>> && std::integral<K>) {
+    detail::mix_integers(keys.data(), keys.size(), out.data(), gen);
+  } else {
+    for (size_t i = 0; i < keys.size(); i++) {
+      out[i] = hasher(keys[i], gen);
+    }
+  }
+}
+
 } // namespace atlas
@@ -0,0 +1,370 @@
+#pragma once
+#include "alloc.hpp"
+#include "hash.hpp"
+#include "iter.hpp"
+#include "result.hpp"
+#include "slice.hpp"
+#include <new>
+#include <utility>
+
+namespace atlas {
+
+/// The open addressing engine behind HashMap and HashSet.
+/// Entries are stored in a flat array, and occupancy is tracked in a separate
+/// array of control bytes, so an empty slot only costs a byte instead of a
+/// whole Option<Entry>. The table size is always a power of two, probing is
+/// linear, and removal shifts the following entries back instead of leaving
+/// tombstones behind.
+/// The control byte of a full slot holds a 7-bit tag taken from the top of
+/// the key's hash, so most mismatching entries are rejected without looking
+/// at their key. With `StoreHash`, the full hash of every entry is kept as
+/// well: probes compare it before the key, and growing or removing never
+/// calls the hasher again. This pays off when hashing or comparing keys is
+/// expensive, e.g. for strings.
+/// `E` is the entry type, it must have a `key` member of type `K`.
+template <typename K, typename E, Allocator A = DefaultAllocator,
+          typename H = Hash<K>, bool StoreHash = false>
+class HashTable {
+
+public:
+  HashTable(size_t capacity = MIN_CAPACITY, A alloc = A(), H hasher = H())
+      : size_(0), capacity_(capacity_for(capacity)), alloc_(alloc),
+        hasher_(hasher) {
+    allocate_table();
+  }
+
+  /// `other` is left empty, with a table of its own like a new one, so it
+  /// can still be used
+  HashTable(HashTable &&other)
+      : entries_(other.entries_), hashes_(other.hashes_), ctrl_(other.ctrl_),
+        size_(other.size_), capacity_(other.capacity_), alloc_(other.alloc_),
+        hasher_(other.hasher_) {
+    other.size_ = 0;
+    other.capacity_ = MIN_CAPACITY;
+    other.allocate_table();
+  }
+
+  HashTable(const HashTable &other) = delete;
+  HashTable &operator=(const HashTable &other) = delete;
+
+  ~HashTable() {
+    destroy_entries();
+    alloc_.deallocate(entries_, table_bytes(capacity_));
+  }
+
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  [[nodiscard]] const A &allocator() const { return alloc_; }
+  [[nodiscard]] const H &hasher() const { return hasher_; }
+
+  [[nodiscard]] E *find(const K &key) const {
+    return find_from(key, hasher_(key));
+  }
+
+  /// Look up a batch of keys, calling `f(i, entry)` for each one with a
+  /// pointer to the entry of `keys[i]`, or nullptr if it isn't present.
+  /// Keys are hashed and their slots prefetched a group at a time before
+  /// probing, so the cache misses of a group overlap instead of stalling
+  /// one after the other.
+  template <typename F> void find_many(Slice<const K> keys, F f) const {
+    uint64_t hashes[BATCH_SIZE];
+
+    for (size_t start = 0; start < keys.size(); start += BATCH_SIZE) {
+      size_t count = keys.size() - start;
+      count = count < BATCH_SIZE ? count : BATCH_SIZE;
+
+      hash_batch(keys.sub_slice(start, start + count).unwrap(),
+                 Slice<uint64_t>(hashes, count), hasher_);
+
+      for (size_t i = 0; i < count; i++) {
+        auto index = index_for_hash(hashes[i]);
+        prefetch(&ctrl_[index]);
+        prefetch(&entries_[index]);
+      }
+
+      for (size_t i = 0; i < count; i++) {
+        f(start + i, find_from(keys[start + i], hashes[i]));
+      }
+    }
+  }
+
+  Result<> insert(E entry) {
+    reserve(size_ + 1);
+
+    uint64_t hash = hasher_(entry.key);
+    return insert_hashed(std::move(entry), hash);
+  }
+
+  /// Insert an entry for every key of `keys`, built by `f(i)` for `keys[i]`
+  /// The table is grown once up front, and keys are hashed a group at a time.
+  /// Keys that are already present are skipped, and reported by returning
+  /// Error::Duplicate once every other key has been inserted.
+  template <typename F> Result<> insert_many(Slice<const K> keys, F f) {
+    uint64_t hashes[BATCH_SIZE];
+    bool duplicate = false;
+
+    reserve(size_ + keys.size());
+
+    for (size_t start = 0; start < keys.size(); start += BATCH_SIZE) {
+      size_t count = keys.size() - start;
+      count = count < BATCH_SIZE ? count : BATCH_SIZE;
+
+      hash_batch(keys.sub_slice(start, start + count).unwrap(),
+                 Slice<uint64_t>(hashes, count), hasher_);
+
+      for (size_t i = 0; i < count; i++) {
+        if (!insert_hashed(f(start + i), hashes[i]).is_ok()) {
+          duplicate = true;
+        }
+      }
+    }
+
+    if (duplicate) {
+      return Err(Error::Duplicate);
+    }
+
+    return Ok(NONE);
+  }
+
+  Result<> remove(const K &key) {
+    auto entry = find(key);
+
+    if (entry == nullptr) {
+      return Err(Error::NotFound);
+    }
+
+    size_t hole = entry - entries_;
+    entry->~E();
+    ctrl_[hole] = EMPTY;
+    size_--;
+
+    // Backward shift deletion: pull back every entry of the cluster that
+    // would become unreachable because of the hole we just made
+    size_t index = (hole + 1) & (capacity_ - 1);
+
+    while (ctrl_[index] != EMPTY) {
+      size_t home = index_for_hash(hash_of(index));
+
+      // Move the entry if its home slot isn't within (hole, index]
+      if (((index - home) & (capacity_ - 1)) >=
+          ((index - hole) & (capacity_ - 1))) {
+        new (&entries_[hole]) E(std::move(entries_[index]));
+        entries_[index].~E();
+        set_hash(hole, hash_of(index));
+        ctrl_[hole] = ctrl_[index];
+        ctrl_[index] = EMPTY;
+        hole = index;
+      }
+
+      index = (index + 1) & (capacity_ - 1);
+    }
+
+    return Ok(NONE);
+  }
+
+  /// Make room for at least `count` entries without growing again
+  void reserve(size_t count) {
+    if (count * MAX_LOAD_DEN <= capacity_ * MAX_LOAD_NUM) {
+      return;
+    }
+
+    rehash(capacity_for(count));
+  }
+
+  void clear() {
+    destroy_entries();
+    size_ = 0;
+  }
+
+  /// Returns an iterator over pointers to the entries of the table
+  /// NOTE: The order is unspecified
+  [[nodiscard]] auto iter() const {
+    auto next_func = [this, index = size_t(0)]() mutable -> Option<E *> {
+      while (index < capacity_) {
+        auto i = index++;
+        if (ctrl_[i] != EMPTY) {
+          return &entries_[i];
+        }
+      }
+
+      return NONE;
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+private:
+  static constexpr size_t MIN_CAPACITY = 8;
+
+  // Grow once the table is 7/8 full
+  static constexpr size_t MAX_LOAD_NUM = 7;
+  static constexpr size_t MAX_LOAD_DEN = 8;
+
+  // How many keys find_many and insert_many hash and probe at a time
+  static constexpr size_t BATCH_SIZE = 16;
+
+  // A full slot always has the top bit of its control byte set
+  static constexpr uint8_t EMPTY = 0;
+  static constexpr uint8_t FULL = 0x80;
+
+  E *entries_ = nullptr;
+  uint64_t *hashes_ = nullptr;
+  uint8_t *ctrl_ = nullptr;
+  size_t size_;
+  size_t capacity_;
+  A alloc_;
+  H hasher_;
+
+  // The caller must have made room for the entry
+  Result<> insert_hashed(E entry, uint64_t hash) {
+    uint8_t tag = tag_for_hash(hash);
+    size_t index = index_for_hash(hash);
+
+    while (ctrl_[index] != EMPTY) {
+      if (matches(index, tag, hash, entry.key)) {
+        return Err(Error::Duplicate);
+      }
+
+      index = (index + 1) & (capacity_ - 1);
+    }
+
+    new (&entries_[index]) E(std::move(entry));
+    set_hash(index, hash);
+    ctrl_[index] = tag;
+    size_++;
+
+    return Ok(NONE);
+  }
+
+  [[nodiscard]] E *find_from(const K &key, uint64_t hash) const {
+    uint8_t tag = tag_for_hash(hash);
+    size_t index = index_for_hash(hash);
+
+    // The load factor guarantees there is always an empty slot, so this
+    // terminates
+    while (ctrl_[index] != EMPTY) {
+      if (matches(index, tag, hash, key)) {
+        return &entries_[index];
+      }
+
+      index = (index + 1) & (capacity_ - 1);
+    }
+
+    return nullptr;
+  }
+
+  [[nodiscard]] static size_t capacity_for(size_t count) {
+    size_t capacity = MIN_CAPACITY;
+
+    while (count * MAX_LOAD_DEN > capacity * MAX_LOAD_NUM) {
+      capacity *= 2;
+    }
+
+    return capacity;
+  }
+
+  [[nodiscard]] bool matches(size_t index, uint8_t tag, uint64_t hash,
+                             const K &key) const {
+    if (ctrl_[index] != tag) {
+      return false;
+    }
+
+    if constexpr (StoreHash) {
+      if (hashes_[index] != hash) {
+        return false;
+      }
+    }
+
+    return key_equal(entries_[index].key, key);
+  }
+
+  [[nodiscard]] uint64_t hash_of(size_t index) const {
+    if constexpr (StoreHash) {
+      return hashes_[index];
+    } else {
+      return hasher_(entries_[index].key);
+    }
+  }
+
+  void set_hash(size_t index, uint64_t hash) {
+    if constexpr (StoreHash) {
+      hashes_[index] = hash;
+    } else {
+      (void)index;
+      (void)hash;
+    }
+  }
+
+  // Entries, hashes and control bytes share a single allocation, in that
+  // order. The capacity is a multiple of 8, so the hashes stay aligned.
+  [[nodiscard]] static size_t table_bytes(size_t capacity) {
+    return capacity * (sizeof(E) + (StoreHash ? sizeof(uint64_t) : 0) + 1);
+  }
+
+  void allocate_table() {
+    entries_ = reinterpret_cast<E *>(alloc_.allocate(table_bytes(capacity_)));
+    hashes_ = reinterpret_cast<uint64_t *>(entries_ + capacity_);
+    ctrl_ = reinterpret_cast<uint8_t *>(
+        hashes_ + (StoreHash ? capacity_ : 0));
+    memset(ctrl_, EMPTY, capacity_);
+  }
+
+  void destroy_entries() {
+    for (size_t i = 0; i < capacity_; i++) {
+      if (ctrl_[i] != EMPTY) {
+        entries_[i].~E();
+        ctrl_[i] = EMPTY;
+      }
+    }
+  }
+
+  void rehash(size_t new_capacity) {
+    auto old_entries = entries_;
+    auto old_hashes = hashes_;
+    auto old_ctrl = ctrl_;
+    auto old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    allocate_table();
+
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_ctrl[i] == EMPTY) {
+        continue;
+      }
+
+      uint64_t hash;
+
+      if constexpr (StoreHash) {
+        hash = old_hashes[i];
+      } else {
+        (void)old_hashes;
+        hash = hasher_(old_entries[i].key);
+      }
+
+      size_t index = index_for_hash(hash);
+
+      while (ctrl_[index] != EMPTY) {
+        index = (index + 1) & (capacity_ - 1);
+      }
+
+      new (&entries_[index]) E(std::move(old_entries[i]));
+      set_hash(index, hash);
+      ctrl_[index] = old_ctrl[i];
+      old_entries[i].~E();
+    }
+
+    alloc_.deallocate(old_entries, table_bytes(old_capacity));
+  }
+
+  [[nodiscard]] size_t index_for_hash(uint64_t hash) const {
+    return hash & (capacity_ - 1);
+  }
+
+  [[nodiscard]] static uint8_t tag_for_hash(uint64_t hash) {
+    return FULL | (hash >> 57);
+  }
+};
+
+} // namespace atlas
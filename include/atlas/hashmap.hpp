@@ -1,147 +1,93 @@
 #pragma once
 #include "alloc.hpp"
+#include "cons.hpp"
 #include "hash.hpp"
+#include "hash_table.hpp"
 #include "result.hpp"
+#include "slice.hpp"
 
 namespace atlas {
 
 /// An open addressing hash map
+/// With `StoreHash`, the hash of every key is kept next to it, see HashTable.
 template <typename K, typename V, Allocator A = DefaultAllocator,
-          typename H = Hash<K>>
+          typename H = Hash<K>, bool StoreHash = false>
 class HashMap {
 
 public:
-  HashMap(A alloc = A(), H hasher = H()) : alloc_(alloc), hasher_(hasher) {
-    size_ = 0;
-    capacity_ = 8;
-    buckets_ = reinterpret_cast<Option<Bucket> *>(
-        alloc_.allocate(capacity_ * sizeof(Option<Bucket>)));
-    for (size_t i = 0; i < capacity_; i++) {
-      buckets_[i] = NONE;
-    }
-  }
+  HashMap(A alloc = A(), H hasher = H()) : table_(8, alloc, hasher) {}
 
   HashMap(size_t capacity, A alloc = A(), H hasher = H())
-      : size_(0), capacity_(capacity), alloc_(alloc), hasher_(hasher) {
-    buckets_ = reinterpret_cast<Option<Bucket> *>(
-        alloc_.allocate(capacity_ * sizeof(Option<Bucket>)));
-    for (size_t i = 0; i < capacity; i++) {
-      buckets_[i] = NONE;
-    }
-  }
-
-  ~HashMap() {
-    for (size_t i = 0; i < capacity_; i++) {
-      buckets_[i].~Option();
-    }
-    alloc_.deallocate(buckets_, capacity_ * sizeof(Option<Bucket>));
-  }
+      : table_(capacity, alloc, hasher) {}
 
-  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] size_t size() const { return table_.size(); }
 
-  [[nodiscard]] bool empty() const { return size_ == 0; }
+  [[nodiscard]] bool empty() const { return table_.empty(); }
 
   Result<> insert(K key, V value) {
-    // We need to resize the map, so rehash all the elements
-    if (size_ == capacity_) {
-      capacity_ *= 2;
-      auto new_buckets = reinterpret_cast<Option<Bucket> *>(
-          alloc_.allocate(capacity_ * sizeof(Option<Bucket>)));
-
-      for (size_t i = 0; i < capacity_; i++) {
-        new_buckets[i] = NONE;
-      }
-
-      for (size_t i = 0; i < size_; i++) {
-        if (buckets_[i].is_some()) {
-          size_t index = index_for_hash(hasher_(buckets_[i]->key));
-
-          while (new_buckets[index].is_some()) {
-            index = (index + 1) % capacity_;
-          }
-
-          new_buckets[index] = buckets_[i];
-        }
-
-        buckets_[i].~Option();
-      }
-
-      alloc_.deallocate(buckets_, size_);
-
-      buckets_ = new_buckets;
-    }
-
-    // Do linear probing: find the next empty slot
-    size_t index = index_for_hash(hasher_(key));
-
-    if (buckets_[index].is_some() && buckets_[index]->key == key) {
-      return Err(Error::Duplicate);
-    }
-
-    while (buckets_[index].is_some()) {
-      if (buckets_[index]->key == key) {
-        return Err(Error::Duplicate);
-      }
-
-      index = (index + 1) % capacity_;
-    }
+    return table_.insert(Bucket{key, value});
+  }
 
-    buckets_[index] = Bucket{key, value};
-    size_++;
+  /// Insert `values[i]` under `keys[i]` for every key, see
+  /// HashTable::insert_many
+  Result<> insert_many(Slice<const K> keys, Slice<const V> values) {
+    ENSURE(values.size() >= keys.size(), "value slice is too small");
 
-    return Ok(NONE);
+    return table_.insert_many(
+        keys, [&](size_t i) { return Bucket{keys[i], values[i]}; });
   }
 
   [[nodiscard]] Option<V> get(K key) const {
-    size_t index = index_for_hash(hasher_(key));
-    size_t mark = index;
-
-    while (buckets_[index].is_some() && buckets_[index].unwrap().key != key) {
-      index = (index + 1) % capacity_;
-
-      // We've looped around and haven't found the key, so return NONE
-      if (index == mark) {
-        return NONE;
-      }
-    }
+    auto bucket = table_.find(key);
 
-    if (buckets_[index].is_none()) {
+    if (bucket == nullptr) {
       return NONE;
     }
 
-    return buckets_[index].unwrap().value;
+    return bucket->value;
   }
 
-  Result<> remove(K key) {
-    size_t index = index_for_hash(hasher_(key));
-    size_t mark = index;
+  /// Look up every key of `keys`, storing the value of `keys[i]` in `out[i]`
+  /// This is faster than calling get() in a loop on big tables, as the cache
+  /// misses of several lookups are overlapped.
+  void get_many(Slice<const K> keys, Slice<Option<V>> out) const {
+    ENSURE(out.size() >= keys.size(), "output slice is too small");
+
+    table_.find_many(keys, [&](size_t i, Bucket *bucket) {
+      if (bucket == nullptr) {
+        out[i] = NONE;
+      } else {
+        out[i] = Option<V>(V(bucket->value));
+      }
+    });
+  }
 
-    while (buckets_[index].is_some() && buckets_[index].unwrap().key != key) {
-      index = (index + 1) % capacity_;
+  Result<> remove(K key) { return table_.remove(key); }
 
-      if (index == mark) {
-        return Err(Error::NotFound);
-      }
-    }
+  void reserve(size_t count) { table_.reserve(count); }
 
-    if (buckets_[index].is_none()) {
-      return Err(Error::NotFound);
-    }
+  void clear() { table_.clear(); }
 
-    buckets_[index] = NONE;
-    size_--;
+  [[nodiscard]] V operator[](K key) const { return get(key).unwrap(); }
 
-    return Ok(NONE);
-  }
+  /// NOTE: The iteration order is unspecified
+  [[nodiscard]] auto iter() const {
+    auto iterator_modifier = [](auto iter) {
+      auto next_func = [iter]() mutable -> Option<Cons<K, V>> {
+        auto ret = iter.next();
+        if (!ret) {
+          return NONE;
+        }
 
-  void clear() {
-    for (size_t i = 0; i < capacity_; i++) {
-      buckets_[i] = NONE;
-    }
-    size_ = 0;
-  }
+        auto bucket = ret.unwrap();
+        return cons(bucket->key, bucket->value);
+      };
 
-  [[nodiscard]] V operator[](K key) const { return get(key).unwrap(); }
+      return Iterator<decltype(next_func)>(next_func);
+    };
+
+    return (table_.iter() | iterator_modifier);
+  }
 
 private:
   struct Bucket {
@@ -149,16 +95,7 @@ private:
     V value;
   };
 
-  size_t size_;
-  size_t capacity_;
-  A alloc_;
-  H hasher_;
-
-  Option<Bucket> *buckets_;
-
-  [[nodiscard]] size_t index_for_hash(uint64_t hash) const {
-    return hash % capacity_;
-  }
+  HashTable<K, Bucket, A, H, StoreHash> table_;
 };
 
 } // namespace atlas
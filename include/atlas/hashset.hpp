@@ -0,0 +1,116 @@
+#pragma once
+#include "alloc.hpp"
+#include "hash.hpp"
+#include "hash_table.hpp"
+#include "result.hpp"
+#include "slice.hpp"
+
+namespace atlas {
+
+/// An open addressing hash set
+/// This shares its engine with HashMap, but has no value slot, so a set of
+/// 8-byte keys costs 9 bytes per slot.
+/// With `StoreHash`, the hash of every key is kept next to it, see HashTable.
+template <typename K, Allocator A = DefaultAllocator, typename H = Hash<K>,
+          bool StoreHash = false>
+class HashSet {
+
+public:
+  HashSet(A alloc = A(), H hasher = H()) : table_(8, alloc, hasher) {}
+
+  HashSet(size_t capacity, A alloc = A(), H hasher = H())
+      : table_(capacity, alloc, hasher) {}
+
+  [[nodiscard]] size_t size() const { return table_.size(); }
+
+  [[nodiscard]] bool empty() const { return table_.empty(); }
+
+  Result<> insert(K key) { return table_.insert(Bucket{key}); }
+
+  /// Insert every key of `keys`, see HashTable::insert_many
+  Result<> insert_many(Slice<const K> keys) {
+    return table_.insert_many(keys, [&](size_t i) { return Bucket{keys[i]}; });
+  }
+
+  [[nodiscard]] bool contains(K key) const {
+    return table_.find(key) != nullptr;
+  }
+
+  Result<> remove(K key) { return table_.remove(key); }
+
+  void reserve(size_t count) { table_.reserve(count); }
+
+  void clear() { table_.clear(); }
+
+  /// NOTE: The iteration order is unspecified
+  [[nodiscard]] auto iter() const {
+    auto iterator_modifier = [](auto iter) {
+      auto next_func = [iter]() mutable -> Option<K> {
+        auto ret = iter.next();
+        if (!ret) {
+          return NONE;
+        }
+
+        return ret.unwrap()->key;
+      };
+
+      return Iterator<decltype(next_func)>(next_func);
+    };
+
+    return (table_.iter() | iterator_modifier);
+  }
+
+  /// Returns a set with the keys present in either set
+  [[nodiscard]] HashSet set_union(const HashSet &other) const {
+    HashSet ret(size() + other.size(), table_.allocator(), table_.hasher());
+
+    for (auto key : iter()) {
+      (void)ret.insert(key);
+    }
+
+    for (auto key : other.iter()) {
+      (void)ret.insert(key);
+    }
+
+    return ret;
+  }
+
+  /// Returns a set with the keys present in both sets
+  [[nodiscard]] HashSet set_intersection(const HashSet &other) const {
+    // Walk the smaller set and probe the bigger one
+    auto &small = size() <= other.size() ? *this : other;
+    auto &big = size() <= other.size() ? other : *this;
+
+    HashSet ret(small.size(), table_.allocator(), table_.hasher());
+
+    for (auto key : small.iter()) {
+      if (big.contains(key)) {
+        (void)ret.insert(key);
+      }
+    }
+
+    return ret;
+  }
+
+  /// Returns a set with the keys of this set that aren't in `other`
+  [[nodiscard]] HashSet set_difference(const HashSet &other) const {
+    HashSet ret(size(), table_.allocator(), table_.hasher());
+
+    for (auto key : iter()) {
+      if (!other.contains(key)) {
+        (void)ret.insert(key);
+      }
+    }
+
+    return ret;
+  }
+
+private:
+  struct Bucket {
+    K key;
+  };
+
+  HashTable<K, Bucket, A, H, StoreHash> table_;
+};
+
+} // namespace atlas
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <source_location>
 
 namespace atlas::impl {
@@ -6,4 +7,8 @@ namespace atlas::impl {
 [[noreturn]] void panic(const char *message,
                         const std::source_location location);
 
+// Returns random bits from a source an attacker can't predict, this is only
+// needed when using keyed hashing (SipHash)
+uint64_t random_seed();
+
 }
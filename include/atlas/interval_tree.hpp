@@ -0,0 +1,140 @@
+#pragma once
+#include "rbtree.hpp"
+
+namespace atlas {
+
+/// An intrusive tree of half-open intervals [start, end), ordered by start
+/// Every element stores in `MaxEnd` the greatest end of its subtree, which
+/// lets overlap queries skip the subtrees that end before the queried
+/// interval: finding an overlap takes O(log n), and listing the k overlaps
+/// O(k log n).
+template <typename T, auto N, typename U, U T::*Start, U T::*End,
+          U T::*MaxEnd>
+  requires(Sortable<U>)
+class IntervalTree {
+
+public:
+  [[nodiscard]] bool empty() const { return tree_.empty(); }
+
+  [[nodiscard]] T *root() const { return tree_.root(); }
+
+  void insert(T *node) { tree_.insert(node); }
+
+  void remove(T *node) { tree_.remove(node); }
+
+  /// The first element, by start, that overlaps [`start`, `end`)
+  [[nodiscard]] Option<T *> first_overlap(U start, U end) const {
+    auto ret = subtree_overlap(tree_.root(), start, end);
+
+    if (ret == nullptr) {
+      return NONE;
+    }
+
+    return ret;
+  }
+
+  /// Return an iterator over the elements that overlap [`start`, `end`),
+  /// ordered by start
+  [[nodiscard]] auto overlapping(U start, U end) const {
+    auto next_func = [this, current = subtree_overlap(tree_.root(), start, end),
+                      start, end]() mutable -> Option<T *> {
+      if (current == nullptr) {
+        return NONE;
+      }
+
+      auto ret = current;
+      current = next_overlap(current, start, end);
+      return ret;
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+  /// Return an iterator over all the elements, ordered by start
+  [[nodiscard]] auto iter() const { return tree_.iter(); }
+
+private:
+  struct Augment {
+    static void update(T *node, T *left, T *right) {
+      auto max = node->*End;
+
+      if (left != nullptr && max < left->*MaxEnd) {
+        max = left->*MaxEnd;
+      }
+
+      if (right != nullptr && max < right->*MaxEnd) {
+        max = right->*MaxEnd;
+      }
+
+      node->*MaxEnd = max;
+    }
+  };
+
+  RBTree<T, N, U, Start, Augment> tree_;
+
+  // The leftmost element of the subtree of `node` that overlaps [start, end)
+  // The leftmost element that ends after `start` is the only candidate: the
+  // ones before it end too early, and the ones after it start even later.
+  static T *subtree_overlap(T *node, const U &start, const U &end) {
+    while (node != nullptr) {
+      auto left = (node->*N).left;
+
+      if (left != nullptr && start < left->*MaxEnd) {
+        node = left;
+        continue;
+      }
+
+      if (!(node->*Start < end)) {
+        return nullptr;
+      }
+
+      if (start < node->*End) {
+        return node;
+      }
+
+      auto right = (node->*N).right;
+
+      if (right == nullptr || !(start < right->*MaxEnd)) {
+        return nullptr;
+      }
+
+      node = right;
+    }
+
+    return nullptr;
+  }
+
+  // The element that follows `node` in order and overlaps [start, end)
+  static T *next_overlap(T *node, const U &start, const U &end) {
+    while (true) {
+      auto right = (node->*N).right;
+
+      if (right != nullptr && start < right->*MaxEnd) {
+        return subtree_overlap(right, start, end);
+      }
+
+      // Go up until coming from a left child, everything on the way has
+      // already been visited
+      T *prev;
+
+      do {
+        prev = node;
+        node = (node->*N).get_parent();
+
+        if (node == nullptr) {
+          return nullptr;
+        }
+      } while ((node->*N).right == prev);
+
+      if (!(node->*Start < end)) {
+        return nullptr;
+      }
+
+      if (start < node->*End) {
+        return node;
+      }
+    }
+  }
+};
+
+} // namespace atlas
@@ -41,10 +41,12 @@ public:
     constexpr const T &operator*() { return *current_; }
     constexpr void operator++() { current_ = next_(); }
 
+    // Only whether the iterators are exhausted is compared, items don't have
+    // to be comparable
     constexpr bool operator!=(const Iter_ &other) {
-      return current_ != other.current_;
+      return current_.is_some() != other.current_.is_some();
     }
-    constexpr bool operator!=(None) { return current_ != NONE; }
+    constexpr bool operator!=(None) { return current_.is_some(); }
   };
 
   Iter_<T> begin() { return Iter_<T>{next_(), next_}; }
@@ -6,6 +6,7 @@
 #include "string.hpp"
 #include "string_view.hpp"
 #include "traits.hpp"
+#include "vec.hpp"
 
 namespace atlas {
 
@@ -68,6 +69,41 @@ template <typename K, typename V, Allocator A = DefaultAllocator> class Map {
 public:
   Map(A alloc = A()) : tree_(), alloc_(alloc) {}
 
+  Map(Map &&other)
+      : size_(other.size_), tree_(std::move(other.tree_)),
+        alloc_(std::move(other.alloc_)) {
+    other.size_ = 0;
+  }
+
+  /// Build a map out of the `Cons<K, V>` entries yielded by `entries`, which
+  /// must be sorted by key without duplicates, in O(n). Otherwise nothing is
+  /// built and InvalidParameters is returned.
+  template <typename I>
+  [[nodiscard]] static Result<Map> from_sorted(I entries, A alloc = A()) {
+    Map ret(alloc);
+    Vec<MapNode *, A> nodes(alloc);
+
+    entries.for_each([&](const Cons<K, V> &entry) {
+      nodes.push(ret.new_node(entry.car, entry.cdr));
+    });
+
+    auto built =
+        ret.tree_.from_sorted(Slice<MapNode *>(nodes.data(), nodes.size()));
+
+    if (!built) {
+      for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i]->~MapNode();
+        ret.alloc_.deallocate(nodes[i], sizeof(MapNode));
+      }
+
+      return Err(built.error());
+    }
+
+    ret.size_ = nodes.size();
+
+    return Ok(std::move(ret));
+  }
+
   [[nodiscard]] size_t size() const { return size_; }
 
   [[nodiscard]] bool empty() const { return size_ == 0; }
@@ -77,12 +113,7 @@ public:
       return Err(Error::Duplicate);
     }
 
-    auto node = reinterpret_cast<MapNode *>(alloc_.allocate(sizeof(MapNode)));
-
-    new (&node->key) MapKey<K>{key};
-    node->value = value;
-
-    tree_.insert(node);
+    tree_.insert(new_node(key, std::move(value)));
 
     size_++;
 
@@ -108,6 +139,7 @@ public:
 
     tree_.remove(node);
 
+    node->~MapNode();
     alloc_.deallocate(node, sizeof(MapNode));
 
     size_--;
@@ -116,11 +148,10 @@ public:
   }
 
   void clear() {
-    for (auto node : tree_.iter()) {
-      tree_.remove(node);
+    tree_.clear([this](MapNode *node) {
       node->~MapNode();
       alloc_.deallocate(node, sizeof(MapNode));
-    }
+    });
 
     size_ = 0;
   }
@@ -129,32 +160,181 @@ public:
 
   [[nodiscard]] V operator[](K key) const { return get(key).unwrap(); }
 
-  auto iter() {
-    auto iterator_modifier = [](auto iter) {
-      auto next_func = [iter]() mutable -> Option<Cons<K, V>> {
-        auto ret = iter.next();
-        if (!ret) {
-          return NONE;
-        }
+  /// The first entry whose key is not less than `key`
+  [[nodiscard]] Option<Cons<K, V>> lower_bound(K key) const {
+    return entry(tree_.lower_bound(MapKey<K>{key}));
+  }
 
-        auto node = ret.unwrap();
-        return cons(node->key.val, node->value);
-      };
+  /// The first entry whose key is greater than `key`
+  [[nodiscard]] Option<Cons<K, V>> upper_bound(K key) const {
+    return entry(tree_.upper_bound(MapKey<K>{key}));
+  }
+
+  /// The last entry whose key is not greater than `key`
+  [[nodiscard]] Option<Cons<K, V>> floor(K key) const {
+    return entry(tree_.floor(MapKey<K>{key}));
+  }
+
+  /// The first entry whose key is not less than `key`
+  [[nodiscard]] Option<Cons<K, V>> ceil(K key) const {
+    return entry(tree_.ceil(MapKey<K>{key}));
+  }
+
+  /// Returns an iterator over the entries with keys in [`start`, `end`), in
+  /// key order. Entries are references into the map, like with iter().
+  [[nodiscard]] auto range(K start, K end) const {
+    auto nodes = tree_.range(MapKey<K>{start}, MapKey<K>{end});
+
+    auto next_func = [nodes]() mutable -> Option<Cons<const K &, const V &>> {
+      auto node = nodes.next();
+
+      if (!node) {
+        return NONE;
+      }
 
-      return Iterator<decltype(next_func)>(next_func);
+      return ref<const V>(node.unwrap());
     };
 
-    return (tree_.iter() | iterator_modifier);
+    return Iterator<decltype(next_func)>(next_func);
+  }
+
+  /// The entries of both maps, with the value of this one for the keys they
+  /// share. Like the other set operations, this merges the two maps in order
+  /// and takes O(n + m).
+  [[nodiscard]] Map union_with(const Map &other) const {
+    return merge_with(other, [](const V &value, const V &) { return value; });
+  }
+
+  /// The entries of this map whose key is also in `other`
+  [[nodiscard]] Map intersection(const Map &other) const {
+    return join(other, [](MapNode *a, MapNode *b) -> Option<V> {
+      if (a == nullptr || b == nullptr) {
+        return NONE;
+      }
+
+      return a->value;
+    });
+  }
+
+  /// The entries of this map whose key isn't in `other`
+  [[nodiscard]] Map difference(const Map &other) const {
+    return join(other, [](MapNode *a, MapNode *b) -> Option<V> {
+      if (a == nullptr || b != nullptr) {
+        return NONE;
+      }
+
+      return a->value;
+    });
   }
 
+  /// The entries of both maps, a key held by both gets the value
+  /// `f(value, other_value)`
+  template <typename F>
+  [[nodiscard]] Map merge_with(const Map &other, F f) const {
+    return join(other, [&f](MapNode *a, MapNode *b) -> Option<V> {
+      if (a == nullptr) {
+        return b->value;
+      }
+
+      if (b == nullptr) {
+        return a->value;
+      }
+
+      return f(a->value, b->value);
+    });
+  }
+
+  /// Returns an iterator over the entries in key order, rev() goes from the
+  /// last one back. Entries are `Cons<const K &, const V &>` referring to the
+  /// map, nothing is copied unless the caller converts them to a
+  /// `Cons<K, V>`.
+  [[nodiscard]] auto iter() const { return entries<const V>(); }
+
+  /// Same as iter(), but values can be modified through the entries
+  [[nodiscard]] auto iter_mut() { return entries<V>(); }
+
 private:
   struct MapNode {
     MapKey<K> key;
     V value;
-    RBTreeNode<MapNode> hook;
+    PackedRBTreeNode<MapNode> hook;
   };
 
-  size_t size_;
+  MapNode *new_node(K key, V value) {
+    auto node = reinterpret_cast<MapNode *>(alloc_.allocate(sizeof(MapNode)));
+
+    new (&node->key) MapKey<K>{key};
+    new (&node->value) V(std::move(value));
+
+    return node;
+  }
+
+  // Build a map out of the keys of this map and `other` in a single ordered
+  // pass. `f(a, b)` gets the nodes that hold a key, nullptr for a missing
+  // one, and returns the value to keep for it, if any.
+  template <typename F> [[nodiscard]] Map join(const Map &other, F f) const {
+    Map ret(alloc_);
+    Vec<MapNode *, A> nodes(alloc_);
+
+    tree_.merge_join(other.tree_, [&](MapNode *a, MapNode *b) {
+      auto value = f(a, b);
+
+      if (value.is_some()) {
+        auto node = a != nullptr ? a : b;
+        nodes.push(ret.new_node(node->key.val, value.unwrap()));
+      }
+    });
+
+    ret.tree_.from_sorted(Slice<MapNode *>(nodes.data(), nodes.size()))
+        .unwrap("merge_join yields sorted keys");
+    ret.size_ = nodes.size();
+
+    return ret;
+  }
+
+  template <typename W>
+  [[nodiscard]] static Cons<const K &, W &> ref(MapNode *node) {
+    return Cons<const K &, W &>(node->key.val, node->value);
+  }
+
+  template <typename W> [[nodiscard]] auto entries() const {
+    using Entry = Cons<const K &, W &>;
+
+    auto next_func = [this, current = tree_.first().unwrap_or(nullptr)]()
+        mutable -> Option<Entry> {
+      if (current == nullptr) {
+        return NONE;
+      }
+
+      auto node = current;
+      current = tree_.successor(current);
+      return ref<W>(node);
+    };
+
+    auto prev_func = [this, current = tree_.last().unwrap_or(nullptr)]()
+        mutable -> Option<Entry> {
+      if (current == nullptr) {
+        return NONE;
+      }
+
+      auto node = current;
+      current = tree_.predecessor(current);
+      return ref<W>(node);
+    };
+
+    return Iterator<decltype(next_func), decltype(prev_func)>(next_func,
+                                                              prev_func);
+  }
+
+  [[nodiscard]] static Option<Cons<K, V>> entry(Option<MapNode *> node) {
+    if (!node) {
+      return NONE;
+    }
+
+    return cons(node.unwrap()->key.val, node.unwrap()->value);
+  }
+
+  size_t size_ = 0;
   RBTree<MapNode, &MapNode::hook, MapKey<K>, &MapNode::key> tree_;
   A alloc_;
 };
@@ -0,0 +1,82 @@
+#pragma once
+#include "rbtree.hpp"
+
+namespace atlas {
+
+/// An intrusive red-black tree that also answers positional queries
+/// Every element stores in `Size` the number of elements of its subtree, so
+/// the k-th element and the position of an element are found in O(log n).
+template <typename T, auto N, typename U, U T::*Key, size_t T::*Size>
+  requires(Sortable<U>)
+class OrderStatisticTree {
+
+public:
+  [[nodiscard]] bool empty() const { return tree_.empty(); }
+
+  [[nodiscard]] size_t size() const { return size_of(tree_.root()); }
+
+  [[nodiscard]] T *root() const { return tree_.root(); }
+
+  void insert(T *node) { tree_.insert(node); }
+
+  void remove(T *node) { tree_.remove(node); }
+
+  template <typename K> [[nodiscard]] Option<T *> find(K key) const {
+    return tree_.find(key);
+  }
+
+  /// The element at position `k` in order, starting from 0
+  [[nodiscard]] Option<T *> select(size_t k) const {
+    auto node = tree_.root();
+
+    while (node != nullptr) {
+      auto left = size_of((node->*N).left);
+
+      if (k < left) {
+        node = (node->*N).left;
+      } else if (k == left) {
+        return node;
+      } else {
+        k -= left + 1;
+        node = (node->*N).right;
+      }
+    }
+
+    return NONE;
+  }
+
+  /// The position of `node` in order, which is the number of elements that
+  /// come before it
+  [[nodiscard]] size_t rank(T *node) const {
+    auto ret = size_of((node->*N).left);
+
+    for (auto parent = (node->*N).get_parent(); parent != nullptr;
+         parent = (parent->*N).get_parent()) {
+      if ((parent->*N).right == node) {
+        ret += size_of((parent->*N).left) + 1;
+      }
+
+      node = parent;
+    }
+
+    return ret;
+  }
+
+  /// Return an iterator over the tree's contents, in order
+  [[nodiscard]] auto iter() const { return tree_.iter(); }
+
+private:
+  struct Augment {
+    static void update(T *node, T *left, T *right) {
+      node->*Size = size_of(left) + size_of(right) + 1;
+    }
+  };
+
+  RBTree<T, N, U, Key, Augment> tree_;
+
+  static size_t size_of(T *node) {
+    return node == nullptr ? 0 : node->*Size;
+  }
+};
+
+} // namespace atlas
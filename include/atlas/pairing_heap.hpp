@@ -18,12 +18,44 @@ public:
   PairingHeap() : root_(nullptr) {}
 
   void insert(T *elem) {
+    h(elem)->child = nullptr;
+    h(elem)->next = nullptr;
+    h(elem)->previous = nullptr;
+
     size_++;
     root_ = meld(root_, elem);
   }
 
   [[nodiscard]] T *top() const { return root_; }
 
+  /// Restore the order after the key of `elem` moved towards the top
+  /// Its subtree is cut from its parent and melded with the root in O(1), the
+  /// restructuring is left to the next pop().
+  void decrease_key(T *elem) {
+    if (elem == root_) {
+      return;
+    }
+
+    cut(elem);
+    root_ = meld(root_, elem);
+  }
+
+  /// Remove `elem`, which can be anywhere in the heap
+  void remove(T *elem) {
+    if (elem == root_) {
+      (void)pop();
+      return;
+    }
+
+    cut(elem);
+
+    auto children = merge_pairs(h(elem)->child);
+    h(elem)->child = nullptr;
+
+    root_ = meld(root_, children);
+    size_--;
+  }
+
   Option<T *> pop() {
     if (root_ == nullptr) {
       return NONE;
@@ -47,6 +79,8 @@ public:
 
   [[nodiscard]] size_t size() const { return size_; }
 
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
 private:
   T *root_;
   size_t size_ = 0;
@@ -59,16 +93,12 @@ private:
     }
 
     if (Compare(heap1, heap2)) {
-      h(heap2)->next = h(heap1)->child;
-      h(heap1)->child = heap2;
-      h(heap2)->previous = heap1;
+      add_child(heap1, heap2);
       return heap1;
     }
 
     else {
-      h(heap1)->next = h(heap2)->child;
-      h(heap2)->child = heap1;
-      h(heap1)->previous = heap2;
+      add_child(heap2, heap1);
       return heap2;
     }
 
@@ -76,21 +106,74 @@ private:
     return nullptr;
   }
 
+  // Make `child` the leftmost child of `parent`
+  void add_child(T *parent, T *child) {
+    auto first = h(parent)->child;
+
+    h(child)->next = first;
+    h(child)->previous = parent;
+
+    if (first != nullptr) {
+      h(first)->previous = child;
+    }
+
+    h(parent)->child = child;
+  }
+
+  // Detach the subtree of `elem` from its parent and siblings
+  void cut(T *elem) {
+    auto node = h(elem);
+    auto previous = node->previous;
+
+    if (h(previous)->child == elem) {
+      h(previous)->child = node->next;
+    } else {
+      h(previous)->next = node->next;
+    }
+
+    if (node->next != nullptr) {
+      h(node->next)->previous = previous;
+    }
+
+    node->next = nullptr;
+    node->previous = nullptr;
+  }
+
   PairingHeapNode<T> *h(T *heap) const { return &(heap->*N); }
 
+  // Two-pass pairing of the sibling list starting at `node`: meld the
+  // siblings in pairs from left to right, then meld the pairs into one heap
+  // from right to left. The pairs are chained in reverse through `next`, so
+  // the second pass walks them back without recursing.
   T *merge_pairs(T *node) {
-    if (!node || h(node)->next == nullptr) {
-      return node;
+    T *pairs = nullptr;
+
+    while (node != nullptr) {
+      T *first = node;
+      T *second = h(first)->next;
+      node = second == nullptr ? nullptr : h(second)->next;
+
+      h(first)->next = nullptr;
+      if (second != nullptr) {
+        h(second)->next = nullptr;
+      }
+
+      auto pair = meld(first, second);
+      h(pair)->next = pairs;
+      pairs = pair;
     }
 
-    T *first = node;
-    T *second = h(node)->next;
-    T *rest = h(second)->next;
+    T *ret = nullptr;
 
-    h(first)->next = nullptr;
-    h(second)->next = nullptr;
+    while (pairs != nullptr) {
+      auto pair = pairs;
+      pairs = h(pair)->next;
+      h(pair)->next = nullptr;
+
+      ret = meld(pair, ret);
+    }
 
-    return meld(meld(first, second), merge_pairs(rest));
+    return ret;
   }
 };
 
@@ -0,0 +1,646 @@
+#pragma once
+#include "alloc.hpp"
+#include "hamt.hpp"
+#include "hash.hpp"
+#include "option.hpp"
+#include "result.hpp"
+#include <atomic>
+#include <bit>
+#include <new>
+#include <utility>
+
+namespace atlas {
+
+/// An immutable Hash Array Mapped Trie
+/// insert() and remove() leave the trie untouched and return a new version of
+/// it: only the tables on the path to the key are copied, every other table
+/// is shared between the versions. Tables are reference counted, so a version
+/// stays valid for as long as it's alive, copying one (taking a snapshot) is
+/// O(1), and an update allocates one table per level.
+/// Versions can be shared between threads, as long as each thread works on
+/// its own copy.
+/// A batch of updates is cheaper through a Transient, which edits the tables
+/// it owns in place instead of copying the path to every key.
+template <typename K, typename V, Allocator A = DefaultAllocator,
+          typename H = Hash<K>>
+class PersistentHamt {
+
+public:
+  PersistentHamt(A alloc = A(), H hash = H()) : alloc_(alloc), hash_(hash) {}
+
+  PersistentHamt(const PersistentHamt &other)
+      : root_(other.root_), alloc_(other.alloc_), hash_(other.hash_),
+        size_(other.size_) {
+    retain(root_.table);
+  }
+
+  PersistentHamt(PersistentHamt &&other)
+      : root_(other.root_), alloc_(std::move(other.alloc_)),
+        hash_(std::move(other.hash_)), size_(other.size_) {
+    other.root_ = {};
+    other.size_ = 0;
+  }
+
+  PersistentHamt &operator=(const PersistentHamt &other) {
+    if (this != &other) {
+      retain(other.root_.table);
+      release(root_);
+      root_ = other.root_;
+      alloc_ = other.alloc_;
+      hash_ = other.hash_;
+      size_ = other.size_;
+    }
+
+    return *this;
+  }
+
+  PersistentHamt &operator=(PersistentHamt &&other) {
+    if (this != &other) {
+      release(root_);
+      root_ = other.root_;
+      alloc_ = std::move(other.alloc_);
+      hash_ = std::move(other.hash_);
+      size_ = other.size_;
+      other.root_ = {};
+      other.size_ = 0;
+    }
+
+    return *this;
+  }
+
+  ~PersistentHamt() { release(root_); }
+
+  [[nodiscard]] size_t size() const { return size_; }
+
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  [[nodiscard]] Option<V> get(const K &key) const {
+    HashState state(hash_(key), &key, hash_);
+    auto branch = &root_;
+
+    while (true) {
+      uint32_t bit = 1 << state.get_index();
+
+      if (!(branch->bitmap & bit)) {
+        return NONE;
+      }
+
+      auto &slot = branch->table->slots()[get_index(branch->bitmap, bit)];
+
+      if (branch->leafmap & bit) {
+        if (!key_equal(slot.leaf.key, key)) {
+          return NONE;
+        }
+
+        return Option<V>(V(slot.leaf.value));
+      }
+
+      branch = &slot.branch;
+      state.next();
+    }
+  }
+
+  [[nodiscard]] bool contains(const K &key) const {
+    return get(key).is_some();
+  }
+
+  /// Returns a version with `key` set to `value`
+  [[nodiscard]] PersistentHamt insert(K key, V value) const {
+    PersistentHamt ret(alloc_, hash_);
+    bool added = false;
+
+    Leaf leaf{std::move(key), std::move(value)};
+    HashState state(hash_(leaf.key), &leaf.key, hash_);
+    ret.root_ = ret.insert_into(root_, state, leaf, added);
+    ret.size_ = size_ + added;
+
+    return ret;
+  }
+
+  /// Returns a version without `key`, or this one if it isn't present
+  [[nodiscard]] PersistentHamt remove(const K &key) const {
+    PersistentHamt ret(alloc_, hash_);
+    HashState state(hash_(key), &key, hash_);
+
+    if (!ret.remove_from(root_, state, key, ret.root_)) {
+      return *this;
+    }
+
+    ret.size_ = size_ - 1;
+    return ret;
+  }
+
+  /// An edit session on a version of the trie
+  /// The first update of a table copies it into one that belongs to the
+  /// session, with room to grow, and later updates change that table in place.
+  /// commit() shrinks the tables of the session to their size and hands them
+  /// over to a regular version. The version the session started from is left
+  /// untouched.
+  class Transient {
+
+  public:
+    Transient(Transient &&other) = default;
+    Transient(const Transient &other) = delete;
+    Transient &operator=(const Transient &other) = delete;
+
+    [[nodiscard]] size_t size() const { return map_.size_; }
+
+    [[nodiscard]] Option<V> get(const K &key) const { return map_.get(key); }
+
+    [[nodiscard]] bool contains(const K &key) const {
+      return map_.contains(key);
+    }
+
+    void insert(K key, V value) {
+      bool added = false;
+
+      Leaf leaf{std::move(key), std::move(value)};
+      HashState state(map_.hash_(leaf.key), &leaf.key, map_.hash_);
+      map_.insert_in_place(map_.root_, state, leaf, added);
+      map_.size_ += added;
+    }
+
+    Result<> remove(const K &key) {
+      if (!map_.contains(key)) {
+        return Err(Error::NotFound);
+      }
+
+      HashState state(map_.hash_(key), &key, map_.hash_);
+      map_.remove_in_place(map_.root_, state, key);
+      map_.size_--;
+
+      return Ok(NONE);
+    }
+
+    /// Ends the session, the transient is left empty
+    [[nodiscard]] PersistentHamt commit() {
+      map_.compact(map_.root_);
+      return std::move(map_);
+    }
+
+  private:
+    friend class PersistentHamt;
+
+    PersistentHamt map_;
+
+    Transient(const PersistentHamt &map) : map_(map) {}
+  };
+
+  /// Starts an edit session on this version
+  [[nodiscard]] Transient transient() const { return Transient(*this); }
+
+private:
+  using HashState = HamtHashState<K, H>;
+
+  struct Table;
+
+  struct Branch {
+    Table *table = nullptr;
+    uint32_t bitmap = 0;
+    uint32_t leafmap = 0;
+  };
+
+  struct Leaf {
+    K key;
+    V value;
+  };
+
+  // A slot is a leaf or a branch depending on the leafmap of its parent, and
+  // is constructed and destroyed by hand
+  union Slot {
+    Leaf leaf;
+    Branch branch;
+
+    Slot() {}
+    ~Slot() {}
+  };
+
+  // The slots of a table follow its header in the same allocation
+  struct alignas(Slot) Table {
+    std::atomic<uint32_t> refs;
+
+    // Slots that were allocated, only tables of a transient have more than
+    // they use
+    uint8_t capacity;
+
+    // Whether the table belongs to a transient, which may change it in place
+    bool transient;
+
+    Slot *slots() { return reinterpret_cast<Slot *>(this + 1); }
+  };
+
+  Branch root_;
+  A alloc_;
+  H hash_;
+  size_t size_ = 0;
+
+  [[nodiscard]] static size_t popcount(uint32_t x) {
+    return __builtin_popcount(x);
+  }
+
+  // The position of the child for `bit` in a table
+  [[nodiscard]] static size_t get_index(uint32_t bitmap, uint32_t bit) {
+    return popcount(bitmap & (bit - 1));
+  }
+
+  [[nodiscard]] static size_t table_bytes(size_t count) {
+    return sizeof(Table) + sizeof(Slot) * count;
+  }
+
+  Table *allocate_table(size_t count, bool transient = false) {
+    // A transient table gets room to grow, rounded up so that the table is
+    // reallocated a logarithmic number of times
+    size_t capacity = transient ? std::bit_ceil(count) : count;
+
+    auto table = new (alloc_.allocate(table_bytes(capacity))) Table;
+    table->refs.store(1, std::memory_order_relaxed);
+    table->capacity = capacity;
+    table->transient = transient;
+    return table;
+  }
+
+  void free_table(Table *table) {
+    auto bytes = table_bytes(table->capacity);
+    table->~Table();
+    alloc_.deallocate(table, bytes);
+  }
+
+  static void retain(Table *table) {
+    if (table != nullptr) {
+      table->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void release(const Branch &branch) {
+    auto table = branch.table;
+
+    if (table == nullptr ||
+        table->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+
+    size_t pos = 0;
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1, pos++) {
+      uint32_t bit = bits & -bits;
+      auto &slot = table->slots()[pos];
+
+      if (branch.leafmap & bit) {
+        slot.leaf.~Leaf();
+      } else {
+        release(slot.branch);
+      }
+    }
+
+    free_table(table);
+  }
+
+  // A copy of `branch` with the bitmaps of the result. The slot of `bit` is
+  // left uninitialized, and every other slot is copied, branches being
+  // shared instead.
+  Branch copy_except(const Branch &branch, uint32_t bitmap, uint32_t leafmap,
+                     uint32_t bit) {
+    Branch ret = {nullptr, bitmap, leafmap};
+
+    if (bitmap == 0) {
+      return ret;
+    }
+
+    ret.table = allocate_table(popcount(bitmap));
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1) {
+      uint32_t b = bits & -bits;
+
+      if (b == bit) {
+        continue;
+      }
+
+      auto &src = branch.table->slots()[get_index(branch.bitmap, b)];
+      auto &dst = ret.table->slots()[get_index(bitmap, b)];
+
+      if (branch.leafmap & b) {
+        new (&dst.leaf) Leaf(src.leaf);
+      } else {
+        new (&dst.branch) Branch(src.branch);
+        retain(src.branch.table);
+      }
+    }
+
+    return ret;
+  }
+
+  // A copy of `branch` with `leaf` at `bit`
+  Branch with_leaf(const Branch &branch, uint32_t bit, const Leaf &leaf) {
+    auto ret = copy_except(branch, branch.bitmap | bit, branch.leafmap | bit,
+                           bit);
+    new (&ret.table->slots()[get_index(ret.bitmap, bit)].leaf) Leaf(leaf);
+    return ret;
+  }
+
+  // A copy of `branch` with `child` at `bit`, the reference to `child` is
+  // handed over to the copy
+  Branch with_branch(const Branch &branch, uint32_t bit, const Branch &child) {
+    auto ret = copy_except(branch, branch.bitmap | bit, branch.leafmap & ~bit,
+                           bit);
+    new (&ret.table->slots()[get_index(ret.bitmap, bit)].branch) Branch(child);
+    return ret;
+  }
+
+  // A copy of `branch` without the slot of `bit`
+  Branch without(const Branch &branch, uint32_t bit) {
+    return copy_except(branch, branch.bitmap & ~bit, branch.leafmap & ~bit,
+                       bit);
+  }
+
+  // A branch holding two leaves whose hashes match up to the current level
+  Branch make_pair(const Leaf &prev, HashState prev_state, const Leaf &leaf,
+                   HashState state) {
+    uint32_t prev_bit = 1 << prev_state.get_index();
+    uint32_t bit = 1 << state.get_index();
+
+    if (prev_bit == bit) {
+      return with_branch(
+          {}, bit, make_pair(prev, prev_state.next(), leaf, state.next()));
+    }
+
+    Branch ret = {allocate_table(2), prev_bit | bit, prev_bit | bit};
+    new (&ret.table->slots()[get_index(ret.bitmap, prev_bit)].leaf) Leaf(prev);
+    new (&ret.table->slots()[get_index(ret.bitmap, bit)].leaf) Leaf(leaf);
+    return ret;
+  }
+
+  Branch insert_into(const Branch &branch, HashState state, const Leaf &leaf,
+                     bool &added) {
+    uint32_t bit = 1 << state.get_index();
+
+    if (!(branch.bitmap & bit)) {
+      added = true;
+      return with_leaf(branch, bit, leaf);
+    }
+
+    auto &child = branch.table->slots()[get_index(branch.bitmap, bit)];
+
+    if (!(branch.leafmap & bit)) {
+      return with_branch(branch, bit,
+                         insert_into(child.branch, state.next(), leaf, added));
+    }
+
+    if (key_equal(child.leaf.key, leaf.key)) {
+      return with_leaf(branch, bit, leaf);
+    }
+
+    // Another key lives here, push both of them one level down
+    added = true;
+
+    return with_branch(branch, bit, split_leaf(child.leaf, leaf, state));
+  }
+
+  // A branch holding `prev`, which sits where `state` points, and `leaf`
+  Branch split_leaf(const Leaf &prev, const Leaf &leaf, HashState state) {
+    // Bring the state of the existing leaf to the same level as ours
+    HashState prev_state(hash_(prev.key), &prev.key, hash_);
+    prev_state.shift = state.shift;
+
+    if (state.gen != 0) {
+      prev_state.gen = state.gen;
+      prev_state.hash = hash_(prev.key, state.gen);
+    }
+
+    return make_pair(prev, prev_state.next(), leaf, state.next());
+  }
+
+  bool remove_from(const Branch &branch, HashState state, const K &key,
+                   Branch &out) {
+    uint32_t bit = 1 << state.get_index();
+
+    if (!(branch.bitmap & bit)) {
+      return false;
+    }
+
+    auto &child = branch.table->slots()[get_index(branch.bitmap, bit)];
+
+    if (branch.leafmap & bit) {
+      if (!key_equal(child.leaf.key, key)) {
+        return false;
+      }
+
+      out = without(branch, bit);
+      return true;
+    }
+
+    Branch new_child;
+
+    if (!remove_from(child.branch, state.next(), key, new_child)) {
+      return false;
+    }
+
+    // Pull a lone leaf up into its parent, so that the trie stays as compact
+    // as if the key had never been inserted
+    if (popcount(new_child.bitmap) == 1 &&
+        new_child.bitmap == new_child.leafmap) {
+      out = with_leaf(branch, bit, new_child.table->slots()[0].leaf);
+      release(new_child);
+    } else if (new_child.bitmap == 0) {
+      out = without(branch, bit);
+    } else {
+      out = with_branch(branch, bit, new_child);
+    }
+
+    return true;
+  }
+
+  // Moves the entry of a slot, which is a leaf if `is_leaf` is set
+  static void move_slot(Slot &dst, Slot &src, bool is_leaf) {
+    if (is_leaf) {
+      new (&dst.leaf) Leaf(std::move(src.leaf));
+      src.leaf.~Leaf();
+    } else {
+      new (&dst.branch) Branch(src.branch);
+    }
+  }
+
+  // Make `branch` point to a table of the transient with room for `count`
+  // entries. A table that nothing else references is taken over as is.
+  void make_transient(Branch &branch, size_t count) {
+    auto table = branch.table;
+
+    if (table != nullptr && table->capacity >= count &&
+        (table->transient ||
+         table->refs.load(std::memory_order_acquire) == 1)) {
+      table->transient = true;
+      return;
+    }
+
+    auto copy = allocate_table(count, true);
+    bool owned =
+        table != nullptr && (table->transient ||
+                             table->refs.load(std::memory_order_acquire) == 1);
+    size_t pos = 0;
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1, pos++) {
+      bool is_leaf = branch.leafmap & bits & -bits;
+      auto &src = table->slots()[pos];
+      auto &dst = copy->slots()[pos];
+
+      if (owned) {
+        move_slot(dst, src, is_leaf);
+      } else if (is_leaf) {
+        new (&dst.leaf) Leaf(src.leaf);
+      } else {
+        new (&dst.branch) Branch(src.branch);
+        retain(src.branch.table);
+      }
+    }
+
+    if (owned) {
+      free_table(table);
+    } else {
+      release(branch);
+    }
+
+    branch.table = copy;
+  }
+
+  // Make room for an entry at `pos` of a transient table
+  static void open_slot(Branch &branch, size_t pos) {
+    auto slots = branch.table->slots();
+    size_t i = popcount(branch.bitmap);
+
+    for (uint32_t bits = branch.bitmap; i > pos; i--) {
+      uint32_t bit = 1u << (31 - __builtin_clz(bits));
+      bits &= ~bit;
+      move_slot(slots[i], slots[i - 1], branch.leafmap & bit);
+    }
+  }
+
+  // Close the gap that a removed entry left at `pos` of a transient table,
+  // the bitmaps no longer contain the entry
+  static void close_slot(Branch &branch, size_t pos) {
+    auto slots = branch.table->slots();
+    size_t i = 0;
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1, i++) {
+      if (i >= pos) {
+        move_slot(slots[i], slots[i + 1], branch.leafmap & bits & -bits);
+      }
+    }
+  }
+
+  void insert_in_place(Branch &branch, HashState state, Leaf &leaf,
+                       bool &added) {
+    uint32_t bit = 1 << state.get_index();
+    auto count = popcount(branch.bitmap);
+
+    if (!(branch.bitmap & bit)) {
+      make_transient(branch, count + 1);
+
+      auto pos = get_index(branch.bitmap, bit);
+      open_slot(branch, pos);
+      new (&branch.table->slots()[pos].leaf) Leaf(std::move(leaf));
+
+      branch.bitmap |= bit;
+      branch.leafmap |= bit;
+      added = true;
+      return;
+    }
+
+    make_transient(branch, count);
+    auto &child = branch.table->slots()[get_index(branch.bitmap, bit)];
+
+    if (!(branch.leafmap & bit)) {
+      insert_in_place(child.branch, state.next(), leaf, added);
+      return;
+    }
+
+    if (key_equal(child.leaf.key, leaf.key)) {
+      child.leaf.~Leaf();
+      new (&child.leaf) Leaf(std::move(leaf));
+      return;
+    }
+
+    added = true;
+
+    auto pair = split_leaf(child.leaf, leaf, state);
+    child.leaf.~Leaf();
+    new (&child.branch) Branch(pair);
+    branch.leafmap &= ~bit;
+  }
+
+  // Removes a key that is known to be in the trie
+  void remove_in_place(Branch &branch, HashState state, const K &key) {
+    uint32_t bit = 1 << state.get_index();
+    auto pos = get_index(branch.bitmap, bit);
+
+    make_transient(branch, popcount(branch.bitmap));
+    auto &child = branch.table->slots()[pos];
+
+    if (!(branch.leafmap & bit)) {
+      auto &sub = child.branch;
+      remove_in_place(sub, state.next(), key);
+
+      // Pull a lone leaf up, as remove_from() does
+      if (popcount(sub.bitmap) == 1 && sub.bitmap == sub.leafmap) {
+        Leaf leaf(std::move(sub.table->slots()[0].leaf));
+        release(sub);
+
+        new (&child.leaf) Leaf(std::move(leaf));
+        branch.leafmap |= bit;
+        return;
+      }
+
+      if (sub.bitmap != 0) {
+        return;
+      }
+
+      release(sub);
+    } else {
+      child.leaf.~Leaf();
+    }
+
+    branch.bitmap &= ~bit;
+    branch.leafmap &= ~bit;
+    close_slot(branch, pos);
+
+    if (branch.bitmap == 0) {
+      release(branch);
+      branch.table = nullptr;
+    }
+  }
+
+  // Shrink the tables of a transient to their size, and hand them over to
+  // regular versions
+  void compact(Branch &branch) {
+    auto table = branch.table;
+
+    if (table == nullptr || !table->transient) {
+      return;
+    }
+
+    size_t count = 0;
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1, count++) {
+      if (!(branch.leafmap & bits & -bits)) {
+        compact(table->slots()[count].branch);
+      }
+    }
+
+    table->transient = false;
+
+    if (table->capacity == count) {
+      return;
+    }
+
+    auto tight = allocate_table(count);
+    size_t pos = 0;
+
+    for (uint32_t bits = branch.bitmap; bits != 0; bits &= bits - 1, pos++) {
+      move_slot(tight->slots()[pos], table->slots()[pos],
+                branch.leafmap & bits & -bits);
+    }
+
+    free_table(table);
+    branch.table = tight;
+  }
+};
+
+} // namespace atlas
@@ -0,0 +1,525 @@
+#pragma once
+#include "alloc.hpp"
+#include "assert.hpp"
+#include "cons.hpp"
+#include "iter.hpp"
+#include "option.hpp"
+#include "result.hpp"
+#include <bit>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace atlas {
+
+/// A map from 64-bit keys to values, backed by a radix tree of 64-way nodes
+/// Every level consumes 6 bits of the key, most significant first, and the
+/// tree is only as tall as its largest key needs, so a lookup is a handful of
+/// array indexings with no hashing and no key comparison. Nodes keep bitmaps
+/// of their slots in use, which makes scans ordered and lets them skip empty
+/// ranges. Like Linux's xarray, entries can carry `Tags` tag bits, and nodes
+/// also summarize which of their subtrees hold tagged entries or are full, to
+/// find the next tagged entry or the next free key in O(key_bits / 6).
+template <typename V, Allocator A = DefaultAllocator, size_t Tags = 0>
+class RadixTree {
+
+public:
+  RadixTree(A alloc = A()) : alloc_(alloc) {}
+
+  RadixTree(RadixTree &&other)
+      : root_(other.root_), size_(other.size_),
+        alloc_(std::move(other.alloc_)) {
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+
+  RadixTree(const RadixTree &other) = delete;
+  RadixTree &operator=(const RadixTree &other) = delete;
+
+  ~RadixTree() { clear(); }
+
+  [[nodiscard]] size_t size() const { return size_; }
+
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  Result<> insert(uint64_t key, V value) {
+    auto node = leaf_for(key);
+    auto slot = key & MASK;
+
+    if (node->present & bit(slot)) {
+      return Err(Error::Duplicate);
+    }
+
+    new (&leaf(node)->values[slot]) V(std::move(value));
+    node->present |= bit(slot);
+    size_++;
+
+    // Fill up the full bits of the ancestors the key completed
+    while (node->parent != nullptr && is_full(node)) {
+      node->parent->full |= bit(node->offset);
+      node = node->parent;
+    }
+
+    return Ok(NONE);
+  }
+
+  [[nodiscard]] Option<V> get(uint64_t key) const {
+    auto node = find_leaf(key);
+
+    if (node == nullptr || !(node->present & bit(key & MASK))) {
+      return NONE;
+    }
+
+    return leaf(node)->values[key & MASK];
+  }
+
+  [[nodiscard]] bool contains(uint64_t key) const {
+    auto node = find_leaf(key);
+    return node != nullptr && (node->present & bit(key & MASK));
+  }
+
+  Result<> remove(uint64_t key) {
+    auto node = find_leaf(key);
+    auto slot = key & MASK;
+
+    if (node == nullptr || !(node->present & bit(slot))) {
+      return Err(Error::NotFound);
+    }
+
+    leaf(node)->values[slot].~V();
+    node->present &= ~bit(slot);
+    size_--;
+
+    for (size_t tag = 0; tag < Tags; tag++) {
+      clear_tag_bit(node, slot, tag);
+    }
+
+    for (auto n = node; n->parent != nullptr; n = n->parent) {
+      if (!(n->parent->full & bit(n->offset))) {
+        break;
+      }
+
+      n->parent->full &= ~bit(n->offset);
+    }
+
+    prune(node);
+
+    return Ok(NONE);
+  }
+
+  void clear() {
+    if (root_ != nullptr) {
+      free_subtree(root_);
+    }
+
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  [[nodiscard]] V operator[](uint64_t key) const { return get(key).unwrap(); }
+
+  /// The smallest key not less than `start` that isn't in the tree
+  [[nodiscard]] Option<uint64_t> find_free(uint64_t start = 0) const {
+    return seek<true>(start, [](Node *node) {
+      return node->shift == 0 ? ~node->present : ~node->full;
+    });
+  }
+
+  Result<> set_tag(uint64_t key, size_t tag)
+    requires(Tags > 0)
+  {
+    ENSURE(tag < Tags, "invalid tag");
+
+    auto node = find_leaf(key);
+    auto slot = key & MASK;
+
+    if (node == nullptr || !(node->present & bit(slot))) {
+      return Err(Error::NotFound);
+    }
+
+    node->tags[tag] |= bit(slot);
+
+    // Ancestors that already have the bit have it all the way up
+    for (; node->parent != nullptr; node = node->parent) {
+      if (node->parent->tags[tag] & bit(node->offset)) {
+        break;
+      }
+
+      node->parent->tags[tag] |= bit(node->offset);
+    }
+
+    return Ok(NONE);
+  }
+
+  Result<> clear_tag(uint64_t key, size_t tag)
+    requires(Tags > 0)
+  {
+    ENSURE(tag < Tags, "invalid tag");
+
+    auto node = find_leaf(key);
+    auto slot = key & MASK;
+
+    if (node == nullptr || !(node->present & bit(slot))) {
+      return Err(Error::NotFound);
+    }
+
+    clear_tag_bit(node, slot, tag);
+
+    return Ok(NONE);
+  }
+
+  [[nodiscard]] bool has_tag(uint64_t key, size_t tag) const
+    requires(Tags > 0)
+  {
+    ENSURE(tag < Tags, "invalid tag");
+
+    auto node = find_leaf(key);
+    return node != nullptr && (node->tags[tag] & bit(key & MASK));
+  }
+
+  /// The smallest key not less than `start` whose entry has `tag`
+  [[nodiscard]] Option<uint64_t> next_tagged(uint64_t start, size_t tag) const
+    requires(Tags > 0)
+  {
+    ENSURE(tag < Tags, "invalid tag");
+
+    return seek<false>(start, [tag](Node *node) { return node->tags[tag]; });
+  }
+
+  /// Returns an iterator over the entries in key order, as
+  /// `Cons<uint64_t, const V &>`
+  [[nodiscard]] auto iter() const { return entries(0, ~0ULL, false); }
+
+  /// Returns an iterator over the entries with keys in [`start`, `end`), in
+  /// key order
+  [[nodiscard]] auto range(uint64_t start, uint64_t end) const {
+    return entries(start, end - 1, start >= end);
+  }
+
+private:
+  static constexpr size_t BITS = 6;
+  static constexpr size_t SLOTS = 1 << BITS;
+  static constexpr uint64_t MASK = SLOTS - 1;
+
+  struct Node {
+    Node *parent;
+
+    // Position of the key bits that index the slots, 0 for leaves
+    uint8_t shift;
+
+    // Slot of the node in its parent
+    uint8_t offset;
+
+    // Slots in use
+    uint64_t present;
+
+    // Slots whose subtree holds every key of its range, only for branches
+    uint64_t full;
+
+    // Slots whose subtree holds an entry with each tag
+    uint64_t tags[Tags > 0 ? Tags : 1];
+  };
+
+  struct Branch : Node {
+    Node *children[SLOTS];
+  };
+
+  // Values are constructed and destroyed by hand
+  struct Leaf : Node {
+    union {
+      V values[SLOTS];
+    };
+
+    Leaf() {}
+    ~Leaf() {}
+  };
+
+  Node *root_ = nullptr;
+  size_t size_ = 0;
+  A alloc_;
+
+  static constexpr uint64_t bit(size_t slot) { return 1ULL << slot; }
+
+  static Branch *branch(Node *node) { return static_cast<Branch *>(node); }
+
+  static Leaf *leaf(Node *node) { return static_cast<Leaf *>(node); }
+
+  // Mask of the key bits covered by a node of `shift`, including its slot
+  static constexpr uint64_t span(size_t shift) {
+    return shift + BITS >= 64 ? ~0ULL : (1ULL << (shift + BITS)) - 1;
+  }
+
+  static bool is_full(Node *node) {
+    return (node->shift == 0 ? node->present : node->full) == ~0ULL;
+  }
+
+  Node *allocate_node(size_t shift) {
+    Node *node;
+
+    if (shift == 0) {
+      node = new (alloc_.allocate(sizeof(Leaf))) Leaf();
+    } else {
+      node = new (alloc_.allocate(sizeof(Branch))) Branch;
+    }
+
+    node->parent = nullptr;
+    node->shift = shift;
+    node->offset = 0;
+    node->present = 0;
+    node->full = 0;
+
+    for (auto &tag : node->tags) {
+      tag = 0;
+    }
+
+    return node;
+  }
+
+  void free_node(Node *node) {
+    if (node->shift == 0) {
+      alloc_.deallocate(node, sizeof(Leaf));
+    } else {
+      alloc_.deallocate(node, sizeof(Branch));
+    }
+  }
+
+  void free_subtree(Node *node) {
+    for (auto slots = node->present; slots != 0; slots &= slots - 1) {
+      auto slot = std::countr_zero(slots);
+
+      if (node->shift == 0) {
+        leaf(node)->values[slot].~V();
+      } else {
+        free_subtree(branch(node)->children[slot]);
+      }
+    }
+
+    free_node(node);
+  }
+
+  // The leaf that holds `key`, if any
+  [[nodiscard]] Node *find_leaf(uint64_t key) const {
+    auto node = root_;
+
+    if (node == nullptr || (key & ~span(node->shift)) != 0) {
+      return nullptr;
+    }
+
+    while (node->shift > 0) {
+      auto slot = (key >> node->shift) & MASK;
+
+      if (!(node->present & bit(slot))) {
+        return nullptr;
+      }
+
+      node = branch(node)->children[slot];
+    }
+
+    return node;
+  }
+
+  // The leaf that holds `key`, creating it and the levels above it if needed
+  Node *leaf_for(uint64_t key) {
+    if (root_ == nullptr) {
+      root_ = allocate_node(0);
+    }
+
+    // The tree grows from the top, the old root becomes the first child of
+    // the new one
+    while ((key & ~span(root_->shift)) != 0) {
+      auto root = allocate_node(root_->shift + BITS);
+
+      root->present = 1;
+      root->full = is_full(root_);
+
+      for (size_t tag = 0; tag < Tags; tag++) {
+        root->tags[tag] = root_->tags[tag] != 0;
+      }
+
+      branch(root)->children[0] = root_;
+      root_->parent = root;
+      root_ = root;
+    }
+
+    auto node = root_;
+
+    while (node->shift > 0) {
+      auto slot = (key >> node->shift) & MASK;
+
+      if (!(node->present & bit(slot))) {
+        auto child = allocate_node(node->shift - BITS);
+        child->parent = node;
+        child->offset = slot;
+        branch(node)->children[slot] = child;
+        node->present |= bit(slot);
+      }
+
+      node = branch(node)->children[slot];
+    }
+
+    return node;
+  }
+
+  void clear_tag_bit(Node *node, size_t slot, size_t tag) {
+    node->tags[tag] &= ~bit(slot);
+
+    for (; node->parent != nullptr && node->tags[tag] == 0;
+         node = node->parent) {
+      node->parent->tags[tag] &= ~bit(node->offset);
+    }
+  }
+
+  // Free the empty nodes from `node` up, then drop the levels at the top
+  // that only lead to their first slot
+  void prune(Node *node) {
+    while (node->present == 0) {
+      auto parent = node->parent;
+      auto slot = node->offset;
+
+      free_node(node);
+
+      if (parent == nullptr) {
+        root_ = nullptr;
+        return;
+      }
+
+      parent->present &= ~bit(slot);
+      parent->full &= ~bit(slot);
+
+      for (size_t tag = 0; tag < Tags; tag++) {
+        parent->tags[tag] &= ~bit(slot);
+      }
+
+      node = parent;
+    }
+
+    while (root_->shift > 0 && root_->present == 1) {
+      auto child = branch(root_)->children[0];
+      free_node(root_);
+      child->parent = nullptr;
+      root_ = child;
+    }
+  }
+
+  // The smallest key not less than `start` that `candidates` leads to
+  // `candidates(node)` has the bits of the slots worth looking into. With
+  // `Free`, a slot that isn't in use is a match, otherwise the key must be
+  // present in a leaf.
+  template <bool Free, typename F>
+  [[nodiscard]] Option<uint64_t> seek(uint64_t start, F candidates,
+                                      Node **found = nullptr) const {
+    auto node = root_;
+
+    if (node == nullptr || (start & ~span(node->shift)) != 0) {
+      if (Free) {
+        return start;
+      }
+
+      return NONE;
+    }
+
+    while (true) {
+      auto slot = (start >> node->shift) & MASK;
+      auto bits = candidates(node) & (~0ULL << slot);
+
+      // The root of a full height tree only has the slots the key reaches
+      if (node->shift + BITS > 64) {
+        bits &= bit(1 << (64 - node->shift)) - 1;
+      }
+
+      if (bits == 0) {
+        // Nothing left here, carry on after the range of this node, from the
+        // first ancestor whose range still holds that key
+        if ((start | span(node->shift)) == ~0ULL) {
+          return NONE;
+        }
+
+        auto prev = start;
+        start = (start | span(node->shift)) + 1;
+
+        do {
+          node = node->parent;
+        } while (node != nullptr && (start & ~span(node->shift)) !=
+                                        (prev & ~span(node->shift)));
+
+        if (node == nullptr) {
+          if (Free) {
+            return start;
+          }
+
+          return NONE;
+        }
+
+        continue;
+      }
+
+      size_t next = std::countr_zero(bits);
+
+      if (next != slot) {
+        start = (start & ~span(node->shift)) | (uint64_t(next) << node->shift);
+      }
+
+      if (node->shift == 0 || (Free && !(node->present & bit(next)))) {
+        if (found != nullptr) {
+          *found = node;
+        }
+
+        return start;
+      }
+
+      node = branch(node)->children[next];
+    }
+  }
+
+  // Entries from `start` to `last`, both included. The iterator keeps the
+  // leaf of the next key, and only seeks from the root to find the next leaf.
+  [[nodiscard]] auto entries(uint64_t start, uint64_t last, bool done) const {
+    auto next_func = [this, key = start, last, done,
+                      node = (Node *)nullptr]() mutable
+        -> Option<Cons<uint64_t, const V &>> {
+      if (done) {
+        return NONE;
+      }
+
+      uint64_t bits = 0;
+
+      if (node != nullptr) {
+        bits = node->present & (~0ULL << (key & MASK));
+      }
+
+      if (bits != 0) {
+        key = (key & ~MASK) | std::countr_zero(bits);
+      } else {
+        auto next = seek<false>(
+            key, [](Node *n) { return n->present; }, &node);
+
+        if (next.is_none()) {
+          done = true;
+          return NONE;
+        }
+
+        key = next.unwrap();
+      }
+
+      if (key > last) {
+        done = true;
+        return NONE;
+      }
+
+      auto ret = Cons<uint64_t, const V &>(key, leaf(node)->values[key & MASK]);
+
+      // Past the end of the leaf, the next key is found from the root
+      if (key == ~0ULL) {
+        done = true;
+      } else if ((++key & MASK) == 0) {
+        node = nullptr;
+      }
+
+      return ret;
+    };
+
+    return Iterator<decltype(next_func)>(next_func);
+  }
+};
+
+} // namespace atlas
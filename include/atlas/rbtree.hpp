@@ -1,6 +1,13 @@
 #pragma once
+#include "assert.hpp"
 #include "iter.hpp"
+#include "result.hpp"
+#include "slice.hpp"
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
 
 // This implementation of a red-black tree is mostly based on 'Introduction to
 // Algorithms' by Cormen et al.
@@ -16,28 +23,88 @@ template <typename T> struct RBTreeNode {
   T *right = nullptr;
 
   RBColor color = RBColor::Black;
+
+  [[nodiscard]] T *get_parent() const { return parent; }
+
+  void set_parent(T *new_parent) { parent = new_parent; }
+
+  [[nodiscard]] RBColor get_color() const { return color; }
+
+  void set_color(RBColor new_color) { color = new_color; }
+};
+
+/// A hook of three words instead of four, the color is kept in the low bit of
+/// the parent pointer, so `T` must be at least 2-byte aligned
+template <typename T> class PackedRBTreeNode {
+public:
+  T *left = nullptr;
+  T *right = nullptr;
+
+  [[nodiscard]] T *get_parent() const {
+    return reinterpret_cast<T *>(parent_color_ & ~RED);
+  }
+
+  void set_parent(T *parent) {
+    static_assert(alignof(T) >= 2, "the color needs a free pointer bit");
+    parent_color_ = reinterpret_cast<uintptr_t>(parent) | (parent_color_ & RED);
+  }
+
+  [[nodiscard]] RBColor get_color() const {
+    return parent_color_ & RED ? RBColor::Red : RBColor::Black;
+  }
+
+  void set_color(RBColor color) {
+    parent_color_ = (parent_color_ & ~RED) | (color == RBColor::Red ? RED : 0);
+  }
+
+private:
+  static constexpr uintptr_t RED = 1;
+
+  uintptr_t parent_color_ = 0;
+};
+
+/// Augmentation policy of a tree that keeps no per-subtree data
+/// A policy provides `static void update(T *node, T *left, T *right)`, which
+/// recomputes the data of `node` from its own fields and the data of its
+/// children (nullptr when missing). The tree calls it bottom-up whenever a
+/// subtree changes, so the data of every node always describes its subtree.
+struct RBNoAugment {
+  template <typename T> static void update(T *, T *, T *) {}
 };
 
-template <typename T, RBTreeNode<T> T::*N, typename U, U T::*Key>
+/// An intrusive red-black tree of `T`, linked through the hook `N` and ordered
+/// by `Key`. The hook is either a RBTreeNode<T> or a PackedRBTreeNode<T>.
+/// A `Cached` tree also keeps track of its first and last elements, which
+/// makes first(), last() and pop_first() O(1) at the cost of a few stores on
+/// every insertion and removal.
+template <typename T, auto N, typename U, U T::*Key,
+          typename Augment = RBNoAugment, bool Cached = false>
   requires(Sortable<U>)
 class RBTree {
 
 public:
-  RBTree()
-      : nil_({
-            .parent = nullptr,
-            .left = nullptr,
-            .right = nullptr,
-            .color = RBColor::Black,
-        }) {}
+  using Hook = std::remove_cvref_t<decltype(std::declval<T &>().*N)>;
+
+  RBTree() = default;
+
+  RBTree(RBTree &&other) : RBTree() {
+    root_ = other.root_;
+    first_ = other.first_;
+    last_ = other.last_;
+    other.root_ = nullptr;
+    other.first_ = nullptr;
+    other.last_ = nullptr;
+  }
 
   [[nodiscard]] T *root() const { return root_; }
 
   [[nodiscard]] bool empty() const { return root_ == nullptr; }
 
-  [[nodiscard]] bool is_red(T *n) { return h(n)->color == RBColor::Red; }
+  [[nodiscard]] bool is_red(T *n) { return h(n)->get_color() == RBColor::Red; }
 
-  [[nodiscard]] bool is_black(T *n) { return h(n)->color == RBColor::Black; }
+  [[nodiscard]] bool is_black(T *n) {
+    return h(n)->get_color() == RBColor::Black;
+  }
 
   void insert(T *to_insert) {
     auto new_node = h(to_insert);
@@ -47,18 +114,34 @@ public:
 
     T *y = nullptr;
 
+    // Whether the new node only went left (or right) on its way down
+    bool is_first = true;
+    bool is_last = true;
+
     while (!is_nil(x)) {
       y = x;
       if (key(to_insert) < key(x)) {
         x = x_node->left;
         x_node = h(x);
+        is_last = false;
       } else {
         x = x_node->right;
         x_node = h(x);
+        is_first = false;
       }
     }
 
-    new_node->parent = y;
+    if constexpr (Cached) {
+      if (is_first) {
+        first_ = to_insert;
+      }
+
+      if (is_last) {
+        last_ = to_insert;
+      }
+    }
+
+    new_node->set_parent(y);
 
     if (is_nil(y)) {
       root_ = to_insert;
@@ -71,16 +154,27 @@ public:
     new_node->left = nullptr;
     new_node->right = nullptr;
 
-    new_node->color = RBColor::Red;
+    new_node->set_color(RBColor::Red);
 
+    propagate(to_insert);
     insert_fixup(to_insert);
   }
 
   void remove(T *node) {
+    if constexpr (Cached) {
+      if (node == first_) {
+        first_ = successor(node);
+      }
+
+      if (node == last_) {
+        last_ = predecessor(node);
+      }
+    }
+
     auto n = h(node);
     auto y = n;
     auto x = node;
-    auto y_orig_color = y->color;
+    auto y_orig_color = y->get_color();
 
     if (is_nil(n->left)) {
       x = n->right;
@@ -91,28 +185,118 @@ public:
     } else {
       y = h(minimum(n->right));
 
-      y_orig_color = y->color;
+      y_orig_color = y->get_color();
       x = y->right;
 
       if (y != h(n->right)) {
         transplant(raw(y), y->right);
         y->right = n->right;
-        h(y->right)->parent = raw(y);
+        h(y->right)->set_parent(raw(y));
       } else {
-        h(x)->parent = raw(y);
+        h(x)->set_parent(raw(y));
       }
 
       transplant(node, raw(y));
       y->left = n->left;
-      h(y->left)->parent = raw(y);
-      y->color = n->color;
+      h(y->left)->set_parent(raw(y));
+      y->set_color(n->get_color());
     }
 
+    // The parent of x is the lowest node whose subtree changed, every
+    // rotation done by the fixup then updates the nodes it moves
+    propagate(h(x)->get_parent());
+
     if (y_orig_color == RBColor::Black) {
       remove_fixup(x);
     }
   }
 
+  /// Unlink every element, calling `destroy` on each of them
+  /// Elements are visited in post order, children before their parent, so
+  /// `destroy` may free them. This takes O(n), with no rebalancing.
+  template <typename F> void clear(F destroy) {
+    auto x = root_;
+    root_ = nullptr;
+    first_ = nullptr;
+    last_ = nullptr;
+
+    while (!is_nil(x)) {
+      auto n = h(x);
+
+      if (!is_nil(n->left)) {
+        x = n->left;
+        continue;
+      }
+
+      if (!is_nil(n->right)) {
+        x = n->right;
+        continue;
+      }
+
+      // Both subtrees are gone, detach from the parent and go back up
+      auto parent = n->get_parent();
+
+      if (!is_nil(parent)) {
+        if (h(parent)->left == x) {
+          h(parent)->left = nullptr;
+        } else {
+          h(parent)->right = nullptr;
+        }
+      }
+
+      destroy(x);
+      x = parent;
+    }
+  }
+
+  /// Build the tree out of `nodes`, which must be sorted by key, in O(n)
+  /// The tree must be empty. It's balanced by construction: every level but
+  /// the deepest one is full and black, and the nodes of the deepest one are
+  /// red, so no rotation or recoloring is needed. Nodes that aren't strictly
+  /// increasing are rejected with InvalidParameters and the tree stays empty.
+  Result<> from_sorted(Slice<T *> nodes) {
+    ENSURE(empty(), "tree must be empty");
+
+    if (nodes.size() == 0) {
+      return Ok(NONE);
+    }
+
+    for (size_t i = 1; i < nodes.size(); i++) {
+      if (!(key(nodes[i - 1]) < key(nodes[i]))) [[unlikely]] {
+        return Err(Error::InvalidParameters);
+      }
+    }
+
+    // Depth of the deepest level
+    size_t red_depth = std::bit_width(nodes.size()) - 1;
+
+    root_ = build(nodes, 0, nodes.size(), nullptr, 0, red_depth);
+
+    if constexpr (Cached) {
+      first_ = nodes[0];
+      last_ = nodes[nodes.size() - 1];
+    }
+
+    return Ok(NONE);
+  }
+
+  /// The first element in order, O(1) in a cached tree
+  [[nodiscard]] Option<T *> first() const { return to_option(first_node()); }
+
+  /// The last element in order, O(1) in a cached tree
+  [[nodiscard]] Option<T *> last() const { return to_option(last_node()); }
+
+  /// Remove the first element and return it
+  Option<T *> pop_first() {
+    auto ret = first();
+
+    if (ret.is_some()) {
+      remove(ret.unwrap());
+    }
+
+    return ret;
+  }
+
   // The minimum element of a tree is its leftmost element
   [[nodiscard]] T *minimum(T *root) const {
     auto x = root;
@@ -157,96 +341,232 @@ public:
     return NONE;
   }
 
+  /// The first element whose key is not less than `key`
+  template <typename K> [[nodiscard]] Option<T *> lower_bound(K key) const {
+    return to_option(lower_bound_node(key));
+  }
+
+  /// The first element whose key is greater than `key`
+  template <typename K> [[nodiscard]] Option<T *> upper_bound(K key) const {
+    T *ret = nullptr;
+    auto x = root_;
+
+    while (!is_nil(x)) {
+      if (key < this->key(x)) {
+        ret = x;
+        x = h(x)->left;
+      } else {
+        x = h(x)->right;
+      }
+    }
+
+    return to_option(ret);
+  }
+
+  /// The last element whose key is not greater than `key`
+  template <typename K> [[nodiscard]] Option<T *> floor(K key) const {
+    T *ret = nullptr;
+    auto x = root_;
+
+    while (!is_nil(x)) {
+      if (key < this->key(x)) {
+        x = h(x)->left;
+      } else {
+        ret = x;
+        x = h(x)->right;
+      }
+    }
+
+    return to_option(ret);
+  }
+
+  /// The first element whose key is not less than `key`, same as
+  /// lower_bound()
+  template <typename K> [[nodiscard]] Option<T *> ceil(K key) const {
+    return lower_bound(key);
+  }
+
+  /// The element that follows `node` in order, or nullptr
+  [[nodiscard]] T *successor(T *node) const {
+    auto n = h(node);
+
+    if (!is_nil(n->right)) {
+      return minimum(n->right);
+    }
+
+    auto y = n->get_parent();
+    while (!is_nil(y) && node == h(y)->right) {
+      node = y;
+      y = h(y)->get_parent();
+    }
+
+    return is_nil(y) ? nullptr : y;
+  }
+
+  /// The element that precedes `node` in order, or nullptr
+  [[nodiscard]] T *predecessor(T *node) const {
+    auto n = h(node);
+
+    if (!is_nil(n->left)) {
+      return maximum(n->left);
+    }
+
+    auto y = n->get_parent();
+    while (!is_nil(y) && node == h(y)->left) {
+      node = y;
+      y = h(y)->get_parent();
+    }
+
+    return is_nil(y) ? nullptr : y;
+  }
+
+  /// Walk this tree and `other` together in key order, in O(n + m)
+  /// `f(a, b)` is called once per key, with the elements of both trees that
+  /// hold it, and nullptr on the side that doesn't. Equal keys within a tree
+  /// are paired with the other tree's in order.
+  template <typename F> void merge_join(const RBTree &other, F f) const {
+    auto a = first_node();
+    auto b = other.first_node();
+
+    while (a != nullptr || b != nullptr) {
+      if (b == nullptr || (a != nullptr && key(a) < key(b))) {
+        f(a, nullptr);
+        a = successor(a);
+      } else if (a == nullptr || key(b) < key(a)) {
+        f(nullptr, b);
+        b = other.successor(b);
+      } else {
+        f(a, b);
+        a = successor(a);
+        b = other.successor(b);
+      }
+    }
+  }
+
   /// Return an iterator over the tree's contents
   /// NOTE: Iteration is done in order
   [[nodiscard]] auto iter() const {
-    auto next_func = [this, current = minimum(root_)]() mutable -> Option<T *> {
+    auto next_func = [this, current = first_node()]() mutable -> Option<T *> {
       if (is_nil(current)) {
         return NONE;
       }
 
       auto ret = current;
-      auto current_node = h(current);
-
-      if (!is_nil(current_node->right)) {
-        current = minimum(current_node->right);
-      } else {
-        auto y = current_node->parent;
-        while (!is_nil(y) && current == h(y)->right) {
-          current = y;
-          y = h(y)->parent;
-        }
-        current = y;
-      }
-
+      current = successor(current);
       return ret;
     };
 
-    auto prev_func = [this, current = maximum(root_)]() mutable -> Option<T *> {
+    auto prev_func = [this, current = last_node()]() mutable -> Option<T *> {
       if (is_nil(current)) {
         return NONE;
       }
 
       auto ret = current;
-      auto current_node = h(current);
+      current = predecessor(current);
+      return ret;
+    };
 
-      if (!is_nil(current_node->left)) {
-        current = maximum(current_node->left);
-      } else {
-        auto y = current_node->parent;
-        while (!is_nil(y) && current == h(y)->left) {
-          current = y;
-          y = h(y)->parent;
-        }
-        current = y;
+    return Iterator<decltype(next_func), decltype(prev_func)>(next_func,
+                                                              prev_func);
+  }
+
+  /// Return an iterator over the elements with keys in [`start`, `end`), in
+  /// order. The first element is found in O(log n), and every other one is
+  /// the successor of the previous one.
+  template <typename K> [[nodiscard]] auto range(K start, K end) const {
+    auto next_func = [this, current = lower_bound_node(start),
+                      end]() mutable -> Option<T *> {
+      if (is_nil(current) || !(key(current) < end)) {
+        return NONE;
       }
 
+      auto ret = current;
+      current = successor(current);
       return ret;
     };
 
-    return Iterator<decltype(next_func), decltype(prev_func)>(next_func,
-                                                              prev_func);
+    return Iterator<decltype(next_func)>(next_func);
   }
 
 private:
-  [[nodiscard]] RBTreeNode<T> *h(T *n) const {
+  [[nodiscard]] Hook *h(T *n) const {
     if (!n)
-      return const_cast<RBTreeNode<T> *>(&nil_);
+      return const_cast<Hook *>(&nil_);
     return &(n->*N);
   }
 
-  inline RBTreeNode<T> *parent(T *n) { return h(h(n)->parent); }
-  inline RBTreeNode<T> *parent(RBTreeNode<T> *n) { return h(n->parent); }
+  inline Hook *parent(T *n) { return h(h(n)->get_parent()); }
+  inline Hook *parent(Hook *n) { return h(n->get_parent()); }
 
-  inline RBTreeNode<T> *grandparent(RBTreeNode<T> *n) {
-    return h(h(n->parent)->parent);
+  inline Hook *grandparent(Hook *n) {
+    return h(h(n->get_parent())->get_parent());
   }
 
   // This is a bit like container_of
-  inline T *raw(RBTreeNode<T> *n) const {
+  inline T *raw(Hook *n) const {
     auto off = (size_t)(&((T *)nullptr->*N));
     return reinterpret_cast<T *>((char *)n - off);
   }
 
-  inline auto key(T *n) const { return *(&(n->*Key)); }
+  inline const U &key(T *n) const { return n->*Key; }
+
+  [[nodiscard]] static Option<T *> to_option(T *n) {
+    if (n == nullptr) {
+      return NONE;
+    }
+
+    return n;
+  }
+
+  [[nodiscard]] T *first_node() const {
+    if constexpr (Cached) {
+      return first_;
+    } else {
+      return minimum(root_);
+    }
+  }
+
+  [[nodiscard]] T *last_node() const {
+    if constexpr (Cached) {
+      return last_;
+    } else {
+      return maximum(root_);
+    }
+  }
+
+  template <typename K> [[nodiscard]] T *lower_bound_node(const K &key) const {
+    T *ret = nullptr;
+    auto x = root_;
+
+    while (!is_nil(x)) {
+      if (this->key(x) < key) {
+        x = h(x)->right;
+      } else {
+        ret = x;
+        x = h(x)->left;
+      }
+    }
+
+    return ret;
+  }
 
   void insert_fixup(T *to_insert) {
     auto node = h(to_insert);
 
-    while (parent(node)->color == RBColor::Red) {
+    while (parent(node)->get_color() == RBColor::Red) {
 
       // Is the parent of the node a left child?
-      if (node->parent == grandparent(node)->left) {
+      if (node->get_parent() == grandparent(node)->left) {
         auto y = h(grandparent(node)->right);
 
         // If parent and uncle are both red, make them both black and
         // grandparent red, as a red node cannot have a red parent
-        if (y->color == RBColor::Red) {
-          parent(node)->color = RBColor::Black;
+        if (y->get_color() == RBColor::Red) {
+          parent(node)->set_color(RBColor::Black);
 
-          y->color = RBColor::Black;
+          y->set_color(RBColor::Black);
 
-          grandparent(node)->color = RBColor::Red;
+          grandparent(node)->set_color(RBColor::Red);
 
           to_insert = raw(grandparent(node));
 
@@ -256,13 +576,13 @@ private:
           // If the parent is a right child, rotate left to make it a left child
           // and then rotate right to fix the tree
           if (to_insert == parent(node)->right) {
-            to_insert = node->parent;
+            to_insert = node->get_parent();
             node = parent(node);
             rotate_left(to_insert);
           }
 
-          parent(node)->color = RBColor::Black;
-          grandparent(node)->color = RBColor::Red;
+          parent(node)->set_color(RBColor::Black);
+          grandparent(node)->set_color(RBColor::Red);
 
           rotate_right(raw(grandparent(node)));
         }
@@ -272,39 +592,39 @@ private:
       else {
         auto y = h(grandparent(node)->left);
 
-        if (y->color == RBColor::Red) {
-          parent(node)->color = RBColor::Black;
+        if (y->get_color() == RBColor::Red) {
+          parent(node)->set_color(RBColor::Black);
 
-          y->color = RBColor::Black;
+          y->set_color(RBColor::Black);
 
-          grandparent(node)->color = RBColor::Red;
+          grandparent(node)->set_color(RBColor::Red);
 
           to_insert = raw(grandparent(node));
 
           node = grandparent(node);
         } else {
           if (to_insert == parent(node)->left) {
-            to_insert = node->parent;
+            to_insert = node->get_parent();
             node = parent(node);
             rotate_right(to_insert);
           }
 
-          parent(node)->color = RBColor::Black;
-          grandparent(node)->color = RBColor::Red;
+          parent(node)->set_color(RBColor::Black);
+          grandparent(node)->set_color(RBColor::Red);
 
           rotate_left(raw(grandparent(node)));
         }
       }
     }
 
-    h(root_)->color = RBColor::Black;
+    h(root_)->set_color(RBColor::Black);
   }
 
   void transplant(T *u, T *v) {
     auto u_node = h(u);
     auto v_node = h(v);
 
-    if (is_nil(h(u)->parent)) {
+    if (is_nil(h(u)->get_parent())) {
       root_ = v;
     } else if (u == parent(u)->left) {
       parent(u)->left = v;
@@ -312,11 +632,50 @@ private:
       parent(u)->right = v;
     }
 
-    v_node->parent = u_node->parent;
+    v_node->set_parent(u_node->get_parent());
   }
 
   [[nodiscard]] bool is_nil(T *n) const { return h(n) == &nil_; }
 
+  static constexpr bool AUGMENTED = !std::is_same_v<Augment, RBNoAugment>;
+
+  void augment(T *n) {
+    if constexpr (AUGMENTED) {
+      Augment::update(n, h(n)->left, h(n)->right);
+    }
+  }
+
+  // Update `n` and all of its ancestors
+  void propagate(T *n) {
+    if constexpr (AUGMENTED) {
+      while (!is_nil(n)) {
+        augment(n);
+        n = h(n)->get_parent();
+      }
+    }
+  }
+
+  // Link nodes [begin, end) into a subtree, its root is the middle node
+  T *build(Slice<T *> nodes, size_t begin, size_t end, T *parent,
+           size_t depth, size_t red_depth) {
+    if (begin == end) {
+      return nullptr;
+    }
+
+    auto mid = begin + (end - begin) / 2;
+    auto x = nodes[mid];
+    auto n = h(x);
+
+    n->set_parent(parent);
+    n->set_color(depth == red_depth && depth > 0 ? RBColor::Red
+                                                 : RBColor::Black);
+    n->left = build(nodes, begin, mid, x, depth + 1, red_depth);
+    n->right = build(nodes, mid + 1, end, x, depth + 1, red_depth);
+    augment(x);
+
+    return x;
+  }
+
   void rotate_left(T *n) {
     auto node = h(n);
 
@@ -326,12 +685,12 @@ private:
     node->right = y->left;
 
     if (!is_nil(y->left)) {
-      h(y->left)->parent = n;
+      h(y->left)->set_parent(n);
     }
 
-    y->parent = node->parent;
+    y->set_parent(node->get_parent());
 
-    if (is_nil(node->parent)) {
+    if (is_nil(node->get_parent())) {
       root_ = y_raw;
     } else if (n == parent(node)->left) {
       parent(node)->left = y_raw;
@@ -340,7 +699,10 @@ private:
     }
 
     y->left = n;
-    node->parent = y_raw;
+    node->set_parent(y_raw);
+
+    augment(n);
+    augment(y_raw);
   }
 
   void rotate_right(T *n) {
@@ -352,12 +714,12 @@ private:
     node->left = y->right;
 
     if (!is_nil(y->right)) {
-      h(y->right)->parent = n;
+      h(y->right)->set_parent(n);
     }
 
-    y->parent = node->parent;
+    y->set_parent(node->get_parent());
 
-    if (is_nil(node->parent)) {
+    if (is_nil(node->get_parent())) {
       root_ = y_raw;
     } else if (n == parent(node)->left) {
       parent(node)->left = y_raw;
@@ -366,36 +728,39 @@ private:
     }
 
     y->right = n;
-    node->parent = y_raw;
+    node->set_parent(y_raw);
+
+    augment(n);
+    augment(y_raw);
   }
 
   void remove_fixup(T *x) {
-    while (x != root_ && h(x)->color == RBColor::Black) {
+    while (x != root_ && h(x)->get_color() == RBColor::Black) {
       if (x == parent(x)->left) {
         auto w = h(parent(x)->right);
-        if (w->color == RBColor::Red) {
-          w->color = RBColor::Black;
-          parent(x)->color = RBColor::Red;
-          rotate_left(h(x)->parent);
+        if (w->get_color() == RBColor::Red) {
+          w->set_color(RBColor::Black);
+          parent(x)->set_color(RBColor::Red);
+          rotate_left(h(x)->get_parent());
           w = h(parent(x)->right);
         }
 
-        if (h(w->left)->color == RBColor::Black &&
-            h(w->right)->color == RBColor::Black) {
-          w->color = RBColor::Red;
-          x = h(x)->parent;
+        if (h(w->left)->get_color() == RBColor::Black &&
+            h(w->right)->get_color() == RBColor::Black) {
+          w->set_color(RBColor::Red);
+          x = h(x)->get_parent();
         } else {
-          if (h(w->right)->color == RBColor::Black) {
-            h(w->left)->color = RBColor::Black;
-            w->color = RBColor::Red;
+          if (h(w->right)->get_color() == RBColor::Black) {
+            h(w->left)->set_color(RBColor::Black);
+            w->set_color(RBColor::Red);
             rotate_right(raw(w));
             w = h(parent(x)->right);
           }
 
-          w->color = parent(x)->color;
-          parent(x)->color = RBColor::Black;
-          h(w->right)->color = RBColor::Black;
-          rotate_left(h(x)->parent);
+          w->set_color(parent(x)->get_color());
+          parent(x)->set_color(RBColor::Black);
+          h(w->right)->set_color(RBColor::Black);
+          rotate_left(h(x)->get_parent());
           x = root_;
         }
       }
@@ -403,40 +768,46 @@ private:
       else {
         auto w = h(parent(x)->left);
 
-        if (w->color == RBColor::Red) {
-          w->color = RBColor::Black;
-          parent(x)->color = RBColor::Red;
-          rotate_right(h(x)->parent);
+        if (w->get_color() == RBColor::Red) {
+          w->set_color(RBColor::Black);
+          parent(x)->set_color(RBColor::Red);
+          rotate_right(h(x)->get_parent());
           w = h(parent(x)->left);
         }
 
-        if (h(w->left)->color == RBColor::Black &&
-            h(w->right)->color == RBColor::Black) {
-          w->color = RBColor::Red;
-          x = h(x)->parent;
+        if (h(w->left)->get_color() == RBColor::Black &&
+            h(w->right)->get_color() == RBColor::Black) {
+          w->set_color(RBColor::Red);
+          x = h(x)->get_parent();
         } else {
-          if (h(w->left)->color == RBColor::Black) {
-            h(w->right)->color = RBColor::Black;
-            w->color = RBColor::Red;
+          if (h(w->left)->get_color() == RBColor::Black) {
+            h(w->right)->set_color(RBColor::Black);
+            w->set_color(RBColor::Red);
             rotate_left(raw(w));
             w = h(parent(x)->left);
           }
 
-          w->color = parent(x)->color;
-          h(w->left)->color = RBColor::Black;
-          parent(x)->color = RBColor::Black;
-          rotate_right(h(x)->parent);
+          w->set_color(parent(x)->get_color());
+          h(w->left)->set_color(RBColor::Black);
+          parent(x)->set_color(RBColor::Black);
+          rotate_right(h(x)->get_parent());
           x = root_;
         }
-        h(x)->color = RBColor::Black;
       }
     }
 
-    h(x)->color = RBColor::Black;
+    h(x)->set_color(RBColor::Black);
   }
 
   T *root_ = nullptr;
-  const RBTreeNode<T> nil_;
+
+  // Only kept up to date in a cached tree
+  T *first_ = nullptr;
+  T *last_ = nullptr;
+
+  // Stands for the missing children, and for the parent of the root. It's
+  // always black, but its parent is set during removals.
+  Hook nil_{};
 };
 
 } // namespace atlas
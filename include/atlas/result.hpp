@@ -2,7 +2,9 @@
 #include "base.hpp"
 #include "error.hpp"
 #include "panic.hpp"
+#include <memory>
 #include <source_location>
+#include <type_traits>
 #include <utility>
 
 namespace atlas {
@@ -28,18 +30,47 @@ public:
 template <typename T = None, typename E = Error> class [[nodiscard]] Result {
 
 public:
-  constexpr Result(Ok<T> &&value)
-      : variant_(std::move(value)), has_value_(true) {}
-  constexpr Result(const Ok<T> &value) : variant_(value), has_value_(true) {}
+  constexpr Result(Ok<T> &&value) : has_value_(true) {
+    std::construct_at(&value_, std::move(value));
+  }
+
+  constexpr Result(const Ok<T> &value) : has_value_(true) {
+    std::construct_at(&value_, value);
+  }
 
-  constexpr Result(Result<T, E> &&other)
-      : variant_(std::move(other.variant_)), has_value_(other.has_value_) {}
+  constexpr Result(Result<T, E> &&other) : has_value_(other.has_value_) {
+    if (has_value_) {
+      std::construct_at(&value_, std::move(other.value_));
+    } else {
+      std::construct_at(&error_, std::move(other.error_));
+    }
+  }
 
-  constexpr Result(Result<T, E> &other)
-      : variant_(other.variant_), has_value_(other.has_value_) {}
+  constexpr Result(Result<T, E> &other) : has_value_(other.has_value_) {
+    if (has_value_) {
+      std::construct_at(&value_, other.value_);
+    } else {
+      std::construct_at(&error_, other.error_);
+    }
+  }
+
+  constexpr Result(Err<E> error) : has_value_(false) {
+    std::construct_at(&error_, error);
+  }
 
-  constexpr Result(Err<E> error)
-      : variant_({.error = error}), has_value_(false) {}
+  // Values that need a destructor (e.g. containers) are destroyed here
+  constexpr ~Result()
+    requires(std::is_trivially_destructible_v<T> &&
+             std::is_trivially_destructible_v<E>)
+  = default;
+
+  constexpr ~Result() {
+    if (has_value_) {
+      value_.~Ok<T>();
+    } else {
+      error_.~Err<E>();
+    }
+  }
 
   constexpr explicit operator bool() const { return has_value_; }
   [[nodiscard]] constexpr bool is_ok() const { return has_value_; }
@@ -51,30 +82,40 @@ public:
       panic(msg, loc);
     }
 
-    return variant_.value.value;
+    return value_.value;
   }
 
   constexpr const T unwrap_or(T const other) const {
     if (has_value_) {
-      return variant_.value.value;
+      return value_.value;
     }
 
     return other;
   }
 
+  /// Move the value out, for values that can't be copied
+  constexpr T take(const char *msg = "Called 'take' on an error value",
+                   std::source_location loc = std::source_location::current()) {
+    if (!has_value_) [[unlikely]] {
+      panic(msg, loc);
+    }
+
+    return std::move(value_.value);
+  }
+
   constexpr const E &error() {
     if (has_value_) {
       panic("Called 'error' on an ok value");
     }
 
-    return variant_.error.value;
+    return error_.value;
   }
 
 private:
   union {
-    Ok<T> value;
-    Err<E> error;
-  } variant_;
+    Ok<T> value_;
+    Err<E> error_;
+  };
 
   bool has_value_;
 };
@@ -0,0 +1,146 @@
+#pragma once
+#include "hash.hpp"
+#include "impl.hpp"
+#include <atomic>
+
+namespace atlas {
+
+/*
+    SipHash, by Jean-Philippe Aumasson and Daniel J. Bernstein
+    C is the number of compression rounds per 8-byte block, D the number of
+    finalization rounds.
+*/
+template <size_t C, size_t D>
+inline uint64_t sip_hash(uint64_t k0, uint64_t k1, const void *key,
+                         size_t len) {
+  uint64_t v0 = 0x736f6d6570736575LLU ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dLLU ^ k1;
+  uint64_t v2 = 0x6c7967656e657261LLU ^ k0;
+  uint64_t v3 = 0x7465646279746573LLU ^ k1;
+
+  auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+
+  auto round = [&] {
+    v0 += v1;
+    v1 = rotl(v1, 13);
+    v1 ^= v0;
+    v0 = rotl(v0, 32);
+    v2 += v3;
+    v3 = rotl(v3, 16);
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl(v3, 21);
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl(v1, 17);
+    v1 ^= v2;
+    v2 = rotl(v2, 32);
+  };
+
+  auto p = static_cast<const uint8_t *>(key);
+  auto end = p + (len & ~size_t(7));
+
+  for (; p != end; p += 8) {
+    auto m = detail::read64(p);
+    v3 ^= m;
+    for (size_t i = 0; i < C; i++) {
+      round();
+    }
+    v0 ^= m;
+  }
+
+  uint64_t b = static_cast<uint64_t>(len) << 56;
+  for (size_t i = 0; i < (len & 7); i++) {
+    b |= static_cast<uint64_t>(p[i]) << (i * 8);
+  }
+
+  v3 ^= b;
+  for (size_t i = 0; i < C; i++) {
+    round();
+  }
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  for (size_t i = 0; i < D; i++) {
+    round();
+  }
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+inline uint64_t sip_hash13(uint64_t k0, uint64_t k1, const void *key,
+                           size_t len) {
+  return sip_hash<1, 3>(k0, k1, key, len);
+}
+
+struct SipKey {
+  uint64_t k0;
+  uint64_t k1;
+
+  /// The process wide secret, drawn from impl::random_seed() the first time
+  /// a keyed hasher is created
+  static const SipKey &process_key() {
+    static const SipKey key = {impl::random_seed(), impl::random_seed()};
+    return key;
+  }
+
+  /// Derive a fresh key from the process secret, so that every container
+  /// gets its own key and collisions found in one table don't carry over to
+  /// another
+  static SipKey make() {
+    static std::atomic<uint64_t> counter = 0;
+
+    auto &key = process_key();
+    auto n = counter.fetch_add(1, std::memory_order_relaxed);
+
+    return {key.k0 ^ mix_integer(n), key.k1 ^ mix_integer(n, 1)};
+  }
+};
+
+/// A keyed hash (SipHash-1-3) for tables indexed by untrusted input, where
+/// an attacker could otherwise pick keys that collide under the fixed seed
+/// of Hash and force long probe sequences or deep tries.
+/// Containers hold their hasher by value, so each container ends up with its
+/// own key. The `gen` argument is mixed into the key, so Hamt rehashing also
+/// stays keyed.
+template <typename T> struct SipHash;
+
+struct SipHasher {
+  SipKey key = SipKey::make();
+
+  uint64_t hash_bytes(const void *data, size_t len, size_t gen) const {
+    return sip_hash13(key.k0, key.k1 ^ gen, data, len);
+  }
+};
+
+template <std::integral T> struct SipHash<T> : SipHasher {
+  uint64_t operator()(T a, size_t gen = 0) const {
+    return hash_bytes(&a, sizeof(a), gen);
+  }
+};
+
+template <> struct SipHash<void *> : SipHasher {
+  uint64_t operator()(void *a, size_t gen = 0) const {
+    return hash_bytes(&a, sizeof(a), gen);
+  }
+};
+
+template <> struct SipHash<String> : SipHasher {
+  uint64_t operator()(const String &s, size_t gen = 0) const {
+    return hash_bytes(s.data(), s.length(), gen);
+  }
+};
+
+template <> struct SipHash<StringView> : SipHasher {
+  uint64_t operator()(const StringView &s, size_t gen = 0) const {
+    return hash_bytes(s.data(), s.length(), gen);
+  }
+};
+
+template <> struct SipHash<const char *> : SipHasher {
+  uint64_t operator()(const char *s, size_t gen = 0) const {
+    return hash_bytes(s, strlen(s), gen);
+  }
+};
+
+} // namespace atlas
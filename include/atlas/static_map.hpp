@@ -0,0 +1,243 @@
+#pragma once
+#include "base.hpp"
+#include "cons.hpp"
+#include "enum.hpp"
+#include "option.hpp"
+#include "panic.hpp"
+#include "string_view.hpp"
+#include <utility>
+
+namespace atlas {
+
+/// Hashing used when building a StaticMap, unlike Hash this has to be usable
+/// in constant expressions
+template <typename T> struct StaticHash;
+
+constexpr uint64_t static_mix(uint64_t x) {
+  // splitmix64 finalizer
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9LLU;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebLLU;
+  x ^= x >> 31;
+  return x;
+}
+
+template <std::integral T> struct StaticHash<T> {
+  constexpr uint64_t operator()(T a, uint64_t seed) const {
+    return static_mix(static_cast<uint64_t>(a) ^ static_mix(seed));
+  }
+};
+
+template <Enum T> struct StaticHash<T> {
+  constexpr uint64_t operator()(T a, uint64_t seed) const {
+    return StaticHash<std::underlying_type_t<T>>()(
+        static_cast<std::underlying_type_t<T>>(a), seed);
+  }
+};
+
+template <> struct StaticHash<StringView> {
+  constexpr uint64_t operator()(StringView s, uint64_t seed) const {
+    // FNV-1a, finalized so that the low bits are usable
+    uint64_t h = 0xcbf29ce484222325LLU ^ static_mix(seed);
+    for (auto c : s) {
+      h ^= static_cast<uint8_t>(c);
+      h *= 0x100000001b3LLU;
+    }
+    return static_mix(h ^ s.length());
+  }
+};
+
+/// An immutable map over a set of keys known at compile time
+/// The constructor searches for a perfect hash function (using the
+/// hash-and-displace method), so a lookup is one hash, one probe and one key
+/// comparison. Every key is hashed into one of `N / 2` buckets, and each
+/// bucket gets a displacement that sends its keys to distinct free slots of
+/// a table kept at most 80% full.
+/// Use `make_static_map` to build one, preferably in a constexpr variable so
+/// the search happens at compile time.
+template <typename K, typename V, size_t N, typename H = StaticHash<K>>
+  requires(N > 0)
+class StaticMap {
+
+public:
+  constexpr StaticMap(const Cons<K, V> (&entries)[N])
+      : StaticMap(entries, std::make_index_sequence<N>()) {}
+
+  [[nodiscard]] constexpr size_t size() const { return N; }
+
+  [[nodiscard]] constexpr Option<V> get(K key) const {
+    auto index = slots_[slot_for(H()(key, seed_))];
+
+    if (index == EMPTY || !(entries_[index].car == key)) {
+      return NONE;
+    }
+
+    return V(entries_[index].cdr);
+  }
+
+  [[nodiscard]] constexpr bool contains(K key) const {
+    return get(key).is_some();
+  }
+
+  [[nodiscard]] constexpr V operator[](K key) const {
+    return get(key).unwrap();
+  }
+
+private:
+  // A full table leaves the last buckets almost no free slots to land on
+  static constexpr size_t table_size() {
+    size_t size = 1;
+    while (size * 4 < N * 5) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  static constexpr size_t TABLE_SIZE = table_size();
+  static constexpr size_t BUCKETS = (N + 1) / 2;
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+
+  // Bound the search so that a bad key set fails to compile instead of
+  // exhausting the constant evaluator
+  static constexpr uint32_t MAX_SEEDS = 64;
+  static constexpr uint32_t MAX_DISPLACEMENTS = 1 << 12;
+
+  Cons<K, V> entries_[N];
+  uint32_t slots_[TABLE_SIZE] = {};
+  uint32_t displacements_[BUCKETS] = {};
+  uint64_t seed_ = 0;
+
+  template <size_t... I>
+  constexpr StaticMap(const Cons<K, V> (&entries)[N],
+                      std::index_sequence<I...>)
+      : entries_{entries[I]...} {
+    for (uint64_t seed = 0; seed < MAX_SEEDS; seed++) {
+      if (build(seed)) {
+        return;
+      }
+    }
+
+    panic("Couldn't find a perfect hash for StaticMap (duplicate keys?)");
+  }
+
+  [[nodiscard]] constexpr size_t bucket_for(uint64_t hash) const {
+    return (hash >> 32) % BUCKETS;
+  }
+
+  [[nodiscard]] static constexpr size_t displaced_slot(uint64_t hash,
+                                                       uint32_t d) {
+    return static_mix(hash ^ d) & (TABLE_SIZE - 1);
+  }
+
+  [[nodiscard]] constexpr size_t slot_for(uint64_t hash) const {
+    return displaced_slot(hash, displacements_[bucket_for(hash)]);
+  }
+
+  constexpr bool build(uint64_t seed) {
+    uint64_t hashes[N] = {};
+    // The keys grouped by bucket, bucket b holds members[starts[b]] up to
+    // members[starts[b + 1]]
+    uint32_t members[N] = {};
+    size_t starts[BUCKETS + 1] = {};
+    size_t cursors[BUCKETS] = {};
+    // The buckets by decreasing size, sizes range from 0 to N
+    uint32_t order[BUCKETS] = {};
+    size_t size_starts[N + 2] = {};
+
+    seed_ = seed;
+
+    for (size_t i = 0; i < N; i++) {
+      hashes[i] = H()(entries_[i].car, seed);
+      starts[bucket_for(hashes[i]) + 1]++;
+    }
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+      starts[b + 1] += starts[b];
+      cursors[b] = starts[b];
+    }
+
+    for (size_t i = 0; i < N; i++) {
+      members[cursors[bucket_for(hashes[i])]++] = i;
+    }
+
+    // Place the biggest buckets first, while the table is still mostly empty
+    for (size_t b = 0; b < BUCKETS; b++) {
+      size_starts[N - bucket_size(starts, b) + 1]++;
+    }
+
+    for (size_t i = 0; i <= N; i++) {
+      size_starts[i + 1] += size_starts[i];
+    }
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+      order[size_starts[N - bucket_size(starts, b)]++] = b;
+    }
+
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+      slots_[i] = EMPTY;
+    }
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+      displacements_[b] = 0;
+    }
+
+    for (size_t b = 0; b < BUCKETS; b++) {
+      auto bucket = order[b];
+      auto size = bucket_size(starts, bucket);
+
+      if (size == 0) {
+        break;
+      }
+
+      if (!place_bucket(bucket, members + starts[bucket], size, hashes)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static constexpr size_t bucket_size(const size_t (&starts)[BUCKETS + 1],
+                                      size_t bucket) {
+    return starts[bucket + 1] - starts[bucket];
+  }
+
+  // Find a displacement that sends the `count` keys of the bucket to free
+  // slots
+  constexpr bool place_bucket(size_t bucket, const uint32_t *keys,
+                              size_t count, const uint64_t (&hashes)[N]) {
+    for (uint32_t d = 0; d < MAX_DISPLACEMENTS; d++) {
+      size_t placed = 0;
+
+      for (; placed < count; placed++) {
+        auto slot = displaced_slot(hashes[keys[placed]], d);
+
+        if (slots_[slot] != EMPTY) {
+          break;
+        }
+
+        slots_[slot] = keys[placed];
+      }
+
+      if (placed == count) {
+        displacements_[bucket] = d;
+        return true;
+      }
+
+      // Undo the partial placement
+      for (size_t i = 0; i < placed; i++) {
+        slots_[displaced_slot(hashes[keys[i]], d)] = EMPTY;
+      }
+    }
+
+    return false;
+  }
+};
+
+template <typename K, typename V, size_t N>
+constexpr StaticMap<K, V, N> make_static_map(const Cons<K, V> (&entries)[N]) {
+  return StaticMap<K, V, N>(entries);
+}
+
+} // namespace atlas
@@ -0,0 +1,272 @@
+#pragma once
+#include "alloc.hpp"
+#include "assert.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace atlas {
+
+/// Memory used by a TablePool, `classes[i]` describes the tables of `i + 1`
+/// elements
+template <size_t MaxCount> struct TablePoolStats {
+  struct SizeClass {
+    // Bytes of the tables that are handed out
+    size_t used_bytes;
+
+    // Bytes of the tables waiting in the freelist
+    size_t free_bytes;
+  };
+
+  SizeClass classes[MaxCount];
+
+  // Bytes reserved from the allocator, including slab headers
+  size_t slab_bytes;
+
+  [[nodiscard]] size_t used_bytes() const {
+    size_t ret = 0;
+    for (auto &size_class : classes) {
+      ret += size_class.used_bytes;
+    }
+    return ret;
+  }
+};
+
+/// Allocates arrays (tables) of 1 to `MaxCount` elements of `T`
+/// Tables of each size come from their own freelist, which is refilled by
+/// carving a slab of tables out of a single allocation. Every new slab of a
+/// size class holds twice as many tables as the previous one (up to
+/// MAX_SLAB_BYTES), so a container that keeps resizing its tables by one
+/// element only hits the allocator a logarithmic number of times.
+/// Slabs are handed back to the allocator by trim() once all their tables
+/// are free, and when the pool is destroyed.
+template <typename T, size_t MaxCount, Allocator A = DefaultAllocator>
+class TablePool {
+
+public:
+  TablePool(A alloc = A()) : alloc_(alloc) {}
+
+  TablePool(TablePool &&other) : alloc_(std::move(other.alloc_)) {
+    for (size_t i = 0; i < MaxCount; i++) {
+      classes_[i] = other.classes_[i];
+      other.classes_[i] = {};
+    }
+  }
+
+  TablePool(const TablePool &other) = delete;
+  TablePool &operator=(const TablePool &other) = delete;
+
+  ~TablePool() {
+    for (auto &size_class : classes_) {
+      while (size_class.slabs != nullptr) {
+        auto next = size_class.slabs->next;
+        alloc_.deallocate(size_class.slabs, size_class.slabs->bytes);
+        size_class.slabs = next;
+      }
+    }
+  }
+
+  [[nodiscard]] T *allocate(size_t count) {
+    ENSURE(count > 0 && count <= MaxCount, "invalid table size");
+
+    auto &size_class = classes_[count - 1];
+
+    if (size_class.free == nullptr) {
+      grow(count);
+    }
+
+    auto table = size_class.free;
+    size_class.free = table->next;
+    size_class.free_count--;
+    size_class.used_count++;
+
+    return reinterpret_cast<T *>(table);
+  }
+
+  void deallocate(T *table, size_t count) {
+    ENSURE(count > 0 && count <= MaxCount, "invalid table size");
+
+    auto &size_class = classes_[count - 1];
+    auto free = reinterpret_cast<FreeTable *>(table);
+
+    free->next = size_class.free;
+    size_class.free = free;
+    size_class.free_count++;
+    size_class.used_count--;
+  }
+
+  [[nodiscard]] TablePoolStats<MaxCount> stats() const {
+    TablePoolStats<MaxCount> ret = {};
+
+    for (size_t i = 0; i < MaxCount; i++) {
+      auto table_bytes = (i + 1) * sizeof(T);
+      ret.classes[i].used_bytes = classes_[i].used_count * table_bytes;
+      ret.classes[i].free_bytes = classes_[i].free_count * table_bytes;
+    }
+
+    for (auto &size_class : classes_) {
+      for (auto slab = size_class.slabs; slab != nullptr; slab = slab->next) {
+        ret.slab_bytes += slab->bytes;
+      }
+    }
+
+    return ret;
+  }
+
+  /// Hand the slabs whose tables are all free back to the allocator, this
+  /// takes O(f log f + s log s) for f free tables and s slabs
+  void trim() {
+    for (size_t count = 1; count <= MaxCount; count++) {
+      trim_class(count);
+    }
+  }
+
+private:
+  static constexpr size_t MIN_SLAB_TABLES = 4;
+  static constexpr size_t MAX_SLAB_BYTES = 64 * 1024;
+
+  // A free table stores the next one of its freelist in its first bytes
+  struct FreeTable {
+    FreeTable *next;
+  };
+
+  static_assert(sizeof(T) >= sizeof(FreeTable), "T is too small to pool");
+
+  struct Slab {
+    Slab *next;
+    size_t bytes;
+  };
+
+  static constexpr size_t SLAB_HEADER =
+      (sizeof(Slab) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+  struct SizeClass {
+    Slab *slabs = nullptr;
+    FreeTable *free = nullptr;
+    size_t free_count = 0;
+    size_t used_count = 0;
+    size_t next_slab_tables = MIN_SLAB_TABLES;
+  };
+
+  A alloc_;
+  SizeClass classes_[MaxCount];
+
+  void grow(size_t count) {
+    auto &size_class = classes_[count - 1];
+    auto tables = size_class.next_slab_tables;
+    auto table_bytes = count * sizeof(T);
+    auto bytes = SLAB_HEADER + tables * table_bytes;
+
+    auto slab = reinterpret_cast<Slab *>(alloc_.allocate(bytes));
+    slab->next = size_class.slabs;
+    slab->bytes = bytes;
+    size_class.slabs = slab;
+
+    auto data = reinterpret_cast<uint8_t *>(slab) + SLAB_HEADER;
+
+    // Push the tables backwards, so that they're handed out in address order
+    for (size_t i = tables; i > 0; i--) {
+      auto free = reinterpret_cast<FreeTable *>(data + (i - 1) * table_bytes);
+      free->next = size_class.free;
+      size_class.free = free;
+    }
+
+    size_class.free_count += tables;
+
+    if (tables * 2 * table_bytes <= MAX_SLAB_BYTES) {
+      size_class.next_slab_tables = tables * 2;
+    }
+  }
+
+  void trim_class(size_t count) {
+    auto &size_class = classes_[count - 1];
+
+    if (size_class.free == nullptr) {
+      return;
+    }
+
+    // With both lists in address order, the free tables of each slab come
+    // right after the ones of the previous slab, so one pass counts them.
+    // This also hands out the remaining tables in address order again.
+    auto table_bytes = count * sizeof(T);
+    auto slabs = sort_by_address(size_class.slabs);
+    auto free = sort_by_address(size_class.free);
+    auto slab_tail = &size_class.slabs;
+    auto free_tail = &size_class.free;
+
+    while (slabs != nullptr) {
+      auto slab = slabs;
+      slabs = slab->next;
+
+      auto end = address(slab) + slab->bytes;
+      auto first = free;
+      FreeTable *last = nullptr;
+      size_t free_tables = 0;
+
+      while (free != nullptr && address(free) < end) {
+        last = free;
+        free = free->next;
+        free_tables++;
+      }
+
+      if (free_tables == (slab->bytes - SLAB_HEADER) / table_bytes) {
+        alloc_.deallocate(slab, slab->bytes);
+        size_class.free_count -= free_tables;
+        continue;
+      }
+
+      *slab_tail = slab;
+      slab_tail = &slab->next;
+
+      if (last != nullptr) {
+        *free_tail = first;
+        free_tail = &last->next;
+      }
+    }
+
+    *slab_tail = nullptr;
+    *free_tail = nullptr;
+
+    if (size_class.slabs == nullptr) {
+      size_class.next_slab_tables = MIN_SLAB_TABLES;
+    }
+  }
+
+  template <typename N> static uintptr_t address(N *node) {
+    return reinterpret_cast<uintptr_t>(node);
+  }
+
+  // Merge sort a list linked through `next` by address
+  template <typename N> static N *sort_by_address(N *list) {
+    if (list == nullptr || list->next == nullptr) {
+      return list;
+    }
+
+    auto middle = list;
+    for (auto fast = list->next; fast != nullptr && fast->next != nullptr;
+         fast = fast->next->next) {
+      middle = middle->next;
+    }
+
+    auto second = middle->next;
+    middle->next = nullptr;
+
+    auto a = sort_by_address(list);
+    auto b = sort_by_address(second);
+    N *ret = nullptr;
+    auto tail = &ret;
+
+    while (a != nullptr && b != nullptr) {
+      auto &smaller = address(a) < address(b) ? a : b;
+      *tail = smaller;
+      tail = &smaller->next;
+      smaller = smaller->next;
+    }
+
+    *tail = a != nullptr ? a : b;
+
+    return ret;
+  }
+};
+
+} // namespace atlas
@@ -87,13 +87,28 @@ public:
     return TupleAccessor_<n, Ts...>::get(storage_);
   }
 
+  constexpr bool operator==(const Tuple<Ts...> &other) const {
+    return equal(other, std::make_integer_sequence<int, sizeof...(Ts)>());
+  }
+
 private:
   TupleStorage_<Ts...> storage_;
+
+  template <int... I>
+  constexpr bool equal(const Tuple<Ts...> &other,
+                       std::integer_sequence<int, I...>) const {
+    return ((get<I>() == other.template get<I>()) && ...);
+  }
 };
 
-template <> class Tuple<> {};
+template <> class Tuple<> {
+public:
+  constexpr bool operator==(const Tuple<> &) const { return true; }
+};
 
 static_assert(Tuple<int, int>{10, 0}.get<0>() == 10);
 static_assert(Tuple<int, int>{10, 0}.get<1>() == 0);
+static_assert(Tuple<int, int>{10, 0} == Tuple<int, int>{10, 0});
+static_assert(!(Tuple<int, int>{10, 0} == Tuple<int, int>{10, 1}));
 
 } // namespace atlas
@@ -17,13 +17,15 @@ public:
       new (&data_[i]) T();
   }
 
-  Vec(const Vec &other) : size_(other.size_), alloc_(other.alloc_) {
+  Vec(const Vec &other)
+      : size_(other.size_), capacity_(other.size_), alloc_(other.alloc_) {
     data_ = reinterpret_cast<T *>(alloc_.allocate(sizeof(T) * other.size_));
     for (size_t i = 0; i < size_; i++)
       new (&data_[i]) T(other.data_[i]);
   }
 
-  Vec(Vec &&other) : alloc_(other.alloc_) {
+  Vec(Vec &&other)
+      : data_(nullptr), size_(0), capacity_(0), alloc_(other.alloc_) {
     std::swap(data_, other.data_);
     std::swap(size_, other.size_);
     std::swap(capacity_, other.capacity_);
@@ -66,7 +68,8 @@ public:
     for (size_t i = 0; i < size_; i++)
       data_[i].~T();
 
-    alloc_.deallocate(data_, size_ * sizeof(T));
+    if (data_)
+      alloc_.deallocate(data_, capacity_ * sizeof(T));
 
     capacity_ = new_capacity;
     data_ = new_data;
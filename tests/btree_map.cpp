@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <atlas/btree_map.hpp>
+#include <atlas/string.hpp>
+#include <cstdio>
+#include <doctest.h>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace atlas;
+
+static size_t live_bytes = 0;
+
+struct CountingAllocator : DefaultAllocator {
+  void *allocate(size_t size) {
+    live_bytes += size;
+    return DefaultAllocator::allocate(size);
+  }
+
+  void deallocate(void *ptr, size_t size) {
+    live_bytes -= size;
+    DefaultAllocator::deallocate(ptr, size);
+  }
+};
+
+TEST_SUITE("BTreeMap") {
+  TEST_CASE("insert/get") {
+    BTreeMap<size_t, size_t> map;
+
+    for (size_t i = 0; i < 10000; i++) {
+      CHECK(map.insert(i * 7 % 10000, i));
+    }
+
+    CHECK(map.size() == 10000);
+    CHECK_FALSE(map.insert(5, 0));
+
+    for (size_t i = 0; i < 10000; i++) {
+      CHECK(map.get(i * 7 % 10000).unwrap() == i);
+    }
+
+    CHECK(map.get(10000).is_none());
+    CHECK(map[7] == 1);
+    CHECK_THROWS((void)map[10000]);
+  }
+
+  TEST_CASE("iter") {
+    BTreeMap<int64_t, int64_t> map;
+
+    CHECK(map.iter().next().is_none());
+
+    for (int64_t i = 1000; i > -1000; i--) {
+      CHECK(map.insert(i, -i));
+    }
+
+    int64_t expected = -999;
+
+    map.iter().for_each([&](Cons<int64_t, int64_t> entry) {
+      CHECK(entry.car == expected);
+      CHECK(entry.cdr == -expected);
+      expected++;
+    });
+
+    CHECK(expected == 1001);
+  }
+
+  TEST_CASE("range") {
+    BTreeMap<size_t, size_t> map;
+
+    for (size_t i = 0; i < 5000; i += 2) {
+      CHECK(map.insert(i, i));
+    }
+
+    std::vector<size_t> keys;
+    map.range(101, 401).for_each(
+        [&](Cons<size_t, size_t> entry) { keys.push_back(entry.car); });
+
+    CHECK(keys.size() == 150);
+    CHECK(keys.front() == 102);
+    CHECK(keys.back() == 400);
+
+    // Bounds that are keys
+    keys.clear();
+    map.range(100, 110).for_each(
+        [&](Cons<size_t, size_t> entry) { keys.push_back(entry.car); });
+
+    CHECK(keys == std::vector<size_t>{100, 102, 104, 106, 108});
+
+    CHECK(map.range(5000, 6000).next().is_none());
+    CHECK(map.range(7, 8).next().is_none());
+    CHECK(map.range(0, 1).next().unwrap().car == 0);
+  }
+
+  TEST_CASE("remove") {
+    {
+      BTreeMap<uint64_t, uint64_t, CountingAllocator> map;
+      std::map<uint64_t, uint64_t> reference;
+      std::mt19937_64 rng(42);
+
+      for (size_t i = 0; i < 20000; i++) {
+        auto key = rng() % 5000;
+
+        if (rng() % 3 == 0) {
+          CHECK(map.remove(key).is_ok() == (reference.erase(key) == 1));
+        } else {
+          CHECK(map.insert(key, i).is_ok() ==
+                reference.insert({key, i}).second);
+        }
+      }
+
+      CHECK(map.size() == reference.size());
+
+      auto it = reference.begin();
+      map.iter().for_each([&](Cons<uint64_t, uint64_t> entry) {
+        CHECK(entry.car == it->first);
+        CHECK(entry.cdr == it->second);
+        it++;
+      });
+
+      CHECK(it == reference.end());
+
+      for (auto &[key, value] : reference) {
+        CHECK(map.remove(key));
+      }
+
+      CHECK(map.empty());
+      CHECK_FALSE(map.remove(0));
+      CHECK(live_bytes == 0);
+
+      CHECK(map.insert(1, 1));
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("String keys") {
+    {
+      BTreeMap<String, String, CountingAllocator> map;
+      char key[32];
+
+      for (size_t i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "a long enough key %03zu", i);
+        CHECK(map.insert(String(key), String(key)));
+      }
+
+      for (size_t i = 0; i < 500; i += 2) {
+        snprintf(key, sizeof(key), "a long enough key %03zu", i);
+        CHECK(map.remove(String(key)));
+      }
+
+      CHECK(map.get(String("a long enough key 001")).unwrap() ==
+            "a long enough key 001");
+      CHECK(map.get(String("a long enough key 002")).is_none());
+
+      size_t count = 0;
+      auto in_range = map.range(String("a long enough key 100"),
+                                String("a long enough key 200"));
+      in_range.for_each(
+          [&](const Cons<const String &, const String &> &) { count++; });
+
+      CHECK(count == 50);
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("reference iteration") {
+    BTreeMap<int, int> map;
+
+    for (int i = 0; i < 1000; i++) {
+      CHECK(map.insert(i, i));
+    }
+
+    // Entries refer to the values stored in the map
+    auto first = map.iter().next().unwrap();
+    CHECK(&first.cdr == &map.iter().next().unwrap().cdr);
+    CHECK(&map.range(0, 1).next().unwrap().cdr == &first.cdr);
+
+    for (auto entry : map.iter_mut()) {
+      entry.cdr *= 2;
+    }
+
+    CHECK(map.get(21).unwrap() == 42);
+    CHECK(map.range(500, 501).next().unwrap().cdr == 1000);
+  }
+
+  TEST_CASE("C string keys") {
+    BTreeMap<const char *, int> map;
+    char hello[] = "hello";
+
+    CHECK(map.insert("world", 2));
+    CHECK(map.insert("hello", 1));
+    CHECK_FALSE(map.insert(hello, 3));
+
+    CHECK(map.get(hello).unwrap() == 1);
+    CHECK(map.iter().next().unwrap().cdr == 1);
+  }
+}
@@ -26,5 +26,6 @@ TEST_SUITE("Cons") {
     Cons<int, int> c2(1, 2);
     CHECK(c == c2);
     CHECK(c != Cons<int, int>(2, 1));
+    static_assert(Cons<int, int>(1, 2) == Cons<int, int>(1, 2));
   }
 }
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include <atlas/ctrie.hpp>
+#include <atlas/string.hpp>
+#include <atomic>
+#include <doctest.h>
+#include <thread>
+#include <vector>
+
+using namespace atlas;
+
+static std::atomic<size_t> ctrie_mem = 0;
+
+struct CountingAllocator : DefaultAllocator {
+  void *allocate(size_t size) {
+    ctrie_mem += size;
+    return DefaultAllocator::allocate(size);
+  }
+
+  void deallocate(void *ptr, size_t size) {
+    ctrie_mem -= size;
+    DefaultAllocator::deallocate(ptr, size);
+  }
+};
+
+TEST_SUITE("Ctrie") {
+  TEST_CASE("insert/get") {
+    Ctrie<size_t, size_t> ctrie;
+
+    for (size_t i = 0; i < 1000; i++) {
+      ctrie.insert(i, i * 2);
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK(ctrie.get(i).unwrap() == i * 2);
+    }
+
+    CHECK(ctrie.get(1000).is_none());
+
+    ctrie.insert(7, 1);
+    CHECK(ctrie.get(7).unwrap() == 1);
+  }
+
+  TEST_CASE("remove") {
+    Ctrie<size_t, size_t> ctrie;
+
+    for (size_t i = 0; i < 1000; i++) {
+      ctrie.insert(i, i);
+    }
+
+    for (size_t i = 0; i < 1000; i += 2) {
+      CHECK(ctrie.remove(i));
+    }
+
+    CHECK_FALSE(ctrie.remove(0));
+
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK(ctrie.get(i).is_some() == (i % 2 == 1));
+    }
+
+    for (size_t i = 1; i < 1000; i += 2) {
+      CHECK(ctrie.remove(i));
+    }
+
+    CHECK(ctrie.get(1).is_none());
+  }
+
+  TEST_CASE("snapshots") {
+    Ctrie<size_t, size_t> ctrie;
+
+    for (size_t i = 0; i < 100; i++) {
+      ctrie.insert(i, i);
+    }
+
+    auto snapshot = ctrie.snapshot();
+
+    for (size_t i = 0; i < 100; i += 2) {
+      CHECK(ctrie.remove(i));
+    }
+    ctrie.insert(1, 10);
+    ctrie.insert(200, 200);
+
+    snapshot.insert(300, 300);
+
+    for (size_t i = 0; i < 100; i++) {
+      CHECK(snapshot.get(i).unwrap() == i);
+    }
+
+    CHECK(snapshot.get(200).is_none());
+    CHECK(ctrie.get(300).is_none());
+    CHECK(ctrie.get(1).unwrap() == 10);
+    CHECK(ctrie.get(2).is_none());
+    CHECK(ctrie.get(200).unwrap() == 200);
+  }
+
+  TEST_CASE("Collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    Ctrie<uint64_t, uint64_t, DefaultAllocator, FakeHash> ctrie;
+
+    for (uint64_t i = 1; i <= 4; i++) {
+      ctrie.insert(i, i);
+    }
+
+    CHECK(ctrie.remove(1));
+    CHECK(ctrie.get(1).is_none());
+    CHECK(ctrie.get(4).unwrap() == 4);
+  }
+
+  TEST_CASE("String keys") {
+    Ctrie<String, size_t> ctrie;
+    ctrie.insert(String("hello"), 1);
+    ctrie.insert(String("world"), 2);
+
+    CHECK(ctrie.get(String("hello")).unwrap() == 1);
+    CHECK(ctrie.remove(String("world")));
+    CHECK(ctrie.get(String("world")).is_none());
+  }
+
+  TEST_CASE("concurrent updates") {
+    Ctrie<size_t, size_t> ctrie;
+    std::vector<std::thread> threads;
+
+    constexpr size_t THREADS = 4;
+    constexpr size_t KEYS = 2000;
+
+    // Every thread inserts its own keys, and removes half of them again,
+    // while looking up the keys of the others
+    for (size_t t = 0; t < THREADS; t++) {
+      threads.emplace_back([&ctrie, t] {
+        for (size_t i = t; i < KEYS; i += THREADS) {
+          ctrie.insert(i, i);
+          (void)ctrie.get(i + 1);
+        }
+
+        for (size_t i = t; i < KEYS; i += THREADS) {
+          if (i % 2 == 0) {
+            (void)ctrie.remove(i);
+          }
+        }
+      });
+    }
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    for (size_t i = 0; i < KEYS; i++) {
+      CHECK(ctrie.get(i).is_some() == (i % 2 == 1));
+    }
+  }
+
+  TEST_CASE("replaced nodes are reused") {
+    {
+      Ctrie<size_t, String, CountingAllocator> ctrie;
+
+      for (size_t i = 0; i < 100; i++) {
+        ctrie.insert(i, String("key"));
+      }
+
+      // Replace values, and add and remove keys over and over: once the
+      // first round has filled the free lists, the trie stops growing
+      auto churn = [&ctrie] {
+        for (size_t i = 0; i < 1000; i++) {
+          ctrie.insert(i % 100, String("value"));
+          ctrie.insert(100 + i, String("extra"));
+          CHECK(ctrie.remove(100 + i));
+        }
+      };
+
+      churn();
+      auto mem = ctrie_mem.load();
+
+      for (size_t round = 0; round < 20; round++) {
+        churn();
+      }
+
+      CHECK(ctrie_mem.load() == mem);
+
+      for (size_t i = 0; i < 100; i++) {
+        CHECK(ctrie.get(i).unwrap() == String("value"));
+      }
+
+      CHECK(ctrie.get(100).is_none());
+    }
+
+    CHECK(ctrie_mem.load() == 0);
+  }
+
+  TEST_CASE("nodes shared with a snapshot are kept") {
+    {
+      Ctrie<size_t, size_t, CountingAllocator> ctrie;
+
+      for (size_t i = 0; i < 100; i++) {
+        ctrie.insert(i, i);
+      }
+
+      auto churn = [&ctrie](size_t value) {
+        for (size_t i = 0; i < 1000; i++) {
+          ctrie.insert(i % 100, value);
+        }
+      };
+
+      auto mem = ctrie_mem.load();
+
+      {
+        auto snapshot = ctrie.snapshot();
+        churn(1);
+
+        // Replaced keys may still be part of the snapshot
+        CHECK(ctrie_mem.load() > mem);
+
+        for (size_t i = 0; i < 100; i++) {
+          CHECK(snapshot.get(i).unwrap() == i);
+        }
+      }
+
+      // Reclaiming resumes once the snapshot is gone
+      churn(2);
+      mem = ctrie_mem.load();
+      churn(3);
+      CHECK(ctrie_mem.load() == mem);
+      CHECK(ctrie.get(0).unwrap() == 3);
+    }
+
+    CHECK(ctrie_mem.load() == 0);
+  }
+
+  TEST_CASE("snapshots only keep their generations and root") {
+    {
+      Ctrie<size_t, size_t, CountingAllocator> ctrie;
+
+      for (size_t i = 0; i < 100; i++) {
+        ctrie.insert(i, i);
+      }
+
+      auto take = [&ctrie](size_t n) {
+        for (size_t i = 0; i < n; i++) {
+          auto snapshot = ctrie.snapshot();
+        }
+      };
+
+      take(10);
+      auto mem = ctrie_mem.load();
+      take(1000);
+
+      // The replaced roots and the RDCSS descriptors are reused, what's left
+      // is two generations and an INode, each in a block of 64 bytes at most
+      CHECK(ctrie_mem.load() - mem <= 1000 * 3 * 64);
+    }
+
+    CHECK(ctrie_mem.load() == 0);
+  }
+
+  TEST_CASE("reclaiming under concurrent updates") {
+    {
+      Ctrie<size_t, String, CountingAllocator> ctrie;
+      std::atomic<size_t> mismatches = 0;
+
+      constexpr size_t THREADS = 4;
+      constexpr size_t KEYS = THREADS * 64;
+
+      // Values live on the heap, reading one after its node was reused would
+      // read freed memory
+      const char *values[] = {"the first value, which doesn't fit inline",
+                              "the second value, which doesn't fit inline"};
+
+      // Every thread churns its own keys, and reads the keys of the others
+      auto churn = [&](size_t rounds) {
+        std::vector<std::thread> threads;
+
+        for (size_t t = 0; t < THREADS; t++) {
+          threads.emplace_back([&, t] {
+            for (size_t i = 0; i < rounds; i++) {
+              size_t key = t + THREADS * (i % 64);
+              ctrie.insert(key, String(values[i % 2]));
+
+              if (auto other = ctrie.get((key + 1) % KEYS)) {
+                mismatches += !(other.unwrap() == values[0]) &&
+                              !(other.unwrap() == values[1]);
+              }
+
+              if (i % 4 == 0) {
+                mismatches += !ctrie.remove(key);
+              }
+            }
+          });
+        }
+
+        for (auto &thread : threads) {
+          thread.join();
+        }
+      };
+
+      for (size_t round = 0; round < 4; round++) {
+        churn(64 * 80);
+      }
+
+      CHECK(mismatches == 0);
+
+      // A thread that is preempted in the middle of an operation holds back
+      // reuse, so only check that the nodes retired meanwhile are reused once
+      // the threads are done
+      auto update_all = [&ctrie] {
+        for (size_t key = 0; key < KEYS; key++) {
+          ctrie.insert(key, String("a value, for a key of any thread"));
+          ctrie.insert(key, String("another value for the same key"));
+        }
+      };
+
+      update_all();
+      auto mem = ctrie_mem.load();
+
+      for (size_t round = 0; round < 20; round++) {
+        update_all();
+      }
+
+      CHECK(ctrie_mem.load() == mem);
+
+      for (size_t key = 0; key < KEYS; key++) {
+        CHECK(ctrie.get(key).unwrap() == "another value for the same key");
+      }
+    }
+
+    CHECK(ctrie_mem.load() == 0);
+  }
+
+  TEST_CASE("snapshots under concurrent inserts") {
+    Ctrie<size_t, size_t> ctrie;
+
+    std::thread writer([&ctrie] {
+      for (size_t i = 0; i < 5000; i++) {
+        ctrie.insert(i, i);
+      }
+    });
+
+    // Keys are inserted in order, so a snapshot must hold a prefix of them
+    for (size_t n = 0; n < 20; n++) {
+      auto snapshot = ctrie.snapshot();
+      size_t count = 0;
+
+      while (snapshot.get(count).is_some()) {
+        count++;
+      }
+
+      CHECK(snapshot.get(count + 1).is_none());
+    }
+
+    writer.join();
+    CHECK(ctrie.get(4999).unwrap() == 4999);
+  }
+}
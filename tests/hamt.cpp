@@ -1,7 +1,10 @@
 #include "atlas/alloc.hpp"
 #include <atlas/hamt.hpp>
 #include <atlas/hashmap.hpp>
+#include <atlas/string.hpp>
+#include <algorithm>
 #include <csignal>
+#include <cstdio>
 #include <doctest.h>
 #include <iostream>
 #include <unordered_map>
@@ -74,6 +77,25 @@ TEST_SUITE("hamt") {
     }
   }
 
+  TEST_CASE("get_many") {
+    size_t keys[150];
+    Option<size_t> out[150];
+
+    for (size_t i = 0; i < 150; i++) {
+      keys[i] = i;
+    }
+
+    hamt.get_many(Slice<const size_t>(keys, 150),
+                  Slice<Option<size_t>>(out, 150));
+
+    for (size_t i = 0; i < 150; i++) {
+      CHECK(out[i] == hamt.get(i));
+    }
+
+    CHECK(out[99].is_some());
+    CHECK(out[100].is_none());
+  }
+
   TEST_CASE("remove") {
     Hamt<size_t, size_t, TracingAllocator> other;
     other.insert(78, 1);
@@ -100,14 +122,151 @@ TEST_SUITE("hamt") {
     CHECK_FALSE(other.get(954).is_some());
     CHECK(other.remove(772812588));
     CHECK_FALSE(other.get(772812588).is_some());
+    // Only the root is left, every table went back to the pool
+    CHECK(other.pool_stats().used_bytes() == 0);
+    CHECK(allocated_mem == 16 + other.pool_stats().slab_bytes);
+
+    // And from the pool to the allocator
+    other.trim();
+    CHECK(other.pool_stats().slab_bytes == 0);
     CHECK(allocated_mem == 16);
+
     other.insert(78, 1);
-    CHECK(allocated_mem == 32);
+    CHECK(other.pool_stats().used_bytes() == 16);
 
     CHECK(other.get(5460).is_none());
     CHECK_FALSE(other.get(1812219).is_some());
   }
 
+  TEST_CASE("table pool") {
+    auto allocs_before = alloc_count;
+
+    {
+      Hamt<size_t, size_t, TracingAllocator> pooled;
+
+      for (size_t i = 0; i < 10000; i++) {
+        pooled.insert(i, i);
+      }
+
+      auto stats = pooled.pool_stats();
+      size_t free_bytes = 0;
+
+      for (auto &size_class : stats.classes) {
+        free_bytes += size_class.free_bytes;
+      }
+
+      // The pool handed out every table from a few slabs
+      CHECK(stats.used_bytes() > 0);
+      CHECK(stats.used_bytes() + free_bytes <= stats.slab_bytes);
+      CHECK(alloc_count - allocs_before < 200);
+
+      for (size_t i = 0; i < 10000; i++) {
+        CHECK(pooled.remove(i));
+      }
+
+      CHECK(pooled.pool_stats().used_bytes() == 0);
+
+      pooled.trim();
+      CHECK(pooled.pool_stats().slab_bytes == 0);
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
+  TEST_CASE("trim and clear") {
+    auto check_shrink = [](auto &h) {
+      constexpr size_t COUNT = 100000;
+      auto before = allocated_mem;
+
+      for (size_t i = 0; i < COUNT; i++) {
+        h.insert(i, i);
+      }
+
+      auto peak = h.pool_stats().slab_bytes;
+      auto peak_mem = allocated_mem;
+
+      // Keep one key out of 10, so most slabs still hold a table or two
+      for (size_t i = 0; i < COUNT; i++) {
+        if (i % 10 != 0) {
+          CHECK(h.remove(i));
+        }
+      }
+
+      CHECK(h.pool_stats().slab_bytes == peak);
+      h.trim();
+
+      auto stats = h.pool_stats();
+      CHECK(stats.slab_bytes < peak);
+      CHECK(stats.used_bytes() <= stats.slab_bytes);
+      CHECK(allocated_mem < peak_mem);
+
+      for (size_t i = 0; i < COUNT; i++) {
+        CHECK(h.get(i).is_some() == (i % 10 == 0));
+      }
+
+      // The tables left in the pool are still handed out
+      for (size_t i = 0; i < COUNT; i++) {
+        if (i % 10 != 0) {
+          h.insert(i, i + 1);
+        }
+      }
+
+      CHECK(h.size() == COUNT);
+      CHECK(h.get(COUNT - 1).unwrap() == COUNT);
+
+      h.clear();
+      CHECK(h.size() == 0);
+      CHECK(h.get(0).is_none());
+      CHECK(h.pool_stats().slab_bytes == 0);
+      CHECK(allocated_mem == before);
+
+      // A cleared trie is a regular, empty one
+      h.insert(1, 2);
+      CHECK(h.get(1).unwrap() == 2);
+      h.clear();
+      h.clear();
+      CHECK(allocated_mem == before);
+    };
+
+    {
+      Hamt<size_t, size_t, TracingAllocator> inline_leaves;
+      check_shrink(inline_leaves);
+    }
+
+    {
+      Hamt<size_t, size_t, TracingAllocator, Hash<size_t>,
+           HamtLayout<HamtLeaves::OutOfLine>>
+          out_of_line;
+      check_shrink(out_of_line);
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
+  TEST_CASE("2-byte keys and values") {
+    {
+      Hamt<uint16_t, uint16_t, TracingAllocator> h;
+
+      for (uint16_t i = 0; i < 1000; i++) {
+        h.insert(i, i * 2);
+      }
+
+      for (uint16_t i = 0; i < 1000; i += 2) {
+        CHECK(h.remove(i));
+      }
+
+      for (uint16_t i = 0; i < 1000; i++) {
+        CHECK(h.get(i).is_some() == (i % 2 == 1));
+      }
+
+      CHECK(h.get(999).unwrap() == 1998);
+      CHECK(h.stats().leaves == 500);
+      h.clear();
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
   TEST_CASE("Collisions") {
     struct FakeHash {
       uint64_t operator()(uint64_t a, size_t gen = 0) const {
@@ -127,4 +286,333 @@ TEST_SUITE("hamt") {
       CHECK(false);
     }
   }
+
+  TEST_CASE("stored hashes") {
+    Hamt<size_t, size_t, TracingAllocator, Hash<size_t>,
+         HamtLayout<HamtLeaves::Auto, true>>
+        stored;
+
+    for (size_t i = 0; i < 1000; i++) {
+      stored.insert(i, i * 2);
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK(stored.get(i).unwrap() == i * 2);
+    }
+
+    for (size_t i = 0; i < 1000; i += 2) {
+      CHECK(stored.remove(i));
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK(stored.get(i).is_some() == (i % 2 == 1));
+    }
+  }
+
+  TEST_CASE("stored hashes with collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    Hamt<uint64_t, uint64_t, TracingAllocator, FakeHash,
+         HamtLayout<HamtLeaves::Auto, true>>
+        h;
+    h.insert(1, 1);
+    h.insert(2, 2);
+    h.insert(3, 3);
+
+    CHECK(h.get(1).unwrap() == 1);
+    CHECK(h.get(2).unwrap() == 2);
+    CHECK(h.get(3).unwrap() == 3);
+    CHECK(h.get(4).is_none());
+  }
+
+  TEST_CASE("iter") {
+    Hamt<size_t, size_t> h;
+    bool seen[1000] = {};
+
+    CHECK(h.iter().next().is_none());
+
+    for (size_t i = 0; i < 1000; i++) {
+      h.insert(i, i * 3);
+    }
+
+    size_t count = 0;
+
+    h.iter().for_each([&](Cons<size_t, size_t> entry) {
+      CHECK(entry.cdr == entry.car * 3);
+      CHECK_FALSE(seen[entry.car]);
+      seen[entry.car] = true;
+      count++;
+    });
+
+    CHECK(count == 1000);
+  }
+
+  TEST_CASE("from_sorted_by_hash") {
+    using H = Hamt<size_t, size_t, TracingAllocator, Hash<size_t>,
+                   HamtLayout<HamtLeaves::Auto, true>>;
+    Vec<Cons<size_t, size_t>> entries;
+
+    for (size_t i = 0; i < 5000; i++) {
+      entries.push(cons(i, i * 2));
+    }
+
+    std::sort(entries.begin(), entries.begin() + 5000, [](auto &a, auto &b) {
+      return H::trie_order(Hash<size_t>()(a.car)) <
+             H::trie_order(Hash<size_t>()(b.car));
+    });
+
+    {
+      auto built = H::from_sorted_by_hash(
+          Slice<const Cons<size_t, size_t>>(entries.data(), 5000));
+
+      CHECK(built.size() == 5000);
+
+      for (size_t i = 0; i < 5000; i++) {
+        CHECK(built.get(i).unwrap() == i * 2);
+      }
+
+      CHECK(built.get(5000).is_none());
+
+      H inserted;
+      for (size_t i = 0; i < 5000; i++) {
+        inserted.insert(i, i * 2);
+      }
+
+      // Same shape, but the tables were allocated at their final size instead
+      // of growing through every smaller one
+      CHECK(built.stats().branches == inserted.stats().branches);
+      CHECK(built.stats().used_bytes == inserted.stats().used_bytes);
+      CHECK(built.stats().reserved_bytes < inserted.stats().reserved_bytes);
+
+      // The trie is a regular one afterwards
+      built.insert(5000, 1);
+      CHECK(built.remove(0));
+      CHECK(built.get(5000).unwrap() == 1);
+      CHECK(built.get(0).is_none());
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
+  TEST_CASE("from_sorted_by_hash with unsorted entries") {
+    using H = Hamt<size_t, size_t, TracingAllocator>;
+    Vec<Cons<size_t, size_t>> entries;
+
+    // In key order, which isn't the order of their hashes
+    for (size_t i = 0; i < 1000; i++) {
+      entries.push(cons(i, i));
+    }
+
+    entries.push(cons(size_t(0), size_t(7)));
+
+    {
+      auto built = H::from_sorted_by_hash(
+          Slice<const Cons<size_t, size_t>>(entries.data(), entries.size()));
+
+      CHECK(built.size() == 1000);
+      CHECK(built.get(0).unwrap() == 7);
+
+      for (size_t i = 1; i < 1000; i++) {
+        CHECK(built.get(i).unwrap() == i);
+      }
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
+  TEST_CASE("from_sorted_by_hash with collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    using H = Hamt<uint64_t, uint64_t, TracingAllocator, FakeHash>;
+
+    // Every key shares its first hash, and 2 appears twice
+    Cons<uint64_t, uint64_t> entries[] = {cons(uint64_t(1), uint64_t(1)),
+                                          cons(uint64_t(2), uint64_t(2)),
+                                          cons(uint64_t(3), uint64_t(3)),
+                                          cons(uint64_t(2), uint64_t(20))};
+
+    auto h = H::from_sorted_by_hash(
+        Slice<const Cons<uint64_t, uint64_t>>(entries, 4));
+
+    CHECK(h.size() == 3);
+    CHECK(h.get(1).unwrap() == 1);
+    CHECK(h.get(2).unwrap() == 20);
+    CHECK(h.get(3).unwrap() == 3);
+  }
+
+  TEST_CASE("from_sorted_by_hash with duplicate keys") {
+    using H = Hamt<size_t, size_t>;
+
+    Cons<size_t, size_t> twice[] = {cons(size_t(7), size_t(1)),
+                                    cons(size_t(7), size_t(2))};
+    auto single = H::from_sorted_by_hash(
+        Slice<const Cons<size_t, size_t>>(twice, 2));
+
+    H inserted;
+    inserted.insert(7, 2);
+
+    CHECK(single.size() == 1);
+    CHECK(single.get(7).unwrap() == 2);
+    CHECK(single.stats().branches == inserted.stats().branches);
+    CHECK(single.stats().depth_histogram[1] == 1);
+
+    // Every key three times, the last copy holds the expected value
+    Vec<Cons<size_t, size_t>> entries;
+
+    for (size_t i = 0; i < 1000; i++) {
+      for (size_t copy = 0; copy < 3; copy++) {
+        entries.push(cons(i, i * 10 + copy));
+      }
+    }
+
+    std::stable_sort(entries.begin(), entries.begin() + 3000,
+                     [](auto &a, auto &b) {
+                       return H::trie_order(Hash<size_t>()(a.car)) <
+                              H::trie_order(Hash<size_t>()(b.car));
+                     });
+
+    auto built = H::from_sorted_by_hash(
+        Slice<const Cons<size_t, size_t>>(entries.data(), 3000));
+
+    H expected;
+    for (size_t i = 0; i < 1000; i++) {
+      expected.insert(i, i * 10 + 2);
+    }
+
+    CHECK(built.size() == 1000);
+    CHECK(built.stats().branches == expected.stats().branches);
+
+    for (size_t depth = 0; depth <= H::MAX_DEPTH; depth++) {
+      CHECK(built.stats().depth_histogram[depth] ==
+            expected.stats().depth_histogram[depth]);
+    }
+
+    for (size_t i = 0; i < 1000; i++) {
+      CHECK(built.get(i).unwrap() == i * 10 + 2);
+    }
+  }
+
+  TEST_CASE("stats") {
+    Hamt<size_t, size_t> h;
+
+    auto empty = h.stats();
+    CHECK(empty.branches == 0);
+    CHECK(empty.leaves == 0);
+    CHECK(empty.used_bytes == 0);
+
+    for (size_t i = 0; i < 1000; i++) {
+      h.insert(i, i);
+    }
+
+    auto stats = h.stats();
+    size_t leaves = 0;
+
+    for (auto count : stats.depth_histogram) {
+      leaves += count;
+    }
+
+    CHECK(stats.leaves == 1000);
+    CHECK(leaves == 1000);
+    CHECK(stats.depth_histogram[0] == 0);
+    CHECK(stats.branches > 1);
+    CHECK(stats.used_bytes == 16 + h.pool_stats().used_bytes());
+    CHECK(stats.reserved_bytes >= stats.used_bytes);
+  }
+
+  TEST_CASE("String keys and values") {
+    {
+      Hamt<String, String, TracingAllocator> h;
+      char key[32];
+      char value[48];
+
+      for (size_t i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "a rather long key %zu", i);
+        snprintf(value, sizeof(value), "a value too long to be inline %zu", i);
+        h.insert(String(key), String(value));
+      }
+
+      h.insert(String("a rather long key 7"), String("replaced"));
+
+      for (size_t i = 0; i < 1000; i += 2) {
+        snprintf(key, sizeof(key), "a rather long key %zu", i);
+        CHECK(h.remove(String(key)));
+      }
+
+      CHECK(h.size() == 500);
+      CHECK(h.get(String("a rather long key 7")).unwrap() == "replaced");
+      CHECK(h.get(String("a rather long key 9")).unwrap() ==
+            "a value too long to be inline 9");
+      CHECK(h.get(String("a rather long key 8")).is_none());
+
+      size_t count = 0;
+      h.iter().for_each([&](Cons<String, String>) { count++; });
+      CHECK(count == 500);
+    }
+
+    CHECK(allocated_mem == 0);
+  }
+
+  TEST_CASE("out of line leaves") {
+    struct Big {
+      size_t data[8];
+    };
+
+    Hamt<size_t, Big, TracingAllocator, Hash<size_t>,
+         HamtLayout<HamtLeaves::Inline>>
+        inline_leaves;
+    Hamt<size_t, Big, TracingAllocator, Hash<size_t>,
+         HamtLayout<HamtLeaves::OutOfLine>>
+        out_of_line;
+
+    for (size_t i = 0; i < 10000; i++) {
+      Big big = {};
+      big.data[7] = i;
+      inline_leaves.insert(i, big);
+      out_of_line.insert(i, big);
+    }
+
+    for (size_t i = 0; i < 10000; i++) {
+      CHECK(out_of_line.get(i).unwrap().data[7] == i);
+    }
+
+    // Slots of the tables are as small as a branch, instead of as big as an
+    // entry, so free tables of the pool take much less room
+    CHECK(out_of_line.stats().reserved_bytes <
+          inline_leaves.stats().reserved_bytes * 3 / 4);
+
+    for (size_t i = 0; i < 10000; i++) {
+      CHECK(out_of_line.remove(i));
+    }
+
+    CHECK(out_of_line.stats().used_bytes == 16);
+  }
+
+  TEST_CASE("out of line leaves with stored hashes and collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    Hamt<uint64_t, uint64_t, TracingAllocator, FakeHash,
+         HamtLayout<HamtLeaves::OutOfLine, true>>
+        h;
+
+    for (uint64_t i = 1; i <= 4; i++) {
+      h.insert(i, i);
+    }
+
+    CHECK(h.remove(1));
+    CHECK(h.get(1).is_none());
+    CHECK(h.get(4).unwrap() == 4);
+    CHECK(h.stats().leaves == 3);
+  }
 }
@@ -0,0 +1,198 @@
+#include <atlas/hash.hpp>
+#include <atlas/hashmap.hpp>
+#include <atlas/siphash.hpp>
+#include <doctest.h>
+#include <set>
+
+using namespace atlas;
+
+TEST_SUITE("Hash") {
+  TEST_CASE("integers") {
+    static_assert(Hash<uint64_t>()(42) == Hash<uint64_t>()(42));
+
+    std::set<uint64_t> low_bits;
+    for (uint64_t i = 0; i < 1024; i++) {
+      low_bits.insert(Hash<uint64_t>()(i) & 0xffff);
+    }
+
+    // Sequential keys shouldn't pile up in the low bits
+    CHECK(low_bits.size() > 1000);
+
+    CHECK(Hash<uint64_t>()(1, 0) != Hash<uint64_t>()(1, 1));
+    CHECK(Hash<int>()(-1) == Hash<int>()(-1));
+  }
+
+  TEST_CASE("strings") {
+    CHECK(Hash<StringView>()("hello"_sv) == Hash<const char *>()("hello"));
+    CHECK(Hash<String>()(String("hello")) == Hash<StringView>()("hello"_sv));
+    CHECK(Hash<StringView>()("hello"_sv) != Hash<StringView>()("hellp"_sv));
+    CHECK(Hash<StringView>()("hello"_sv, 0) !=
+          Hash<StringView>()("hello"_sv, 1));
+  }
+
+  TEST_CASE("every length") {
+    uint8_t buffer[4096];
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+      buffer[i] = i * 31 + 7;
+    }
+
+    // Every prefix of the buffer must get its own hash, this covers the
+    // short, medium and striped paths
+    std::set<uint64_t> hashes;
+    for (size_t len = 0; len <= sizeof(buffer); len++) {
+      hashes.insert(wy_hash(buffer, len, 0));
+    }
+
+    CHECK(hashes.size() == sizeof(buffer) + 1);
+
+    // Flipping a single byte anywhere must change the hash
+    auto reference = wy_hash(buffer, sizeof(buffer), 0);
+    for (size_t i = 0; i < sizeof(buffer); i += 97) {
+      buffer[i] ^= 1;
+      CHECK(wy_hash(buffer, sizeof(buffer), 0) != reference);
+      buffer[i] ^= 1;
+    }
+  }
+
+  TEST_CASE("vectorized stripes match the scalar code") {
+    uint8_t buffer[64 * 40];
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+      buffer[i] = i * 13 + 5;
+    }
+
+    uint64_t acc[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint64_t scalar_acc[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+    detail::accumulate_stripes(acc, buffer, 40);
+    detail::accumulate_stripes_scalar(scalar_acc, buffer, 40);
+
+    for (size_t i = 0; i < 8; i++) {
+      CHECK(acc[i] == scalar_acc[i]);
+    }
+  }
+
+  TEST_CASE("murmur") {
+    uint64_t key = 42;
+    CHECK(MurmurHash<uint64_t>()(key) == murmur_hash(&key, sizeof(key), 0));
+    CHECK(MurmurHash<StringView>()("hello"_sv) ==
+          MurmurHash<const char *>()("hello"));
+  }
+
+  TEST_CASE("composite keys") {
+    enum class Color { Red, Green };
+
+    static_assert(Hash<Color>()(Color::Green) == Hash<int>()(1));
+    static_assert(Hash<Cons<int, int>>()(cons(1, 2)) !=
+                  Hash<Cons<int, int>>()(cons(2, 1)));
+    static_assert(Hash<Tuple<int, Color, uint64_t>>()({1, Color::Red, 3}) ==
+                  Hash<Tuple<int, Color, uint64_t>>()({1, Color::Red, 3}));
+    static_assert(hash_combine(1, 2) != hash_combine(2, 1));
+
+    CHECK(Hash<Tuple<int, int>>()({1, 2}) != Hash<Tuple<int, int>>()({2, 1}));
+
+    // Both halves of a pair must contribute to the low bits
+    std::set<uint64_t> low_bits;
+    for (int a = 0; a < 32; a++) {
+      for (int b = 0; b < 32; b++) {
+        low_bits.insert(Hash<Cons<int, int>>()(cons(a, b)) & 0xffff);
+      }
+    }
+    CHECK(low_bits.size() > 1000);
+  }
+
+  TEST_CASE("contiguous keys") {
+    uint32_t a[] = {1, 2, 3, 4};
+    uint32_t b[] = {1, 2, 3, 5};
+
+    CHECK(Hash<Slice<uint32_t>>()({a, 4}) == wy_hash(a, sizeof(a), 0));
+    CHECK(Hash<Slice<uint32_t>>()({a, 4}) != Hash<Slice<uint32_t>>()({b, 4}));
+    CHECK(Hash<Slice<const uint32_t>>()({a, 4}) ==
+          Hash<Slice<uint32_t>>()({a, 4}));
+    CHECK(Hash<Array<uint32_t, 4>>()({1, 2, 3, 4}) ==
+          Hash<Slice<uint32_t>>()({a, 4}));
+
+    // Doubles aren't trivially hashable, so they're hashed one by one
+    double d[] = {1.0, 2.0};
+    double e[] = {1.0, 3.0};
+    CHECK(Hash<Slice<double>>()({d, 2}) != Hash<Slice<double>>()({e, 2}));
+    CHECK(Hash<double>()(0.0) == Hash<double>()(-0.0));
+  }
+
+  TEST_CASE("composite keys in a map") {
+    HashMap<Cons<int, int>, int> map;
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(map.insert(cons(i, -i), i));
+    }
+
+    CHECK(map.get(cons(42, -42)).unwrap() == 42);
+    CHECK(map.get(cons(42, 42)).is_none());
+
+    HashMap<Tuple<int, int, int>, int> tuples;
+    CHECK(tuples.insert({1, 2, 3}, 6));
+    CHECK(tuples.get({1, 2, 3}).unwrap() == 6);
+    CHECK(tuples.get({3, 2, 1}).is_none());
+  }
+
+  TEST_CASE("batches match hashing one key at a time") {
+    int64_t wide[103];
+    int32_t narrow[103];
+    uint16_t shorts[103];
+    int8_t bytes[103];
+    uint64_t out[103];
+
+    for (int i = 0; i < 103; i++) {
+      wide[i] = i * -7919 + 3;
+      narrow[i] = i * -31;
+      shorts[i] = i * 977;
+      bytes[i] = i * -3;
+    }
+
+    hash_batch(Slice<const int64_t>(wide, 103), Slice<uint64_t>(out, 103));
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == Hash<int64_t>()(wide[i]));
+    }
+
+    hash_batch(Slice<const int32_t>(narrow, 103), Slice<uint64_t>(out, 103),
+               Hash<int32_t>(), 5);
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == Hash<int32_t>()(narrow[i], 5));
+    }
+
+    hash_batch(Slice<const uint16_t>(shorts, 103), Slice<uint64_t>(out, 103));
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == Hash<uint16_t>()(shorts[i]));
+    }
+
+    hash_batch(Slice<const int8_t>(bytes, 103), Slice<uint64_t>(out, 103));
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == Hash<int8_t>()(bytes[i]));
+    }
+
+    // Strings of every length class
+    char buffer[200];
+    StringView strings[103];
+
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+      buffer[i] = 'a' + i % 26;
+    }
+
+    for (size_t i = 0; i < 103; i++) {
+      strings[i] = StringView(buffer + i % 7, (i * 37) % 150);
+    }
+
+    hash_batch(Slice<const StringView>(strings, 103),
+               Slice<uint64_t>(out, 103));
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == Hash<StringView>()(strings[i]));
+    }
+
+    // Any other hasher is called key by key
+    SipHash<int64_t> keyed;
+    hash_batch(Slice<const int64_t>(wide, 103), Slice<uint64_t>(out, 103),
+               keyed);
+    for (int i = 0; i < 103; i++) {
+      CHECK(out[i] == keyed(wide[i]));
+    }
+  }
+}
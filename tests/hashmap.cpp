@@ -71,4 +71,134 @@ TEST_SUITE("HashMap") {
       CHECK(hashmap.get(i).unwrap() == i);
     }
   }
+
+  TEST_CASE("remove keeps probe chains intact") {
+    HashMap<int, int> hashmap;
+
+    for (int i = 0; i < 200; i++) {
+      CHECK(hashmap.insert(i, i * 2));
+    }
+
+    for (int i = 0; i < 200; i += 3) {
+      CHECK(hashmap.remove(i));
+    }
+
+    for (int i = 0; i < 200; i++) {
+      if (i % 3 == 0) {
+        CHECK_FALSE(hashmap.get(i).is_some());
+      } else {
+        CHECK(hashmap.get(i).unwrap() == i * 2);
+      }
+    }
+  }
+
+  TEST_CASE("iter") {
+    HashMap<int, int> hashmap;
+
+    for (int i = 0; i < 10; i++) {
+      CHECK(hashmap.insert(i, i));
+    }
+
+    int sum = 0;
+    for (auto entry : hashmap.iter()) {
+      CHECK(entry.first() == entry.second());
+      sum += entry.first();
+    }
+
+    CHECK(sum == 45);
+  }
+
+  TEST_CASE("get_many") {
+    HashMap<int, int> hashmap;
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(hashmap.insert(i, i * 3));
+    }
+
+    int keys[120];
+    Option<int> out[120];
+
+    for (int i = 0; i < 120; i++) {
+      keys[i] = i;
+    }
+
+    hashmap.get_many(Slice<const int>(keys, 120), Slice<Option<int>>(out, 120));
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(out[i].unwrap() == i * 3);
+    }
+
+    for (int i = 100; i < 120; i++) {
+      CHECK(out[i].is_none());
+    }
+  }
+
+  TEST_CASE("insert_many") {
+    HashMap<int, int> hashmap;
+    int keys[100];
+    int values[100];
+
+    for (int i = 0; i < 100; i++) {
+      keys[i] = i;
+      values[i] = -i;
+    }
+
+    CHECK(hashmap.insert_many(Slice<const int>(keys, 100),
+                              Slice<const int>(values, 100)));
+    CHECK(hashmap.size() == 100);
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(hashmap.get(i).unwrap() == -i);
+    }
+
+    CHECK(!hashmap.insert_many(Slice<const int>(keys, 1),
+                               Slice<const int>(values, 1)));
+  }
+
+  TEST_CASE("stored hashes") {
+    HashMap<const char *, int, DefaultAllocator, Hash<const char *>, true>
+        hashmap;
+
+    const char *words[] = {"alpha", "beta", "gamma", "delta", "epsilon",
+                           "zeta",  "eta",  "theta", "iota",  "kappa"};
+
+    for (int i = 0; i < 10; i++) {
+      CHECK(hashmap.insert(words[i], i));
+    }
+
+    // Keys are compared by content, not by address
+    char copy[] = "gamma";
+    CHECK(hashmap.get(copy).unwrap() == 2);
+    CHECK_FALSE(hashmap.insert(copy, 3));
+
+    CHECK(hashmap.remove("beta"));
+
+    for (int i = 0; i < 10; i++) {
+      CHECK(hashmap.get(words[i]).is_some() == (i != 1));
+    }
+  }
+
+  TEST_CASE("moved-from map") {
+    HashMap<int, int> a;
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(a.insert(i, i));
+    }
+
+    HashMap<int, int> b(std::move(a));
+    CHECK(b.size() == 100);
+    CHECK(b.get(42).unwrap() == 42);
+
+    // The source is left empty, and can still be used
+    CHECK(a.empty());
+    CHECK(a.get(42).is_none());
+    CHECK_FALSE(a.remove(42));
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(a.insert(i, -i));
+    }
+
+    CHECK(a.get(42).unwrap() == -42);
+    CHECK(b.get(42).unwrap() == 42);
+  }
 }
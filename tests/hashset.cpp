@@ -0,0 +1,121 @@
+#include <atlas/hashset.hpp>
+#include <doctest.h>
+
+using namespace atlas;
+
+TEST_SUITE("HashSet") {
+  HashSet<int> set;
+
+  TEST_CASE("insert") {
+    CHECK(set.insert(1));
+    CHECK(set.insert(2));
+    CHECK(set.insert(3));
+    CHECK_FALSE(set.insert(3));
+
+    CHECK(set.size() == 3);
+  }
+
+  TEST_CASE("contains") {
+    CHECK(set.contains(1));
+    CHECK(set.contains(2));
+    CHECK(set.contains(3));
+    CHECK_FALSE(set.contains(4));
+  }
+
+  TEST_CASE("remove") {
+    CHECK(set.remove(2));
+    CHECK_FALSE(set.contains(2));
+    CHECK(set.size() == 2);
+    CHECK_FALSE(set.remove(2));
+  }
+
+  TEST_CASE("iter") {
+    int sum = 0;
+
+    for (auto key : set.iter()) {
+      sum += key;
+    }
+
+    CHECK(sum == 4);
+    CHECK(set.iter().count() == 2);
+  }
+
+  TEST_CASE("big set") {
+    HashSet<uint64_t> big(1);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+      CHECK(big.insert(i * 7));
+    }
+
+    CHECK(big.size() == 1000);
+
+    // Remove every other key, the remaining ones must stay reachable
+    for (uint64_t i = 0; i < 1000; i += 2) {
+      CHECK(big.remove(i * 7));
+    }
+
+    for (uint64_t i = 0; i < 1000; i++) {
+      CHECK(big.contains(i * 7) == (i % 2 == 1));
+    }
+  }
+
+  TEST_CASE("insert_many") {
+    HashSet<uint64_t> set;
+    uint64_t keys[100];
+
+    for (uint64_t i = 0; i < 100; i++) {
+      keys[i] = i * 3;
+    }
+
+    CHECK(set.insert(30));
+    CHECK(!set.insert_many(Slice<const uint64_t>(keys, 100)));
+
+    CHECK(set.size() == 100);
+    for (uint64_t i = 0; i < 300; i++) {
+      CHECK(set.contains(i) == (i % 3 == 0));
+    }
+  }
+
+  TEST_CASE("set operations") {
+    HashSet<int> a;
+    HashSet<int> b;
+
+    for (int i = 0; i < 10; i++) {
+      (void)a.insert(i);
+    }
+
+    for (int i = 5; i < 15; i++) {
+      (void)b.insert(i);
+    }
+
+    auto u = a.set_union(b);
+    CHECK(u.size() == 15);
+    for (int i = 0; i < 15; i++) {
+      CHECK(u.contains(i));
+    }
+
+    auto inter = a.set_intersection(b);
+    CHECK(inter.size() == 5);
+    for (int i = 5; i < 10; i++) {
+      CHECK(inter.contains(i));
+    }
+
+    auto diff = a.set_difference(b);
+    CHECK(diff.size() == 5);
+    for (int i = 0; i < 5; i++) {
+      CHECK(diff.contains(i));
+    }
+    CHECK_FALSE(diff.contains(5));
+  }
+
+  TEST_CASE("String set") {
+    HashSet<StringView> strings;
+
+    CHECK(strings.insert("hello"_sv));
+    CHECK(strings.insert("world"_sv));
+    CHECK_FALSE(strings.insert("hello"_sv));
+
+    CHECK(strings.contains("world"_sv));
+    CHECK_FALSE(strings.contains("foo"_sv));
+  }
+}
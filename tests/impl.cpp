@@ -1,4 +1,5 @@
 #include <atlas/impl.hpp>
+#include <random>
 #include <source_location>
 #include <stdexcept>
 
@@ -10,4 +11,9 @@ namespace atlas::impl {
                            std::to_string(loc.column()));
 }
 
+uint64_t random_seed() {
+  std::random_device device;
+  return (uint64_t(device()) << 32) | device();
+}
+
 } // namespace atlas::impl
@@ -0,0 +1,113 @@
+#include <atlas/interval_tree.hpp>
+#include <doctest.h>
+#include <random>
+#include <vector>
+
+using namespace atlas;
+
+struct Region {
+  uint64_t start;
+  uint64_t end;
+
+  RBTreeNode<Region> hook = {};
+  uint64_t max_end = 0;
+};
+
+using RegionTree = IntervalTree<Region, &Region::hook, uint64_t,
+                                &Region::start, &Region::end, &Region::max_end>;
+
+// The regions overlapping [start, end), found by looking at all of them
+static std::vector<Region *> brute_force(std::vector<Region> &regions,
+                                         std::vector<bool> &present,
+                                         uint64_t start, uint64_t end) {
+  std::vector<Region *> ret;
+
+  for (size_t i = 0; i < regions.size(); i++) {
+    if (present[i] && regions[i].start < end && start < regions[i].end) {
+      ret.push_back(&regions[i]);
+    }
+  }
+
+  return ret;
+}
+
+TEST_SUITE("Interval tree") {
+  TEST_CASE("overlaps") {
+    RegionTree tree;
+    Region a{10, 20}, b{15, 30}, c{40, 50}, d{0, 5};
+
+    tree.insert(&a);
+    tree.insert(&b);
+    tree.insert(&c);
+    tree.insert(&d);
+
+    CHECK(tree.first_overlap(18, 19).unwrap() == &a);
+    CHECK(tree.first_overlap(20, 40).unwrap() == &b);
+    CHECK(tree.first_overlap(30, 40).is_none());
+    CHECK(tree.first_overlap(5, 10).is_none());
+    CHECK(tree.first_overlap(49, 100).unwrap() == &c);
+
+    std::vector<Region *> found;
+    for (auto region : tree.overlapping(4, 16)) {
+      found.push_back(region);
+    }
+
+    CHECK(found == std::vector<Region *>{&d, &a, &b});
+
+    tree.remove(&a);
+    CHECK(tree.first_overlap(18, 19).unwrap() == &b);
+    CHECK(tree.first_overlap(10, 15).is_none());
+  }
+
+  TEST_CASE("random") {
+    std::mt19937_64 rng(7);
+    std::vector<Region> regions(500);
+    std::vector<bool> present(regions.size(), false);
+    RegionTree tree;
+
+    for (auto &region : regions) {
+      region.start = rng() % 10000;
+      region.end = region.start + 1 + rng() % 300;
+    }
+
+    for (size_t round = 0; round < 4000; round++) {
+      auto i = rng() % regions.size();
+
+      if (present[i]) {
+        tree.remove(&regions[i]);
+      } else {
+        tree.insert(&regions[i]);
+      }
+
+      present[i] = !present[i];
+
+      uint64_t start = rng() % 10000;
+      uint64_t end = start + 1 + rng() % 500;
+
+      auto expected = brute_force(regions, present, start, end);
+
+      std::vector<Region *> found;
+      for (auto region : tree.overlapping(start, end)) {
+        found.push_back(region);
+      }
+
+      // Both are sorted by start, but regions sharing a start may come in
+      // any order
+      CHECK(found.size() == expected.size());
+      for (auto region : found) {
+        CHECK(region->start < end);
+        CHECK(start < region->end);
+      }
+
+      for (size_t j = 1; j < found.size(); j++) {
+        CHECK(found[j - 1]->start <= found[j]->start);
+      }
+
+      if (expected.empty()) {
+        CHECK(tree.first_overlap(start, end).is_none());
+      } else {
+        CHECK(tree.first_overlap(start, end).unwrap() == found[0]);
+      }
+    }
+  }
+}
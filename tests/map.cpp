@@ -1,5 +1,8 @@
 #include <atlas/map.hpp>
 #include <doctest.h>
+#include <map>
+#include <random>
+#include <vector>
 
 using namespace atlas;
 
@@ -59,4 +62,311 @@ TEST_SUITE("Map") {
     CHECK(map.size() == 0);
     CHECK_FALSE(map.get("world").is_some());
   }
+
+  TEST_CASE("bounds and range") {
+    Map<int, int> numbers;
+
+    for (int i = 0; i < 50; i++) {
+      CHECK(numbers.insert(i * 10, i));
+    }
+
+    CHECK(numbers.lower_bound(25).unwrap().car == 30);
+    CHECK(numbers.lower_bound(30).unwrap().cdr == 3);
+    CHECK(numbers.upper_bound(30).unwrap().car == 40);
+    CHECK(numbers.floor(39).unwrap().car == 30);
+    CHECK(numbers.ceil(39).unwrap().car == 40);
+    CHECK(numbers.floor(-1).is_none());
+    CHECK(numbers.ceil(491).is_none());
+
+    std::vector<int> keys;
+    numbers.range(95, 140).for_each(
+        [&](Cons<int, int> entry) { keys.push_back(entry.car); });
+
+    CHECK(keys == std::vector<int>{100, 110, 120, 130});
+
+    for (int i = 0; i < 50; i++) {
+      CHECK(numbers.remove(i * 10));
+    }
+  }
+
+  TEST_CASE("range with string keys") {
+    Map<const char *, int> words;
+
+    CHECK(words.insert("apple", 1));
+    CHECK(words.insert("banana", 2));
+    CHECK(words.insert("cherry", 3));
+    CHECK(words.insert("date", 4));
+
+    std::vector<int> values;
+    words.range("b", "d").for_each(
+        [&](Cons<const char *, int> entry) { values.push_back(entry.cdr); });
+
+    CHECK(values == std::vector<int>{2, 3});
+    CHECK(words.floor("c").unwrap().cdr == 2);
+
+    words.clear();
+  }
+
+  TEST_CASE("from_sorted") {
+    Vec<Cons<int, int>> entries;
+
+    for (int i = 0; i < 1000; i++) {
+      entries.push(cons(i * 2, i));
+    }
+
+    auto built = Map<int, int>::from_sorted(entries.iter()).take();
+
+    CHECK(built.size() == 1000);
+    CHECK(built.get(0).unwrap() == 0);
+    CHECK(built.get(1998).unwrap() == 999);
+    CHECK(built.get(3).is_none());
+
+    CHECK(built.insert(3, 3));
+    CHECK(built.remove(4));
+    CHECK(built.lower_bound(3).unwrap().car == 3);
+    CHECK(built.lower_bound(4).unwrap().car == 6);
+
+    int count = 0;
+    built.iter().for_each([&](const Cons<int, int> &) { count++; });
+    CHECK(count == 1000);
+
+    auto empty =
+        Map<int, int>::from_sorted(Vec<Cons<int, int>>().iter()).take();
+    CHECK(empty.empty());
+  }
+
+  TEST_CASE("from_sorted with unsorted or duplicate keys") {
+    Vec<Cons<int, Vec<int>>> unsorted;
+    Vec<Cons<int, Vec<int>>> duplicate;
+
+    // The values own memory, which must be freed along with the nodes
+    for (int i = 0; i < 100; i++) {
+      Vec<int> value;
+      value.push(i);
+
+      unsorted.push(cons(i == 50 ? 200 : i, value));
+      duplicate.push(cons(i == 50 ? 49 : i, std::move(value)));
+    }
+
+    auto a = Map<int, Vec<int>>::from_sorted(unsorted.iter());
+    CHECK(!a);
+    CHECK(a.error() == Error::InvalidParameters);
+
+    auto b = Map<int, Vec<int>>::from_sorted(duplicate.iter());
+    CHECK(!b);
+    CHECK(b.error() == Error::InvalidParameters);
+  }
+
+  TEST_CASE("set operations") {
+    std::mt19937_64 rng(11);
+    Map<int, int> a, b;
+    std::map<int, int> a_ref, b_ref;
+
+    for (int i = 0; i < 2000; i++) {
+      int key = (int)(rng() % 3000);
+
+      if (rng() % 2 == 0) {
+        if (a.insert(key, i)) {
+          a_ref[key] = i;
+        }
+      } else if (b.insert(key, -i)) {
+        b_ref[key] = -i;
+      }
+    }
+
+    auto check = [](Map<int, int> &map, const std::map<int, int> &expected) {
+      CHECK(map.size() == expected.size());
+
+      auto it = expected.begin();
+      map.iter().for_each([&](const Cons<int, int> &entry) {
+        CHECK(entry.car == it->first);
+        CHECK(entry.cdr == it->second);
+        it++;
+      });
+
+      CHECK(it == expected.end());
+    };
+
+    std::map<int, int> union_ref = b_ref, intersection_ref, difference_ref,
+                       merge_ref = b_ref;
+
+    for (auto [key, value] : a_ref) {
+      union_ref[key] = value;
+
+      if (b_ref.count(key)) {
+        intersection_ref[key] = value;
+        merge_ref[key] = value + b_ref[key];
+      } else {
+        difference_ref[key] = value;
+        merge_ref[key] = value;
+      }
+    }
+
+    auto united = a.union_with(b);
+    check(united, union_ref);
+
+    auto intersection = a.intersection(b);
+    check(intersection, intersection_ref);
+
+    auto difference = a.difference(b);
+    check(difference, difference_ref);
+
+    auto merged = a.merge_with(b, [](int x, int y) { return x + y; });
+    check(merged, merge_ref);
+
+    // The results are regular maps
+    CHECK(difference.insert(-1, 0));
+    CHECK(difference.get(-1).unwrap() == 0);
+
+    Map<int, int> empty;
+    CHECK(empty.intersection(a).empty());
+    CHECK(a.difference(empty).size() == a.size());
+    CHECK(empty.union_with(b).size() == b.size());
+  }
+
+  TEST_CASE("non-trivial values") {
+    auto vec_of = [](int n) {
+      Vec<int> ret;
+      for (int i = 0; i < n; i++) {
+        ret.push(i);
+      }
+      return ret;
+    };
+
+    Map<int, Vec<int>> a, b;
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(a.insert(i, vec_of(i % 10 + 1)));
+      CHECK(b.insert(i + 50, vec_of(3)));
+    }
+
+    CHECK(a.get(42).unwrap().size() == 3);
+    CHECK(a.get(42).unwrap()[2] == 2);
+
+    for (int i = 0; i < 100; i += 2) {
+      CHECK(a.remove(i));
+    }
+
+    CHECK(a.size() == 50);
+    CHECK(a.get(42).is_none());
+
+    auto united = a.union_with(b);
+    CHECK(united.size() == 125);
+    CHECK(united.get(51).unwrap().size() == 2);
+    CHECK(united.get(52).unwrap().size() == 3);
+
+    CHECK(a.intersection(b).size() == 25);
+    CHECK(a.difference(b).size() == 25);
+
+    auto merged = a.merge_with(b, [](const Vec<int> &x, const Vec<int> &y) {
+      auto ret = x;
+      for (size_t i = 0; i < y.size(); i++) {
+        ret.push(y[i]);
+      }
+      return ret;
+    });
+    CHECK(merged.get(51).unwrap().size() == 5);
+
+    Vec<Cons<int, Vec<int>>> entries;
+    for (int i = 0; i < 10; i++) {
+      entries.push(cons(i, vec_of(i + 1)));
+    }
+
+    auto built = Map<int, Vec<int>>::from_sorted(entries.iter()).take();
+    CHECK(built.get(9).unwrap().size() == 10);
+
+    built.clear();
+    CHECK(built.empty());
+  }
+
+  TEST_CASE("reference iteration") {
+    Map<int, int> numbers;
+
+    for (int i = 0; i < 100; i++) {
+      CHECK(numbers.insert(i, i));
+    }
+
+    // Entries refer to the values stored in the map
+    const int *first = nullptr;
+    numbers.iter().for_each([&](const Cons<const int &, const int &> &entry) {
+      if (entry.car == 0) {
+        first = &entry.cdr;
+      }
+    });
+
+    CHECK(first == &numbers.iter().next().unwrap().cdr);
+
+    for (auto entry : numbers.iter_mut()) {
+      entry.cdr *= 2;
+    }
+
+    CHECK(numbers.get(21).unwrap() == 42);
+
+    int expected = 99;
+    for (auto entry : numbers.iter().rev()) {
+      CHECK(entry.car == expected);
+      CHECK(entry.cdr == expected * 2);
+      expected--;
+    }
+
+    CHECK(expected == -1);
+
+    auto range = numbers.range(10, 13);
+    CHECK(range.next().unwrap().car == 10);
+    CHECK(range.next().unwrap().cdr == 22);
+
+    // Entries convert to copies on demand
+    Cons<int, int> copy = range.next().unwrap();
+    CHECK(copy == cons(12, 24));
+    CHECK(range.next().is_none());
+  }
+
+  TEST_CASE("reference iteration of non-comparable values") {
+    // Vec has no operator==, so neither do entries holding one
+    static_assert(
+        !std::equality_comparable<Cons<const int &, const Vec<int> &>>);
+    static_assert(std::equality_comparable<Cons<const int &, const int &>>);
+    static_assert(!std::is_constructible_v<Cons<int, int>,
+                                           const Cons<const char *, int> &>);
+    static_assert(std::is_constructible_v<Cons<int, Vec<int>>,
+                                          const Cons<int, Vec<int>> &>);
+
+    Map<int, Vec<int>> lists;
+
+    for (int i = 0; i < 20; i++) {
+      Vec<int> list;
+      for (int j = 0; j < i; j++) {
+        list.push(j);
+      }
+      CHECK(lists.insert(i, list));
+    }
+
+    int expected = 0;
+    for (auto entry : lists.iter()) {
+      CHECK(entry.car == expected);
+      CHECK(entry.cdr.size() == size_t(expected));
+      expected++;
+    }
+
+    CHECK(expected == 20);
+
+    for (auto entry : lists.iter_mut()) {
+      entry.cdr.push(-1);
+    }
+
+    expected = 19;
+    for (auto entry : lists.iter().rev()) {
+      CHECK(entry.car == expected);
+      CHECK(entry.cdr.size() == size_t(expected) + 1);
+      CHECK(entry.cdr[size_t(expected)] == -1);
+      expected--;
+    }
+
+    CHECK(expected == -1);
+
+    // Entries still convert to owned copies
+    Cons<int, Vec<int>> copy = lists.iter().next().unwrap();
+    CHECK(copy.car == 0);
+    CHECK(copy.cdr.size() == 1);
+  }
 }
\ No newline at end of file
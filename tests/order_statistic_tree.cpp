@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <atlas/order_statistic_tree.hpp>
+#include <doctest.h>
+#include <random>
+#include <vector>
+
+using namespace atlas;
+
+struct Entry {
+  int val;
+
+  RBTreeNode<Entry> hook;
+  size_t size;
+};
+
+using EntryTree = OrderStatisticTree<Entry, &Entry::hook, int, &Entry::val,
+                                     &Entry::size>;
+
+TEST_SUITE("Order statistic tree") {
+  TEST_CASE("select/rank") {
+    EntryTree tree;
+    std::vector<Entry> entries(100);
+
+    CHECK(tree.size() == 0);
+    CHECK(tree.select(0).is_none());
+
+    for (int i = 0; i < 100; i++) {
+      entries[i].val = (i * 37) % 100;
+      tree.insert(&entries[i]);
+    }
+
+    CHECK(tree.size() == 100);
+
+    for (size_t k = 0; k < 100; k++) {
+      auto entry = tree.select(k).unwrap();
+      CHECK(entry->val == (int)k);
+      CHECK(tree.rank(entry) == k);
+    }
+
+    CHECK(tree.select(100).is_none());
+
+    for (int i = 0; i < 100; i += 2) {
+      tree.remove(&entries[i]);
+    }
+
+    CHECK(tree.size() == 50);
+  }
+
+  TEST_CASE("random") {
+    std::mt19937_64 rng(3);
+    std::vector<Entry> entries(1000);
+    std::vector<bool> present(entries.size(), false);
+    std::vector<int> sorted;
+    EntryTree tree;
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      entries[i].val = (int)i;
+    }
+
+    for (size_t round = 0; round < 5000; round++) {
+      auto i = rng() % entries.size();
+
+      if (present[i]) {
+        tree.remove(&entries[i]);
+        sorted.erase(std::find(sorted.begin(), sorted.end(), (int)i));
+      } else {
+        tree.insert(&entries[i]);
+        sorted.insert(std::lower_bound(sorted.begin(), sorted.end(), (int)i),
+                      (int)i);
+      }
+
+      present[i] = !present[i];
+
+      CHECK(tree.size() == sorted.size());
+
+      if (!sorted.empty()) {
+        auto k = rng() % sorted.size();
+        auto entry = tree.select(k).unwrap();
+
+        CHECK(entry->val == sorted[k]);
+        CHECK(tree.rank(entry) == k);
+      }
+    }
+  }
+}
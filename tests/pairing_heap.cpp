@@ -1,6 +1,9 @@
 #include <array>
 #include <atlas/pairing_heap.hpp>
 #include <doctest.h>
+#include <memory>
+#include <random>
+#include <set>
 
 using namespace atlas;
 
@@ -51,4 +54,87 @@ TEST_SUITE("Pairing Heap") {
       CHECK(heap.size() == i);
     }
   }
+
+  TEST_CASE("decrease_key and remove") {
+    PairingHeap<TestNode, &TestNode::hook,
+                [](TestNode *a, TestNode *b) { return a->value < b->value; }>
+        heap;
+    std::array<TestNode, 256> nodes;
+    std::array<bool, 256> in_heap{};
+    std::multiset<int> values;
+    std::mt19937 rng(7);
+
+    for (int round = 0; round < 20000; round++) {
+      auto i = rng() % nodes.size();
+      auto &node = nodes[i];
+
+      switch (rng() % 4) {
+      case 0:
+        if (!in_heap[i]) {
+          node.value = int(rng() % 1000);
+          heap.insert(&node);
+          values.insert(node.value);
+          in_heap[i] = true;
+        }
+        break;
+      case 1:
+        if (in_heap[i]) {
+          values.erase(values.find(node.value));
+          node.value -= int(rng() % 100);
+          values.insert(node.value);
+          heap.decrease_key(&node);
+        }
+        break;
+      case 2:
+        if (in_heap[i]) {
+          heap.remove(&node);
+          values.erase(values.find(node.value));
+          in_heap[i] = false;
+        }
+        break;
+      case 3:
+        if (!heap.empty()) {
+          auto top = heap.pop().unwrap();
+          CHECK(top->value == *values.begin());
+          values.erase(values.begin());
+          in_heap[size_t(top - nodes.data())] = false;
+        }
+        break;
+      }
+
+      REQUIRE(heap.size() == values.size());
+      if (!values.empty()) {
+        REQUIRE(heap.top()->value == *values.begin());
+      }
+    }
+
+    while (!values.empty()) {
+      CHECK(heap.pop().unwrap()->value == *values.begin());
+      values.erase(values.begin());
+    }
+
+    CHECK(heap.empty());
+    CHECK(!heap.pop());
+  }
+
+  TEST_CASE("pop after many inserts") {
+    // Ascending keys leave every node a child of the root, so the first pop
+    // pairs up a million siblings
+    constexpr int COUNT = 1 << 20;
+    PairingHeap<TestNode, &TestNode::hook,
+                [](TestNode *a, TestNode *b) { return a->value < b->value; }>
+        heap;
+    auto nodes = std::make_unique<TestNode[]>(COUNT);
+
+    for (int i = 0; i < COUNT; i++) {
+      nodes[i].value = i;
+      heap.insert(&nodes[i]);
+    }
+
+    for (int i = 0; i < COUNT; i++) {
+      REQUIRE(heap.pop().unwrap()->value == i);
+    }
+
+    CHECK(heap.empty());
+  }
 }
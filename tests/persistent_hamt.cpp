@@ -0,0 +1,272 @@
+#include <atlas/persistent_hamt.hpp>
+#include <atlas/string.hpp>
+#include <cstdio>
+#include <doctest.h>
+
+using namespace atlas;
+
+static size_t live_bytes = 0;
+
+struct CountingAllocator : DefaultAllocator {
+  void *allocate(size_t size) {
+    live_bytes += size;
+    return DefaultAllocator::allocate(size);
+  }
+
+  void deallocate(void *ptr, size_t size) {
+    live_bytes -= size;
+    DefaultAllocator::deallocate(ptr, size);
+  }
+};
+
+TEST_SUITE("PersistentHamt") {
+  TEST_CASE("insert/get") {
+    PersistentHamt<size_t, size_t> empty;
+    auto one = empty.insert(1, 10);
+    auto two = one.insert(2, 20);
+
+    CHECK(empty.size() == 0);
+    CHECK(empty.get(1).is_none());
+
+    CHECK(one.size() == 1);
+    CHECK(one.get(1).unwrap() == 10);
+    CHECK(one.get(2).is_none());
+
+    CHECK(two.size() == 2);
+    CHECK(two.get(1).unwrap() == 10);
+    CHECK(two.get(2).unwrap() == 20);
+
+    auto replaced = two.insert(1, 11);
+    CHECK(replaced.size() == 2);
+    CHECK(replaced.get(1).unwrap() == 11);
+    CHECK(two.get(1).unwrap() == 10);
+  }
+
+  TEST_CASE("old versions stay valid") {
+    PersistentHamt<size_t, size_t, CountingAllocator> versions[101];
+
+    for (size_t i = 0; i < 100; i++) {
+      versions[i + 1] = versions[i].insert(i, i * 2);
+    }
+
+    for (size_t v = 0; v <= 100; v += 10) {
+      CHECK(versions[v].size() == v);
+
+      for (size_t i = 0; i < 100; i++) {
+        CHECK(versions[v].contains(i) == (i < v));
+      }
+    }
+
+    auto removed = versions[100];
+    for (size_t i = 0; i < 100; i += 2) {
+      removed = removed.remove(i);
+    }
+
+    CHECK(removed.size() == 50);
+    for (size_t i = 0; i < 100; i++) {
+      CHECK(removed.contains(i) == (i % 2 == 1));
+      CHECK(versions[100].get(i).unwrap() == i * 2);
+    }
+
+    // Removing a missing key hands back the same version
+    CHECK(removed.remove(0).size() == 50);
+  }
+
+  TEST_CASE("snapshots share tables") {
+    {
+      PersistentHamt<size_t, size_t, CountingAllocator> map;
+
+      for (size_t i = 0; i < 1000; i++) {
+        map = map.insert(i, i);
+      }
+
+      auto before = live_bytes;
+      auto snapshot = map;
+      CHECK(live_bytes == before);
+
+      // An update only copies the path to its key
+      auto updated = snapshot.insert(5, 50);
+      CHECK(live_bytes - before < before / 10);
+      CHECK(updated.get(5).unwrap() == 50);
+      CHECK(map.get(5).unwrap() == 5);
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("removing everything") {
+    {
+      PersistentHamt<size_t, size_t, CountingAllocator> map;
+
+      for (size_t i = 0; i < 500; i++) {
+        map = map.insert(i * 7919, i);
+      }
+
+      for (size_t i = 0; i < 500; i++) {
+        map = map.remove(i * 7919);
+        CHECK(map.get(i * 7919).is_none());
+      }
+
+      CHECK(map.empty());
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("Collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    PersistentHamt<uint64_t, uint64_t, DefaultAllocator, FakeHash> h;
+    auto full = h.insert(1, 1).insert(2, 2).insert(3, 3).insert(4, 4);
+
+    CHECK(full.size() == 4);
+    CHECK(full.get(3).unwrap() == 3);
+
+    auto removed = full.remove(1);
+    CHECK(removed.get(1).is_none());
+    CHECK(removed.get(4).unwrap() == 4);
+    CHECK(full.get(1).unwrap() == 1);
+  }
+
+  TEST_CASE("String keys") {
+    PersistentHamt<String, size_t> map;
+    char name[16];
+
+    for (size_t i = 0; i < 100; i++) {
+      snprintf(name, sizeof(name), "key%zu", i);
+      map = map.insert(String(name), i);
+    }
+
+    auto snapshot = map;
+    map = map.remove(String("key42"));
+
+    CHECK(map.get(String("key42")).is_none());
+    CHECK(snapshot.get(String("key42")).unwrap() == 42);
+    CHECK(map.get(String("key43")).unwrap() == 43);
+  }
+
+  TEST_CASE("transient") {
+    {
+      PersistentHamt<size_t, size_t, CountingAllocator> map;
+
+      for (size_t i = 0; i < 100; i++) {
+        map = map.insert(i, i);
+      }
+
+      auto batch = map.transient();
+
+      for (size_t i = 0; i < 1000; i++) {
+        batch.insert(i, i * 2);
+      }
+
+      for (size_t i = 0; i < 1000; i += 2) {
+        CHECK(batch.remove(i));
+      }
+
+      CHECK_FALSE(batch.remove(0));
+      CHECK(batch.size() == 500);
+      CHECK(batch.get(3).unwrap() == 6);
+
+      auto updated = batch.commit();
+      CHECK(batch.size() == 0);
+
+      CHECK(updated.size() == 500);
+      for (size_t i = 0; i < 1000; i++) {
+        CHECK(updated.contains(i) == (i % 2 == 1));
+      }
+
+      // The version the batch started from didn't change
+      CHECK(map.size() == 100);
+      for (size_t i = 0; i < 100; i++) {
+        CHECK(map.get(i).unwrap() == i);
+      }
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("transient tables are compacted on commit") {
+    size_t persistent_bytes;
+
+    {
+      PersistentHamt<size_t, size_t, CountingAllocator> map;
+
+      for (size_t i = 0; i < 2000; i++) {
+        map = map.insert(i * 7919, i);
+      }
+
+      persistent_bytes = live_bytes;
+    }
+
+    {
+      PersistentHamt<size_t, size_t, CountingAllocator> empty;
+      auto batch = empty.transient();
+
+      for (size_t i = 0; i < 2000; i++) {
+        batch.insert(i * 7919, i);
+      }
+
+      // Tables of the batch have room to grow
+      CHECK(live_bytes > persistent_bytes);
+
+      auto map = batch.commit();
+      CHECK(live_bytes == persistent_bytes);
+
+      // The committed tables are shared like any other
+      auto next = map.insert(1, 1);
+      CHECK(next.get(1).unwrap() == 1);
+      CHECK(map.get(1).is_none());
+      CHECK(map.get(7919).unwrap() == 1);
+    }
+
+    CHECK(live_bytes == 0);
+  }
+
+  TEST_CASE("transient with collisions") {
+    struct FakeHash {
+      uint64_t operator()(uint64_t a, size_t gen = 0) const {
+        return gen ? a : 0;
+      }
+    };
+
+    PersistentHamt<uint64_t, uint64_t, DefaultAllocator, FakeHash> h;
+    auto batch = h.transient();
+
+    for (uint64_t i = 1; i <= 4; i++) {
+      batch.insert(i, i);
+    }
+
+    CHECK(batch.remove(1));
+    auto map = batch.commit();
+
+    CHECK(map.size() == 3);
+    CHECK(map.get(1).is_none());
+    CHECK(map.get(4).unwrap() == 4);
+  }
+
+  TEST_CASE("transient with String keys") {
+    PersistentHamt<String, String> map;
+    auto batch = map.transient();
+    char name[16];
+
+    for (size_t i = 0; i < 200; i++) {
+      snprintf(name, sizeof(name), "key%zu", i);
+      batch.insert(String(name), String(name));
+    }
+
+    for (size_t i = 0; i < 200; i += 3) {
+      snprintf(name, sizeof(name), "key%zu", i);
+      CHECK(batch.remove(String(name)));
+    }
+
+    map = batch.commit();
+
+    CHECK(map.get(String("key0")).is_none());
+    CHECK(map.get(String("key1")).unwrap() == String("key1"));
+    CHECK(map.size() == 133);
+  }
+}
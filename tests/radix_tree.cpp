@@ -0,0 +1,184 @@
+#include <atlas/radix_tree.hpp>
+#include <atlas/string.hpp>
+#include <doctest.h>
+#include <map>
+#include <random>
+#include <set>
+
+using namespace atlas;
+
+TEST_SUITE("Radix tree") {
+  TEST_CASE("insert/get/remove") {
+    RadixTree<uint64_t> tree;
+
+    CHECK(tree.insert(5, 50));
+    CHECK(tree.insert(1000, 10000));
+    CHECK(tree.insert(~0ULL, 1));
+    CHECK_FALSE(tree.insert(5, 0));
+
+    CHECK(tree.size() == 3);
+    CHECK(tree.get(5).unwrap() == 50);
+    CHECK(tree[1000] == 10000);
+    CHECK(tree.get(~0ULL).unwrap() == 1);
+    CHECK(tree.get(6).is_none());
+    CHECK(tree.get(1ULL << 40).is_none());
+
+    CHECK(tree.remove(~0ULL));
+    CHECK_FALSE(tree.remove(~0ULL));
+    CHECK(tree.contains(1000));
+    CHECK(tree.remove(1000));
+    CHECK(tree.remove(5));
+    CHECK(tree.empty());
+    CHECK(tree.get(5).is_none());
+  }
+
+  TEST_CASE("random") {
+    std::mt19937_64 rng(13);
+    RadixTree<uint64_t> tree;
+    std::map<uint64_t, uint64_t> expected;
+
+    // Dense small keys, sparse large ones
+    auto random_key = [&]() -> uint64_t {
+      switch (rng() % 3) {
+      case 0:
+        return rng() % 512;
+      case 1:
+        return rng() % (1 << 20);
+      default:
+        return rng();
+      }
+    };
+
+    for (size_t round = 0; round < 20000; round++) {
+      auto key = random_key();
+
+      if (rng() % 3 == 0) {
+        CHECK(tree.remove(key).is_ok() == (expected.erase(key) == 1));
+      } else {
+        CHECK(tree.insert(key, round).is_ok() ==
+              expected.insert({key, round}).second);
+      }
+    }
+
+    CHECK(tree.size() == expected.size());
+
+    auto it = expected.begin();
+    for (auto entry : tree.iter()) {
+      CHECK(entry.car == it->first);
+      CHECK(entry.cdr == it->second);
+      it++;
+    }
+    CHECK(it == expected.end());
+
+    for (size_t i = 0; i < 100; i++) {
+      auto start = random_key();
+      auto end = start + rng() % (1 << 12);
+
+      auto ref = expected.lower_bound(start);
+      for (auto entry : tree.range(start, end)) {
+        CHECK(entry.car == ref->first);
+        ref++;
+      }
+
+      CHECK((ref == expected.end() || ref->first >= end));
+    }
+
+    for (auto [key, value] : expected) {
+      CHECK(tree.get(key).unwrap() == value);
+    }
+  }
+
+  TEST_CASE("find_free") {
+    RadixTree<uint64_t> tree;
+
+    CHECK(tree.find_free().unwrap() == 0);
+
+    // A root with every slot used
+    for (uint64_t i = 0; i < 64; i++) {
+      CHECK(tree.insert(i, i));
+    }
+
+    CHECK(tree.find_free().unwrap() == 64);
+    tree.clear();
+
+    for (uint64_t i = 0; i < 5000; i++) {
+      CHECK(tree.insert(i, i));
+    }
+
+    CHECK(tree.find_free().unwrap() == 5000);
+    CHECK(tree.find_free(100).unwrap() == 5000);
+    CHECK(tree.find_free(6000).unwrap() == 6000);
+
+    CHECK(tree.remove(4095));
+    CHECK(tree.remove(70));
+    CHECK(tree.find_free().unwrap() == 70);
+    CHECK(tree.find_free(71).unwrap() == 4095);
+
+    CHECK(tree.insert(70, 0));
+    CHECK(tree.insert(4095, 0));
+    CHECK(tree.find_free(1).unwrap() == 5000);
+
+    CHECK(tree.insert(1ULL << 50, 0));
+    CHECK(tree.find_free().unwrap() == 5000);
+    CHECK(tree.find_free(1ULL << 50).unwrap() == (1ULL << 50) + 1);
+
+    CHECK(tree.insert(~0ULL, 0));
+    CHECK(tree.find_free(~0ULL).is_none());
+  }
+
+  TEST_CASE("tags") {
+    std::mt19937_64 rng(17);
+    RadixTree<uint64_t, DefaultAllocator, 2> tree;
+    std::set<uint64_t> tagged;
+
+    for (uint64_t i = 0; i < 3000; i++) {
+      CHECK(tree.insert(i * 37, i));
+    }
+
+    CHECK_FALSE(tree.set_tag(1, 0));
+
+    for (size_t round = 0; round < 3000; round++) {
+      auto key = (rng() % 3000) * 37;
+
+      if (rng() % 2 == 0) {
+        CHECK(tree.set_tag(key, 1));
+        tagged.insert(key);
+      } else {
+        CHECK(tree.clear_tag(key, 1));
+        tagged.erase(key);
+      }
+
+      CHECK(tree.has_tag(key, 1) == tagged.count(key));
+      CHECK_FALSE(tree.has_tag(key, 0));
+
+      auto start = rng() % (3000 * 37);
+      auto next = tagged.lower_bound(start);
+      auto found = tree.next_tagged(start, 1);
+
+      if (next == tagged.end()) {
+        CHECK(found.is_none());
+      } else {
+        CHECK(found.unwrap() == *next);
+      }
+    }
+
+    // Removing an entry drops its tags
+    for (auto key : tagged) {
+      CHECK(tree.remove(key));
+    }
+
+    CHECK(tree.next_tagged(0, 1).is_none());
+  }
+
+  TEST_CASE("String values") {
+    RadixTree<String> tree;
+
+    for (uint64_t i = 0; i < 200; i++) {
+      CHECK(tree.insert(i * 1000, String("long enough to be on the heap")));
+    }
+
+    CHECK(tree.get(1000).unwrap() == String("long enough to be on the heap"));
+    CHECK(tree.remove(1000));
+    CHECK(tree.size() == 199);
+  }
+}
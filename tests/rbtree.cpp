@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <atlas/rbtree.hpp>
 #include <doctest.h>
+#include <random>
 #include <vector>
 
 using namespace atlas;
@@ -7,9 +9,108 @@ using namespace atlas;
 struct MyStruct {
   int val;
 
-  RBTreeNode<MyStruct> hook;
+  RBTreeNode<MyStruct> hook = {};
 };
 
+using PlainTree = RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val>;
+using CachedTree =
+    RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val, RBNoAugment, true>;
+
+struct PackedStruct {
+  int val;
+
+  PackedRBTreeNode<PackedStruct> hook;
+};
+
+// Checks the red-black properties of the subtree of `node`, returns its black
+// height
+template <typename S> static int check_subtree(S *node, S *parent) {
+  if (node == nullptr) {
+    return 1;
+  }
+
+  CHECK(node->hook.get_parent() == parent);
+
+  if (node->hook.get_color() == RBColor::Red) {
+    CHECK((node->hook.left == nullptr ||
+           node->hook.left->hook.get_color() == RBColor::Black));
+    CHECK((node->hook.right == nullptr ||
+           node->hook.right->hook.get_color() == RBColor::Black));
+  }
+
+  if (node->hook.left != nullptr) {
+    CHECK(node->hook.left->val < node->val);
+  }
+
+  if (node->hook.right != nullptr) {
+    CHECK(node->val < node->hook.right->val);
+  }
+
+  auto left = check_subtree(node->hook.left, node);
+  auto right = check_subtree(node->hook.right, node);
+  CHECK(left == right);
+
+  return left + (node->hook.get_color() == RBColor::Black);
+}
+
+template <typename Tree> static void check_ends() {
+  Tree tree;
+  std::mt19937_64 rng(5);
+  std::vector<MyStruct> elems(200);
+  std::vector<bool> present(elems.size(), false);
+  std::vector<int> sorted;
+
+  CHECK(tree.first().is_none());
+  CHECK(tree.last().is_none());
+  CHECK(tree.pop_first().is_none());
+
+  for (size_t i = 0; i < elems.size(); i++) {
+    elems[i].val = (int)i;
+  }
+
+  for (size_t round = 0; round < 2000; round++) {
+    auto i = rng() % elems.size();
+
+    if (present[i]) {
+      tree.remove(&elems[i]);
+      sorted.erase(std::find(sorted.begin(), sorted.end(), (int)i));
+    } else {
+      tree.insert(&elems[i]);
+      sorted.insert(std::lower_bound(sorted.begin(), sorted.end(), (int)i),
+                    (int)i);
+    }
+
+    present[i] = !present[i];
+
+    if (sorted.empty()) {
+      CHECK(tree.first().is_none());
+      CHECK(tree.last().is_none());
+    } else {
+      CHECK(tree.first().unwrap()->val == sorted.front());
+      CHECK(tree.last().unwrap()->val == sorted.back());
+    }
+  }
+
+  for (auto val : sorted) {
+    CHECK(tree.pop_first().unwrap()->val == val);
+  }
+
+  CHECK(tree.empty());
+  CHECK(tree.pop_first().is_none());
+
+  std::vector<MyStruct *> nodes;
+  for (auto &elem : elems) {
+    nodes.push_back(&elem);
+  }
+
+  CHECK(tree.from_sorted(Slice<MyStruct *>(nodes.data(), nodes.size())));
+  CHECK(tree.first().unwrap() == &elems.front());
+  CHECK(tree.last().unwrap() == &elems.back());
+
+  tree.clear([](MyStruct *) {});
+  CHECK(tree.first().is_none());
+}
+
 TEST_SUITE("Red-black tree") {
   RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> tree;
   MyStruct elem_a{13};
@@ -85,4 +186,218 @@ TEST_SUITE("Red-black tree") {
 
     CHECK_FALSE(rev_iter.next().is_some());
   }
+
+  TEST_CASE("bounds") {
+    RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> even;
+    std::vector<MyStruct> elems(100);
+
+    for (int i = 0; i < 100; i++) {
+      elems[i].val = i * 2;
+      even.insert(&elems[i]);
+    }
+
+    CHECK(even.lower_bound(10).unwrap()->val == 10);
+    CHECK(even.lower_bound(11).unwrap()->val == 12);
+    CHECK(even.lower_bound(-5).unwrap()->val == 0);
+    CHECK(even.lower_bound(199).is_none());
+
+    CHECK(even.upper_bound(10).unwrap()->val == 12);
+    CHECK(even.upper_bound(11).unwrap()->val == 12);
+    CHECK(even.upper_bound(198).is_none());
+
+    CHECK(even.floor(10).unwrap()->val == 10);
+    CHECK(even.floor(11).unwrap()->val == 10);
+    CHECK(even.floor(500).unwrap()->val == 198);
+    CHECK(even.floor(-1).is_none());
+
+    CHECK(even.ceil(11).unwrap()->val == 12);
+
+    CHECK(even.successor(&elems[10])->val == 22);
+    CHECK(even.predecessor(&elems[10])->val == 18);
+    CHECK(even.successor(&elems[99]) == nullptr);
+    CHECK(even.predecessor(&elems[0]) == nullptr);
+  }
+
+  TEST_CASE("range") {
+    RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> even;
+    std::vector<MyStruct> elems(100);
+
+    for (int i = 0; i < 100; i++) {
+      elems[i].val = i * 2;
+      even.insert(&elems[i]);
+    }
+
+    std::vector<int> vals;
+    for (auto elem : even.range(15, 25)) {
+      vals.push_back(elem->val);
+    }
+
+    CHECK(vals == std::vector<int>{16, 18, 20, 22, 24});
+
+    vals.clear();
+    for (auto elem : even.range(190, 1000)) {
+      vals.push_back(elem->val);
+    }
+
+    CHECK(vals == std::vector<int>{190, 192, 194, 196, 198});
+
+    CHECK(even.range(21, 22).next().is_none());
+    CHECK(even.range(300, 400).next().is_none());
+  }
+
+  TEST_CASE("from_sorted") {
+    for (int n = 0; n < 130; n++) {
+      RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> built;
+      std::vector<MyStruct> elems(n);
+      std::vector<MyStruct *> nodes;
+
+      for (int i = 0; i < n; i++) {
+        elems[i].val = i * 3;
+        nodes.push_back(&elems[i]);
+      }
+
+      CHECK(built.from_sorted(Slice<MyStruct *>(nodes.data(), nodes.size())));
+
+      if (n > 0) {
+        CHECK(built.root()->hook.color == RBColor::Black);
+      }
+
+      check_subtree<MyStruct>(built.root(), nullptr);
+
+      int expected = 0;
+      for (auto elem : built.iter()) {
+        CHECK(elem->val == expected);
+        expected += 3;
+      }
+
+      CHECK(expected == n * 3);
+
+      // The tree keeps working as a regular one
+      MyStruct extra{1};
+      built.insert(&extra);
+
+      for (int i = 0; i < n; i += 2) {
+        built.remove(&elems[i]);
+      }
+
+      check_subtree<MyStruct>(built.root(), nullptr);
+      CHECK(built.find(1).is_some());
+    }
+  }
+
+  TEST_CASE("from_sorted with unsorted or duplicate keys") {
+    RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> tree;
+    std::vector<MyStruct> elems(100);
+    std::vector<MyStruct *> nodes;
+
+    for (int i = 0; i < 100; i++) {
+      elems[i].val = i;
+      nodes.push_back(&elems[i]);
+    }
+
+    elems[99].val = 98;
+    auto duplicate =
+        tree.from_sorted(Slice<MyStruct *>(nodes.data(), nodes.size()));
+    CHECK(!duplicate);
+    CHECK(duplicate.error() == Error::InvalidParameters);
+    CHECK(tree.empty());
+
+    elems[99].val = 99;
+    std::swap(nodes[10], nodes[11]);
+    auto unsorted =
+        tree.from_sorted(Slice<MyStruct *>(nodes.data(), nodes.size()));
+    CHECK(!unsorted);
+    CHECK(tree.empty());
+  }
+
+  TEST_CASE("clear") {
+    RBTree<MyStruct, &MyStruct::hook, int, &MyStruct::val> tree;
+    std::vector<MyStruct> elems(100);
+
+    for (int i = 0; i < 100; i++) {
+      elems[i].val = (i * 37) % 100;
+      tree.insert(&elems[i]);
+    }
+
+    std::vector<int> destroyed;
+
+    // Children are handed out before their parent
+    tree.clear([&](MyStruct *elem) {
+      CHECK(elem->hook.left == nullptr);
+      CHECK(elem->hook.right == nullptr);
+      destroyed.push_back(elem->val);
+    });
+
+    CHECK(destroyed.size() == 100);
+    CHECK(tree.empty());
+  }
+
+  TEST_CASE("first/last") { check_ends<PlainTree>(); }
+
+  TEST_CASE("first/last cached") { check_ends<CachedTree>(); }
+
+  TEST_CASE("packed hook") {
+    CHECK(sizeof(PackedRBTreeNode<PackedStruct>) == 3 * sizeof(void *));
+
+    RBTree<PackedStruct, &PackedStruct::hook, int, &PackedStruct::val> packed;
+    std::mt19937_64 rng(9);
+    std::vector<PackedStruct> elems(300);
+    std::vector<bool> present(elems.size(), false);
+
+    for (size_t i = 0; i < elems.size(); i++) {
+      elems[i].val = (int)i;
+    }
+
+    for (size_t round = 0; round < 3000; round++) {
+      auto i = rng() % elems.size();
+
+      if (present[i]) {
+        packed.remove(&elems[i]);
+      } else {
+        packed.insert(&elems[i]);
+      }
+
+      present[i] = !present[i];
+
+      if (round % 100 == 0) {
+        check_subtree<PackedStruct>(packed.root(), nullptr);
+      }
+    }
+
+    check_subtree<PackedStruct>(packed.root(), nullptr);
+
+    int prev = -1;
+    size_t count = 0;
+
+    for (auto elem : packed.iter()) {
+      CHECK(present[elem->val]);
+      CHECK(prev < elem->val);
+      prev = elem->val;
+      count++;
+    }
+
+    CHECK(count == (size_t)std::count(present.begin(), present.end(), true));
+  }
+
+  TEST_CASE("merge_join") {
+    PlainTree a, b;
+    MyStruct a_elems[] = {{1}, {3}, {5}, {7}};
+    MyStruct b_elems[] = {{2}, {3}, {7}, {9}};
+
+    for (auto &elem : a_elems) {
+      a.insert(&elem);
+    }
+
+    for (auto &elem : b_elems) {
+      b.insert(&elem);
+    }
+
+    std::vector<std::pair<int, int>> joined;
+    a.merge_join(b, [&](MyStruct *x, MyStruct *y) {
+      joined.push_back({x ? x->val : 0, y ? y->val : 0});
+    });
+
+    CHECK(joined == std::vector<std::pair<int, int>>{
+                        {1, 0}, {0, 2}, {3, 3}, {5, 0}, {7, 7}, {0, 9}});
+  }
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <atlas/hamt.hpp>
+#include <atlas/hashmap.hpp>
+#include <atlas/siphash.hpp>
+#include <doctest.h>
+
+using namespace atlas;
+
+TEST_SUITE("SipHash") {
+  TEST_CASE("reference vectors") {
+    uint8_t key[16];
+    uint8_t input[16];
+
+    for (uint8_t i = 0; i < 16; i++) {
+      key[i] = i;
+      input[i] = i;
+    }
+
+    uint64_t k0;
+    uint64_t k1;
+    memcpy(&k0, key, 8);
+    memcpy(&k1, key + 8, 8);
+
+    // From the SipHash-2-4 paper
+    CHECK(sip_hash<2, 4>(k0, k1, input, 0) == 0x726fdb47dd0e0e31LLU);
+    CHECK(sip_hash<2, 4>(k0, k1, input, 1) == 0x74f839c593dc67fdLLU);
+    CHECK(sip_hash<2, 4>(k0, k1, input, 15) == 0xa129ca6149be45e5LLU);
+
+    // SipHash-1-3, which SipHash<T> uses, from the reference implementation
+    // built with cROUNDS=1 and dROUNDS=3
+    CHECK(sip_hash<1, 3>(k0, k1, input, 0) == 0xabac0158050fc4dcLLU);
+    CHECK(sip_hash<1, 3>(k0, k1, input, 1) == 0xc9f49bf37d57ca93LLU);
+    CHECK(sip_hash<1, 3>(k0, k1, input, 7) == 0xd3927d989bb11140LLU);
+    CHECK(sip_hash<1, 3>(k0, k1, input, 8) == 0x369095118d299a8eLLU);
+    CHECK(sip_hash<1, 3>(k0, k1, input, 15) == 0xd320d86d2a519956LLU);
+  }
+
+  TEST_CASE("keys") {
+    SipHash<StringView> a;
+    SipHash<StringView> b;
+
+    // Each hasher gets its own key
+    CHECK(a("hello"_sv) == a("hello"_sv));
+    CHECK(a("hello"_sv) != b("hello"_sv));
+    CHECK(a("hello"_sv, 0) != a("hello"_sv, 1));
+
+    // Copies share the key of the original
+    auto c = a;
+    CHECK(c("hello"_sv) == a("hello"_sv));
+  }
+
+  TEST_CASE("containers") {
+    HashMap<StringView, int, DefaultAllocator, SipHash<StringView>> map;
+    Hamt<uint64_t, uint64_t, DefaultAllocator, SipHash<uint64_t>> hamt;
+
+    CHECK(map.insert("hello"_sv, 1));
+    CHECK(map.insert("world"_sv, 2));
+    CHECK(map.get("hello"_sv).unwrap() == 1);
+    CHECK(map.get("world"_sv).unwrap() == 2);
+
+    for (uint64_t i = 0; i < 500; i++) {
+      hamt.insert(i, i);
+    }
+
+    for (uint64_t i = 0; i < 500; i++) {
+      CHECK(hamt.get(i).unwrap() == i);
+    }
+  }
+}
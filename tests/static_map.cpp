@@ -0,0 +1,101 @@
+#include <atlas/static_map.hpp>
+#include <doctest.h>
+
+using namespace atlas;
+
+enum class Keyword { If, Else, While, Return };
+
+constexpr auto keywords = make_static_map<StringView, Keyword>({
+    {"if"_sv, Keyword::If},
+    {"else"_sv, Keyword::Else},
+    {"while"_sv, Keyword::While},
+    {"return"_sv, Keyword::Return},
+});
+
+static_assert(keywords.size() == 4);
+static_assert(*keywords.get("while"_sv) == Keyword::While);
+static_assert(keywords["return"_sv] == Keyword::Return);
+static_assert(keywords.get("for"_sv).is_none());
+static_assert(!keywords.contains("iff"_sv));
+
+constexpr auto squares = [] {
+  Cons<int, int> entries[64] = {
+#define S(X) {X, (X) * (X)}
+      S(0),  S(1),  S(2),  S(3),  S(4),  S(5),  S(6),  S(7),  S(8),  S(9),
+      S(10), S(11), S(12), S(13), S(14), S(15), S(16), S(17), S(18), S(19),
+      S(20), S(21), S(22), S(23), S(24), S(25), S(26), S(27), S(28), S(29),
+      S(30), S(31), S(32), S(33), S(34), S(35), S(36), S(37), S(38), S(39),
+      S(40), S(41), S(42), S(43), S(44), S(45), S(46), S(47), S(48), S(49),
+      S(50), S(51), S(52), S(53), S(54), S(55), S(56), S(57), S(58), S(59),
+      S(60), S(61), S(62), S(63),
+#undef S
+  };
+  return make_static_map(entries);
+}();
+
+static_assert(squares[12] == 144);
+
+// Hundreds of sequential keys, at and just below powers of two
+template <size_t... I>
+constexpr auto make_sequential(std::index_sequence<I...>) {
+  Cons<int, int> entries[] = {{int(I), int(I) * 3}...};
+  return make_static_map(entries);
+}
+
+constexpr auto sequential_512 =
+    make_sequential(std::make_index_sequence<512>());
+constexpr auto sequential_1000 =
+    make_sequential(std::make_index_sequence<1000>());
+constexpr auto sequential_1024 =
+    make_sequential(std::make_index_sequence<1024>());
+
+static_assert(sequential_1024[1023] == 3069);
+
+TEST_SUITE("StaticMap") {
+  TEST_CASE("string keys") {
+    CHECK(keywords.get("if"_sv).unwrap() == Keyword::If);
+    CHECK(keywords.get("else"_sv).unwrap() == Keyword::Else);
+    CHECK(keywords.get(StringView("while")).unwrap() == Keyword::While);
+    CHECK_FALSE(keywords.get("whilst"_sv).is_some());
+    CHECK_THROWS((void)keywords["foo"_sv]);
+  }
+
+  TEST_CASE("integer keys") {
+    for (int i = 0; i < 64; i++) {
+      CHECK(squares.get(i).unwrap() == i * i);
+    }
+
+    CHECK_FALSE(squares.contains(64));
+    CHECK_FALSE(squares.contains(-1));
+  }
+
+  TEST_CASE("hundreds of keys") {
+    for (int i = 0; i < 1024; i++) {
+      CHECK(sequential_1024.get(i).unwrap() == i * 3);
+
+      if (i < 1000) {
+        CHECK(sequential_1000.get(i).unwrap() == i * 3);
+      }
+
+      if (i < 512) {
+        CHECK(sequential_512.get(i).unwrap() == i * 3);
+      }
+    }
+
+    CHECK_FALSE(sequential_512.contains(512));
+    CHECK_FALSE(sequential_1000.contains(1000));
+    CHECK_FALSE(sequential_1024.contains(-1));
+    CHECK_FALSE(sequential_1024.contains(1024));
+  }
+
+  TEST_CASE("enum keys") {
+    constexpr auto names = make_static_map<Keyword, StringView>({
+        {Keyword::If, "if"_sv},
+        {Keyword::Return, "return"_sv},
+    });
+
+    static_assert(names[Keyword::If] == "if"_sv);
+    CHECK(names.get(Keyword::Return).unwrap() == "return"_sv);
+    CHECK_FALSE(names.contains(Keyword::Else));
+  }
+}